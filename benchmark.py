@@ -21,6 +21,16 @@ l (5 i = 0 : i < 10000 : i = i + 1) {
   total = total + i
 }
 z.o(total)
+""",
+    "local_loop": """#alphabet<en>
+m 5 sum_to(5 limit) {
+  5 total = 0
+  l (5 i = 0 : i < limit : i = i + 1) {
+    total = total + i
+  }
+  r total
+}
+z.o(sum_to(10000))
 """,
     "string_concat": """#alphabet<en>
 5 sb = z.builder()
@@ -44,6 +54,29 @@ l (5 i = 0 : i < 1000 : i = i + 1) {
 }
 z.o(z.len(m))
 """,
+    "call_frames": """#alphabet<en>
+m 5 fib(5 num) {
+  i (num <= 1) { r num }
+  r fib(num - 1) + fib(num - 2)
+}
+m 5 guarded(5 v) {
+  t {
+    r v + 1
+  } h (12 err) {
+    r 0
+  }
+}
+5 total = 0
+l (5 k = 0 : k < 200000 : k = k + 1) {
+  total = total + guarded(k)
+}
+z.o(fib(25) + total)
+""",
+}
+
+# Function calls made by a benchmark, to report call frames per second.
+FRAMES = {
+    "call_frames": 242785 + 200000,
 }
 
 
@@ -65,14 +98,15 @@ def run_benchmark(name, code, iterations=1):
 
 
 def main():
-    print(f"{'Benchmark':<20} {'Time (ms)':<12} {'Status'}")
-    print("-" * 50)
+    print(f"{'Benchmark':<20} {'Time (ms)':<12} {'Status':<8} {'Frames/s'}")
+    print("-" * 60)
 
     for name, code in BENCHMARKS.items():
         try:
             ms = run_benchmark(name, code)
             status = "PASS" if ms < 10000 else "SLOW"
-            print(f"{name:<20} {ms:<12.1f} {status}")
+            rate = f"{FRAMES[name] / (ms / 1000):,.0f}" if name in FRAMES else ""
+            print(f"{name:<20} {ms:<12.1f} {status:<8} {rate}")
         except Exception as e:
             print(f"{name:<20} {'N/A':<12} FAIL: {e}")
 
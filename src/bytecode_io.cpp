@@ -142,6 +142,10 @@ static void write_method(std::ostream& os, const CompiledMethod& m) {
     for (const auto& dv : m.default_value_bytecodes) {
         write_bytecode(os, dv);
     }
+    write_u32(os, static_cast<uint32_t>(m.local_names.size()));
+    for (const auto& l : m.local_names)
+        write_string(os, l);
+    write_bytecode(os, m.specialized);
 }
 
 static CompiledMethod read_method(std::istream& is) {
@@ -153,6 +157,10 @@ static CompiledMethod read_method(std::istream& is) {
     uint32_t dc = read_u32(is);
     for (uint32_t i = 0; i < dc; ++i)
         m.default_value_bytecodes.push_back(read_bytecode(is));
+    uint32_t lc = read_u32(is);
+    for (uint32_t i = 0; i < lc; ++i)
+        m.local_names.push_back(read_string(is));
+    m.specialized = read_bytecode(is);
     return m;
 }
 
@@ -1,6 +1,9 @@
 #include "compiler.h"
+#include "inliner.h"
 #include "lexer.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "ssa.h"
 #include <algorithm>
 #include <fstream>
 #include <sstream>
@@ -17,6 +20,170 @@ static const std::unordered_map<std::string, std::string> TYPE_NAME_TO_ID = {
     {"i32", "3"},   {"i64", "4"},    {"bool", "11"},   {"boolean", "11"}, {"string", "12"}, {"str", "12"},
     {"list", "13"}, {"array", "13"}, {"map", "14"},    {"dict", "14"},    {"dec", "9"},     {"cpx", "10"}};
 
+static bool is_integer_type(uint16_t type_id) {
+    return type_id >= TypeManager::I8 && type_id <= TypeManager::TYPE_INT;
+}
+
+static bool is_integer_literal(const ExprPtr& expr) {
+    if (auto* ue = dynamic_cast<const Unary*>(expr.get()))
+        return ue->op.type == TokenType::MINUS && is_integer_literal(ue->right);
+    auto* le = dynamic_cast<const Literal*>(expr.get());
+    return le && std::holds_alternative<int64_t>(le->value);
+}
+
+// Names declared by a function body (including nested blocks) become frame
+// slots. Nested lambdas and functions are not descended into.
+static void collect_declared(const StmtPtr& stmt, std::vector<std::string>& out) {
+    if (!stmt)
+        return;
+    auto add = [&out](const std::string& name) {
+        if (std::find(out.begin(), out.end(), name) == out.end())
+            out.push_back(name);
+    };
+    if (auto* vs = dynamic_cast<const VarStmt*>(stmt.get())) {
+        add(sv_to_str(vs->name.lexeme));
+    } else if (auto* fe = dynamic_cast<const ForEachStmt*>(stmt.get())) {
+        // The loop variable and the hidden iterator; the desugared index
+        // is never emitted.
+        collect_declared(fe->statements[0], out);
+        add(sv_to_str(fe->item.lexeme));
+        collect_declared(fe->body, out);
+    } else if (auto* bs = dynamic_cast<const Block*>(stmt.get())) {
+        for (const auto& s : bs->statements)
+            collect_declared(s, out);
+    } else if (auto* is = dynamic_cast<const IfStmt*>(stmt.get())) {
+        collect_declared(is->then_branch, out);
+        collect_declared(is->else_branch, out);
+    } else if (auto* ls = dynamic_cast<const LoopStmt*>(stmt.get())) {
+        collect_declared(ls->body, out);
+    } else if (auto* fs = dynamic_cast<const ForStmt*>(stmt.get())) {
+        collect_declared(fs->initializer, out);
+        collect_declared(fs->body, out);
+    } else if (auto* ts = dynamic_cast<const TryStmt*>(stmt.get())) {
+        for (const auto& s : ts->try_block.statements)
+            collect_declared(s, out);
+        add(sv_to_str(ts->exception_var.lexeme));
+        for (const auto& s : ts->handle_block.statements)
+            collect_declared(s, out);
+    } else if (auto* ms = dynamic_cast<const MatchStmt*>(stmt.get())) {
+        for (const auto& c : ms->cases)
+            collect_declared(c.body, out);
+        collect_declared(ms->default_case, out);
+    }
+}
+
+static void collect_captured(const StmtPtr& stmt, bool nested, std::unordered_set<std::string>& out);
+
+// Lambdas see only globals, so any name referenced inside a nested lambda or
+// function body must stay global in the enclosing function.
+static void collect_captured(const ExprPtr& expr, bool nested, std::unordered_set<std::string>& out) {
+    if (!expr)
+        return;
+    if (auto* e = dynamic_cast<const Variable*>(expr.get())) {
+        if (nested)
+            out.insert(sv_to_str(e->name.lexeme));
+    } else if (auto* e = dynamic_cast<const Assign*>(expr.get())) {
+        if (nested)
+            out.insert(sv_to_str(e->name.lexeme));
+        collect_captured(e->value, nested, out);
+    } else if (auto* e = dynamic_cast<const Binary*>(expr.get())) {
+        collect_captured(e->left, nested, out);
+        collect_captured(e->right, nested, out);
+    } else if (auto* e = dynamic_cast<const Logical*>(expr.get())) {
+        collect_captured(e->left, nested, out);
+        collect_captured(e->right, nested, out);
+    } else if (auto* e = dynamic_cast<const Unary*>(expr.get())) {
+        collect_captured(e->right, nested, out);
+    } else if (auto* e = dynamic_cast<const Grouping*>(expr.get())) {
+        collect_captured(e->expression, nested, out);
+    } else if (auto* e = dynamic_cast<const TernaryExpr*>(expr.get())) {
+        collect_captured(e->condition, nested, out);
+        collect_captured(e->true_expr, nested, out);
+        collect_captured(e->false_expr, nested, out);
+    } else if (auto* e = dynamic_cast<const FString*>(expr.get())) {
+        for (const auto& part : e->parts)
+            collect_captured(part.expr, nested, out);
+    } else if (auto* e = dynamic_cast<const Call*>(expr.get())) {
+        collect_captured(e->callee, nested, out);
+        for (const auto& a : e->arguments)
+            collect_captured(a, nested, out);
+    } else if (auto* e = dynamic_cast<const Get*>(expr.get())) {
+        collect_captured(e->obj, nested, out);
+    } else if (auto* e = dynamic_cast<const NullSafeGet*>(expr.get())) {
+        collect_captured(e->obj, nested, out);
+    } else if (auto* e = dynamic_cast<const Set*>(expr.get())) {
+        collect_captured(e->obj, nested, out);
+        collect_captured(e->value, nested, out);
+    } else if (auto* e = dynamic_cast<const New*>(expr.get())) {
+        for (const auto& a : e->arguments)
+            collect_captured(a, nested, out);
+    } else if (auto* e = dynamic_cast<const ListLiteral*>(expr.get())) {
+        for (const auto& el : e->elements)
+            collect_captured(el, nested, out);
+    } else if (auto* e = dynamic_cast<const MapLiteral*>(expr.get())) {
+        for (const auto& k : e->keys)
+            collect_captured(k, nested, out);
+        for (const auto& v : e->values)
+            collect_captured(v, nested, out);
+    } else if (auto* e = dynamic_cast<const IndexExpr*>(expr.get())) {
+        collect_captured(e->obj, nested, out);
+        collect_captured(e->index, nested, out);
+    } else if (auto* e = dynamic_cast<const IndexAssign*>(expr.get())) {
+        collect_captured(e->obj, nested, out);
+        collect_captured(e->index, nested, out);
+        collect_captured(e->value, nested, out);
+    } else if (auto* e = dynamic_cast<const LambdaExpr*>(expr.get())) {
+        for (const auto& s : e->body)
+            collect_captured(s, true, out);
+    }
+}
+
+static void collect_captured(const StmtPtr& stmt, bool nested, std::unordered_set<std::string>& out) {
+    if (!stmt)
+        return;
+    if (auto* s = dynamic_cast<const ExpressionStmt*>(stmt.get())) {
+        collect_captured(s->expression, nested, out);
+    } else if (auto* s = dynamic_cast<const VarStmt*>(stmt.get())) {
+        if (nested)
+            out.insert(sv_to_str(s->name.lexeme));
+        collect_captured(s->initializer, nested, out);
+    } else if (auto* s = dynamic_cast<const ReturnStmt*>(stmt.get())) {
+        collect_captured(s->value, nested, out);
+    } else if (auto* s = dynamic_cast<const Block*>(stmt.get())) {
+        for (const auto& st : s->statements)
+            collect_captured(st, nested, out);
+    } else if (auto* s = dynamic_cast<const IfStmt*>(stmt.get())) {
+        collect_captured(s->condition, nested, out);
+        collect_captured(s->then_branch, nested, out);
+        collect_captured(s->else_branch, nested, out);
+    } else if (auto* s = dynamic_cast<const LoopStmt*>(stmt.get())) {
+        collect_captured(s->condition, nested, out);
+        collect_captured(s->body, nested, out);
+    } else if (auto* s = dynamic_cast<const ForStmt*>(stmt.get())) {
+        collect_captured(s->initializer, nested, out);
+        collect_captured(s->condition, nested, out);
+        collect_captured(s->increment, nested, out);
+        collect_captured(s->body, nested, out);
+    } else if (auto* s = dynamic_cast<const TryStmt*>(stmt.get())) {
+        for (const auto& st : s->try_block.statements)
+            collect_captured(st, nested, out);
+        if (nested)
+            out.insert(sv_to_str(s->exception_var.lexeme));
+        for (const auto& st : s->handle_block.statements)
+            collect_captured(st, nested, out);
+    } else if (auto* s = dynamic_cast<const MatchStmt*>(stmt.get())) {
+        collect_captured(s->expression, nested, out);
+        for (const auto& c : s->cases) {
+            collect_captured(c.pattern, nested, out);
+            collect_captured(c.body, nested, out);
+        }
+        collect_captured(s->default_case, nested, out);
+    } else if (auto* s = dynamic_cast<const FunctionStmt*>(stmt.get())) {
+        for (const auto& st : s->body)
+            collect_captured(st, true, out);
+    }
+}
+
 uint16_t Compiler::resolve_type_id(const Token& type_id) {
     std::string s = sv_to_str(type_id.lexeme);
     auto it = TYPE_NAME_TO_ID.find(s);
@@ -242,6 +409,8 @@ void Compiler::validate_expression_type(const ExprPtr& expr, uint16_t expected_t
     }
 }
 
+int Compiler::default_opt_level_ = DEFAULT_OPT_LEVEL;
+
 Compiler::Compiler() = default;
 
 Program Compiler::compile(const std::vector<StmtPtr>& statements) {
@@ -301,61 +470,230 @@ Program Compiler::compile(const std::vector<StmtPtr>& statements) {
     pending_classes_.clear();
 
     program.globals = globals_;
+    program.constant_pool = constant_pool_;
     program.functions = std::move(pending_functions_);
     pending_functions_.clear();
 
-    optimize_bytecode(program.main);
+    // Inlining comes first, so the passes see each copy in its caller.
+    // Specialized bodies were optimized before specializing, and must keep
+    // the same layout as their twins.
+    if (opt_level_ >= 2)
+        inline_calls(program);
+    optimize_body(program.main, opt_level_);
     for (auto& [id, cls] : program.classes) {
         for (auto& [mname, method] : cls.methods) {
-            optimize_bytecode(method.bytecode);
+            if (method.specialized.empty())
+                optimize_method(method);
         }
         for (auto& [mname, method] : cls.static_methods) {
-            optimize_bytecode(method.bytecode);
+            if (method.specialized.empty())
+                optimize_method(method);
         }
     }
     for (auto& [name, func] : program.functions) {
-        optimize_bytecode(func.bytecode);
+        if (func.specialized.empty())
+            optimize_method(func);
     }
 
     return program;
 }
 
-void Compiler::optimize_bytecode(std::vector<Instruction>& code) {
+// Function bodies keep their locals in slots, which is what the SSA passes
+// work on; top-level code keeps them in globals that any call may change.
+void Compiler::optimize_method(CompiledMethod& method) {
+    optimize_body(method.bytecode, opt_level_);
+    if (opt_level_ >= 2)
+        optimize_ssa(method);
+}
+
+// is_target[i] is set when some jump lands on instruction i (or, for
+// i == code.size(), runs off the end).
+static std::vector<bool> jump_targets(const std::vector<Instruction>& code) {
+    std::vector<bool> is_target(code.size() + 1, false);
+    for (const auto& instr : code) {
+        auto* target = std::get_if<int64_t>(&instr.operand);
+        if (is_jump_op(instr.op) && target && *target >= 0 && static_cast<size_t>(*target) <= code.size())
+            is_target[*target] = true;
+    }
+    return is_target;
+}
+
+// A value pushed by this instruction is never an integer.
+static bool pushes_non_integer(const Instruction& instr) {
+    OpCode op = instr.op;
+    if (is_register_op(instr.op)) {
+        auto* packed = std::get_if<int64_t>(&instr.operand);
+        if (!packed || !RegisterOperands::unpack(*packed).push)
+            return false;
+        op = register_base_op(instr.op);
+    }
+    switch (op) {
+    case OpCode::PUSH_CONST:
+        return !std::holds_alternative<int64_t>(instr.operand);
+    case OpCode::DIV:
+    case OpCode::EQ:
+    case OpCode::NE:
+    case OpCode::GT:
+    case OpCode::GE:
+    case OpCode::LT:
+    case OpCode::LE:
+    case OpCode::NOT:
+    case OpCode::BUILD_LIST:
+    case OpCode::BUILD_MAP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Strict mode. Integer-typed slots that are only ever assigned integers
+// (integer constants, arithmetic on such slots, or stores checked at run
+// time) are proven integers. method.specialized is a copy of the body that
+// relies on this: arithmetic and comparisons on proven slots read them
+// unchecked, stores into them check their value, and parameters are guarded
+// on entry. Both copies get the same prologue, so every instruction keeps its
+// index and a failed check resumes in method.bytecode at the same ip.
+void Compiler::specialize_integers(CompiledMethod& method, const std::vector<uint16_t>& slot_types) {
+    std::vector<Instruction>& code = method.bytecode;
+    size_t slot_count = slot_types.size();
+    std::vector<bool> proven(slot_count);
+    for (size_t s = 0; s < slot_count; ++s)
+        proven[s] = is_integer_type(slot_types[s]);
+
+    std::vector<bool> is_target = jump_targets(code);
+    auto int_source = [&](uint16_t index, bool is_const) {
+        if (is_const)
+            return index < constant_pool_.size() && std::holds_alternative<int64_t>(constant_pool_[index]);
+        return index < slot_count && proven[index];
+    };
+
+    // Drop slots with a write that is not known to produce an integer, until
+    // no more drop out.
     bool changed = true;
     while (changed) {
         changed = false;
-        for (size_t i = 0; i + 2 < code.size(); ++i) {
-            if (code[i].op != OpCode::PUSH_CONST)
-                continue;
-            if (code[i + 1].op != OpCode::PUSH_CONST)
-                continue;
-            OpCode op3 = code[i + 2].op;
-            if (op3 != OpCode::ADD && op3 != OpCode::SUB && op3 != OpCode::MUL && op3 != OpCode::DIV)
-                continue;
-
-            auto* a_d = std::get_if<double>(&code[i].operand);
-            auto* b_d = std::get_if<double>(&code[i + 1].operand);
-            if (!a_d || !b_d)
+        auto reject = [&](size_t slot) {
+            if (slot < slot_count && proven[slot]) {
+                proven[slot] = false;
+                changed = true;
+            }
+        };
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instruction& instr = code[i];
+            auto* operand = std::get_if<int64_t>(&instr.operand);
+            if (!operand)
                 continue;
-
-            double result = 0;
-            if (op3 == OpCode::ADD)
-                result = *a_d + *b_d;
-            else if (op3 == OpCode::SUB)
-                result = *a_d - *b_d;
-            else if (op3 == OpCode::MUL)
-                result = *a_d * *b_d;
-            else if (op3 == OpCode::DIV) {
-                if (*b_d == 0.0)
+            if (instr.op == OpCode::STORE_LOCAL) {
+                if (i > 0 && !is_target[i] && pushes_non_integer(code[i - 1]))
+                    reject(static_cast<size_t>(*operand));
+            } else if (instr.op == OpCode::APPEND_LOCAL) {
+                reject(AppendOperands::unpack(*operand).target);
+            } else if (is_register_op(instr.op)) {
+                RegisterOperands regs = RegisterOperands::unpack(*operand);
+                if (regs.push)
                     continue;
-                result = *a_d / *b_d;
+                switch (register_base_op(instr.op)) {
+                case OpCode::ADD:
+                case OpCode::SUB:
+                case OpCode::MUL:
+                case OpCode::PERCENT:
+                    if (!int_source(regs.lhs, regs.lhs_const) || !int_source(regs.rhs, regs.rhs_const))
+                        reject(regs.dst);
+                    break;
+                case OpCode::NOP: // MOVE_R; slot sources are checked at run time
+                    if (regs.lhs_const && !int_source(regs.lhs, true))
+                        reject(regs.dst);
+                    break;
+                default:
+                    reject(regs.dst);
+                    break;
+                }
             }
+        }
+    }
+    if (std::none_of(proven.begin(), proven.end(), [](bool p) { return p; }))
+        return;
 
-            code[i].operand = result;
-            code.erase(code.begin() + static_cast<ptrdiff_t>(i + 1), code.begin() + static_cast<ptrdiff_t>(i + 3));
-            changed = true;
+    static const std::unordered_map<OpCode, OpCode> SPECIALIZED_OPS = {
+        {OpCode::ADD_R, OpCode::ADD_II}, {OpCode::ADD_I, OpCode::ADD_II},
+        {OpCode::SUB_R, OpCode::SUB_II}, {OpCode::SUB_I, OpCode::SUB_II},
+        {OpCode::MUL_R, OpCode::MUL_II}, {OpCode::PERCENT_R, OpCode::PERCENT_II},
+        {OpCode::EQ_R, OpCode::EQ_II},   {OpCode::NE_R, OpCode::NE_II},
+        {OpCode::GT_R, OpCode::GT_II},   {OpCode::GE_R, OpCode::GE_II},
+        {OpCode::LT_R, OpCode::LT_II},   {OpCode::LT_I, OpCode::LT_II},
+        {OpCode::LE_R, OpCode::LE_II},   {OpCode::LE_I, OpCode::LE_II},
+    };
+    std::vector<Instruction> specialized = code;
+    bool rewritten = false;
+    for (size_t i = 0; i < specialized.size(); ++i) {
+        Instruction& instr = specialized[i];
+        auto* operand = std::get_if<int64_t>(&instr.operand);
+        OpCode op = instr.op;
+        if (op == OpCode::LOAD_INDEX && i > 0 && !is_target[i]) {
+            // The index is whatever the previous instruction pushed.
+            const Instruction& prev = specialized[i - 1];
+            auto* prev_operand = std::get_if<int64_t>(&prev.operand);
+            bool int_index =
+                (prev.op == OpCode::PUSH_CONST && prev_operand) ||
+                (prev.op == OpCode::LOAD_LOCAL && prev_operand && int_source(static_cast<uint16_t>(*prev_operand), false)) ||
+                ((prev.op == OpCode::ADD_II || prev.op == OpCode::SUB_II || prev.op == OpCode::MUL_II ||
+                  prev.op == OpCode::PERCENT_II) &&
+                 RegisterOperands::unpack(*prev_operand).push);
+            if (int_index)
+                instr.op = OpCode::LOAD_INDEX_I;
+        } else if (!operand) {
+            continue;
+        } else if (op == OpCode::STORE_LOCAL && int_source(static_cast<uint16_t>(*operand), false)) {
+            instr.op = OpCode::STORE_LOCAL_I;
+        } else if (op == OpCode::INC_I && int_source(IncrementOperands::unpack(*operand).slot, false)) {
+            instr.op = OpCode::INC_II;
+        } else if (op == OpCode::MOVE_R) {
+            RegisterOperands regs = RegisterOperands::unpack(*operand);
+            if (!regs.push && int_source(regs.dst, false) && !int_source(regs.lhs, regs.lhs_const))
+                instr.op = OpCode::MOVE_I;
+        } else if (is_register_op(op)) {
+            RegisterOperands regs = RegisterOperands::unpack(*operand);
+            auto it = SPECIALIZED_OPS.find(op);
+            if (it != SPECIALIZED_OPS.end() && int_source(regs.lhs, regs.lhs_const) &&
+                int_source(regs.rhs, regs.rhs_const))
+                instr.op = it->second;
         }
+        rewritten = rewritten || instr.op != op;
     }
+    if (!rewritten)
+        return;
+
+    // Prologue: guard proven parameters, and start other proven slots at zero
+    // so both copies agree on reads before the first store.
+    std::vector<Instruction> prologue;
+    std::vector<Instruction> generic_prologue;
+    RegisterOperands zero;
+    zero.lhs = static_cast<uint16_t>(add_constant(static_cast<int64_t>(0)));
+    zero.lhs_const = true;
+    for (size_t s = 0; s < slot_count; ++s) {
+        if (!proven[s])
+            continue;
+        if (s < method.param_names.size()) {
+            prologue.emplace_back(OpCode::GUARD_INT, Operand(static_cast<int64_t>(s)));
+            generic_prologue.emplace_back(OpCode::NOP);
+        } else {
+            zero.dst = static_cast<uint16_t>(s);
+            prologue.emplace_back(OpCode::MOVE_R, Operand(zero.pack()));
+            generic_prologue.emplace_back(OpCode::MOVE_R, Operand(zero.pack()));
+        }
+    }
+    auto relocate = [&](std::vector<Instruction>& body, std::vector<Instruction> head) {
+        for (auto& instr : body) {
+            auto* target = std::get_if<int64_t>(&instr.operand);
+            if (is_jump_op(instr.op) && target)
+                *target += static_cast<int64_t>(head.size());
+        }
+        head.insert(head.end(), std::make_move_iterator(body.begin()), std::make_move_iterator(body.end()));
+        body = std::move(head);
+    };
+    relocate(code, std::move(generic_prologue));
+    relocate(specialized, std::move(prologue));
+    method.specialized = std::move(specialized);
 }
 
 void Compiler::emit(OpCode op, Operand operand, int line) {
@@ -392,6 +730,8 @@ void Compiler::visit(const StmtPtr& stmt) {
         visit_for(*fs);
     } else if (auto* ts = dynamic_cast<const TryStmt*>(stmt.get())) {
         visit_try(*ts);
+    } else if (auto* fes = dynamic_cast<const ForEachStmt*>(stmt.get())) {
+        visit_for_each(*fes);
     } else if (auto* bs = dynamic_cast<const Block*>(stmt.get())) {
         visit_block(*bs);
     } else if (auto* cs = dynamic_cast<const ClassStmt*>(stmt.get())) {
@@ -411,12 +751,7 @@ void Compiler::visit(const StmtPtr& stmt) {
         visit_continue(*cs);
     } else if (auto* fs = dynamic_cast<const FunctionStmt*>(stmt.get())) {
         std::string func_name = sv_to_str(fs->name.lexeme);
-        CompiledMethod info;
-        info.bytecode = compile_method(*fs);
-        for (const auto& param : fs->params) {
-            info.param_names.push_back(sv_to_str(param.name.lexeme));
-        }
-        pending_functions_[func_name] = std::move(info);
+        pending_functions_[func_name] = compile_method(*fs);
     }
 }
 
@@ -463,6 +798,11 @@ void Compiler::visit_expr(const ExprPtr& expr) {
 void Compiler::visit_return(const ReturnStmt& stmt) {
     if (stmt.value) {
         visit_expr(stmt.value);
+        // `r f(...)` in a function body: the callee may take over the frame.
+        if (!local_scopes_.empty() && dynamic_cast<const Call*>(stmt.value.get()) && !bytecode_.empty() &&
+            bytecode_.back().op == OpCode::CALL) {
+            bytecode_.back().op = OpCode::TAIL_CALL;
+        }
     } else {
         emit(OpCode::PUSH_CONST, nullptr, stmt.keyword.line);
     }
@@ -470,15 +810,38 @@ void Compiler::visit_return(const ReturnStmt& stmt) {
 }
 
 void Compiler::visit_var(const VarStmt& stmt) {
+    std::string name = sv_to_str(stmt.name.lexeme);
+    int slot = resolve_local(name);
+    uint16_t type = resolve_type_id(stmt.type_id);
+    if (slot >= 0) {
+        LocalScope& scope = local_scopes_.back();
+        scope.int_slots[slot] = is_integer_type(type) && (!stmt.initializer || is_integer_source(stmt.initializer));
+        if (scope.types[slot] == LocalScope::UNDECLARED) {
+            scope.types[slot] = type;
+        } else if (scope.types[slot] != type) {
+            scope.types[slot] = 0;
+        }
+    }
+    if (slot >= 0 && stmt.initializer && !stmt.is_const &&
+        emit_register_store(stmt.initializer, slot, stmt.name.line)) {
+        return;
+    }
+
     if (stmt.initializer) {
         visit_expr(stmt.initializer);
+    } else if (strict_mode_ && slot >= 0 && is_integer_type(type)) {
+        // Strict mode: integer locals start at zero rather than null.
+        emit(OpCode::PUSH_CONST, static_cast<int64_t>(0), stmt.name.line);
     } else {
         emit(OpCode::PUSH_CONST, nullptr, stmt.name.line);
     }
 
-    std::string name = sv_to_str(stmt.name.lexeme);
-    size_t idx = get_global_index(name);
-    emit(OpCode::STORE_VAR, static_cast<int64_t>(idx), stmt.name.line);
+    if (slot >= 0) {
+        emit(OpCode::STORE_LOCAL, static_cast<int64_t>(slot), stmt.name.line);
+    } else {
+        size_t idx = get_global_index(name);
+        emit(OpCode::STORE_VAR, static_cast<int64_t>(idx), stmt.name.line);
+    }
     emit(OpCode::POP);
 
     if (stmt.is_const) {
@@ -487,8 +850,7 @@ void Compiler::visit_var(const VarStmt& stmt) {
 }
 
 void Compiler::visit_expression(const ExpressionStmt& stmt) {
-    visit_expr(stmt.expression);
-    emit(OpCode::POP);
+    visit_discarded(stmt.expression);
 }
 
 void Compiler::visit_if(const IfStmt& stmt) {
@@ -620,13 +982,81 @@ void Compiler::visit_for(const ForStmt& stmt) {
     }
 
     if (stmt.increment) {
-        visit_expr(stmt.increment);
-        emit(OpCode::POP);
+        visit_discarded(stmt.increment);
+    }
+
+    emit(OpCode::JUMP, static_cast<int64_t>(loop_start));
+
+    patch_jump(exit_jump, bytecode_.size());
+
+    LoopContext ctx = loop_stack_.back();
+    loop_stack_.pop_back();
+    for (size_t break_idx : ctx.break_jumps) {
+        patch_jump(break_idx, bytecode_.size());
+    }
+}
+
+// The collection becomes an iterator held in the hidden `__feN` variable;
+// each pass runs FOR_ITER on it and leaves when it reports the end. A loop
+// over a z.range, z.keys or z.values call iterates the range or the map
+// directly instead of building the list first.
+void Compiler::visit_for_each(const ForEachStmt& stmt) {
+    int line = static_cast<int>(stmt.item.line);
+    IterSource source = IterSource::Value;
+    const Call* call = dynamic_cast<const Call*>(stmt.collection.get());
+    const Get* get = call ? dynamic_cast<const Get*>(call->callee.get()) : nullptr;
+    const Variable* module = get ? dynamic_cast<const Variable*>(get->obj.get()) : nullptr;
+    if (module && module->name.lexeme == "z") {
+        size_t argc = call->arguments.size();
+        if (get->name.lexeme == "range" && argc >= 1 && argc <= 3) {
+            source = static_cast<IterSource>(argc);
+        } else if (get->name.lexeme == "keys" && argc == 1) {
+            source = IterSource::Keys;
+        } else if (get->name.lexeme == "values" && argc == 1) {
+            source = IterSource::Values;
+        }
+    }
+    if (source == IterSource::Value) {
+        visit_expr(stmt.collection);
+    } else {
+        for (const auto& arg : call->arguments) {
+            visit_expr(arg);
+        }
+    }
+    emit(OpCode::GET_ITER, static_cast<int64_t>(source), line);
+
+    auto* iter_decl = static_cast<const VarStmt*>(stmt.statements[0].get());
+    std::string iter_name = sv_to_str(iter_decl->name.lexeme);
+    if (resolve_local(iter_name) < 0) {
+        get_global_index(iter_name);
     }
+    emit_store(iter_name, line);
+    emit(OpCode::POP);
+
+    size_t loop_start = bytecode_.size();
+    emit(OpCode::LOOP_START, static_cast<int64_t>(loop_start));
+    visit_expr(std::make_shared<Variable>(iter_decl->name));
+    emit(OpCode::FOR_ITER, std::monostate{}, line);
+
+    size_t exit_jump = bytecode_.size();
+    emit(OpCode::JUMP_IF_FALSE, static_cast<int64_t>(0));
+
+    std::string item_name = sv_to_str(stmt.item.lexeme);
+    if (const_vars_.count(item_name)) {
+        throw CompileError("Cannot reassign const variable '" + item_name + "'");
+    }
+    emit_store(item_name, line);
+    emit(OpCode::POP);
+
+    loop_stack_.push_back({loop_start, loop_start, {}, {}, stmt.label});
+
+    visit(stmt.body);
 
     emit(OpCode::JUMP, static_cast<int64_t>(loop_start));
 
+    // The exhausted iterator's null item is still on the stack here.
     patch_jump(exit_jump, bytecode_.size());
+    emit(OpCode::POP);
 
     LoopContext ctx = loop_stack_.back();
     loop_stack_.pop_back();
@@ -647,8 +1077,14 @@ void Compiler::visit_try(const TryStmt& stmt) {
 
     patch_jump(setup_try_idx, bytecode_.size());
 
-    size_t exc_idx = get_global_index(sv_to_str(stmt.exception_var.lexeme));
-    emit(OpCode::STORE_VAR, static_cast<int64_t>(exc_idx));
+    std::string exc_name = sv_to_str(stmt.exception_var.lexeme);
+    int exc_slot = resolve_local(exc_name);
+    if (exc_slot >= 0) {
+        emit(OpCode::STORE_LOCAL, static_cast<int64_t>(exc_slot));
+    } else {
+        size_t exc_idx = get_global_index(exc_name);
+        emit(OpCode::STORE_VAR, static_cast<int64_t>(exc_idx));
+    }
     emit(OpCode::POP);
 
     visit_block(stmt.handle_block);
@@ -715,6 +1151,9 @@ void Compiler::visit_match(const MatchStmt& stmt) {
 void Compiler::visit_class(const ClassStmt&) {}
 
 void Compiler::visit_binary(const Binary& expr) {
+    if (emit_register_binary(expr, -1))
+        return;
+
     visit_expr(expr.left);
     visit_expr(expr.right);
 
@@ -764,7 +1203,19 @@ void Compiler::visit_unary(const Unary& expr) {
         emit(OpCode::NOT);
         break;
     case TokenType::MINUS:
-        emit(OpCode::PUSH_CONST, 0.0);
+        // Negative literals are constants; otherwise 0 - x keeps integers
+        // integral. -0.0 is left to the subtraction, which yields +0.
+        if (auto* le = dynamic_cast<const Literal*>(expr.right.get())) {
+            if (auto* i = std::get_if<int64_t>(&le->value)) {
+                emit(OpCode::PUSH_CONST, -*i);
+                break;
+            }
+            if (auto* d = std::get_if<double>(&le->value); d && *d != 0.0) {
+                emit(OpCode::PUSH_CONST, -*d);
+                break;
+            }
+        }
+        emit(OpCode::PUSH_CONST, static_cast<int64_t>(0));
         visit_expr(expr.right);
         emit(OpCode::SUB);
         break;
@@ -831,6 +1282,12 @@ void Compiler::visit_variable(const Variable& expr) {
         return;
     }
 
+    int slot = resolve_local(name);
+    if (slot >= 0) {
+        emit(OpCode::LOAD_LOCAL, static_cast<int64_t>(slot));
+        return;
+    }
+
     auto global_it = std::find(globals_.begin(), globals_.end(), name);
     if (global_it != globals_.end()) {
         size_t idx = global_it - globals_.begin();
@@ -853,13 +1310,24 @@ void Compiler::visit_assign(const Assign& expr) {
     }
 
     visit_expr(expr.value);
+    emit_store(name);
+}
+
+// Stores the top of the stack into `name`, leaving it there: a frame slot,
+// a known global, or a global resolved by name at run time.
+void Compiler::emit_store(const std::string& name, int line) {
+    int slot = resolve_local(name);
+    if (slot >= 0) {
+        emit(OpCode::STORE_LOCAL, static_cast<int64_t>(slot), line);
+        return;
+    }
 
     auto global_it = std::find(globals_.begin(), globals_.end(), name);
     if (global_it != globals_.end()) {
         size_t idx = global_it - globals_.begin();
-        emit(OpCode::STORE_VAR, static_cast<int64_t>(idx));
+        emit(OpCode::STORE_VAR, static_cast<int64_t>(idx), line);
     } else {
-        emit(OpCode::STORE_VAR, name);
+        emit(OpCode::STORE_VAR, name, line);
     }
 }
 
@@ -901,6 +1369,19 @@ void Compiler::visit_call(const Call& expr) {
                 emit(OpCode::CALL, std::make_pair(method_name, static_cast<int>(expr.arguments.size())));
                 return;
             }
+            // `z` always names the builtin module, so z.* calls bind to their
+            // builtin here rather than by name at run time.
+            int id = obj_name == "z" ? builtin_id(sv_to_str(get->name.lexeme)) : -1;
+            if (id >= 0 && get->name.lexeme != "o") {
+                for (const auto& arg : expr.arguments) {
+                    visit_expr(arg);
+                }
+                BuiltinCall call;
+                call.id = static_cast<uint32_t>(id);
+                call.arg_count = static_cast<uint32_t>(expr.arguments.size());
+                emit(OpCode::CALL_BUILTIN, call.pack());
+                return;
+            }
         }
 
         visit_expr(get->obj);
@@ -991,31 +1472,7 @@ void Compiler::visit_index_assign(const IndexAssign& expr) {
 
 void Compiler::visit_lambda(const LambdaExpr& expr) {
     std::string lambda_name = "__lambda_" + std::to_string(lambda_counter_++);
-
-    std::vector<std::string> param_names;
-    for (const auto& param : expr.params) {
-        param_names.push_back(sv_to_str(param.name.lexeme));
-    }
-
-    std::vector<Instruction> old_bytecode = std::move(bytecode_);
-    bytecode_.clear();
-
-    for (const auto& stmt : expr.body) {
-        visit(stmt);
-    }
-
-    if (bytecode_.empty() || bytecode_.back().op != OpCode::RET) {
-        emit(OpCode::PUSH_CONST, nullptr);
-        emit(OpCode::RET);
-    }
-
-    CompiledMethod info;
-    info.bytecode = std::move(bytecode_);
-    info.param_names = std::move(param_names);
-    pending_functions_[lambda_name] = std::move(info);
-
-    bytecode_ = std::move(old_bytecode);
-
+    pending_functions_[lambda_name] = compile_function(expr.params, expr.body);
     emit(OpCode::PUSH_CONST, lambda_name);
 }
 
@@ -1071,12 +1528,7 @@ CompiledClass Compiler::compile_class_def(const ClassStmt& stmt) {
     }
 
     for (const auto& method : stmt.methods) {
-        CompiledMethod info;
-        info.bytecode = compile_method(method);
-
-        for (const auto& param : method.params) {
-            info.param_names.push_back(sv_to_str(param.name.lexeme));
-        }
+        CompiledMethod info = compile_method(method);
 
         std::string method_name = sv_to_str(method.name.lexeme);
         if (method.is_static) {
@@ -1121,11 +1573,255 @@ CompiledClass Compiler::compile_class_def(const ClassStmt& stmt) {
     return cls;
 }
 
-std::vector<Instruction> Compiler::compile_method(const FunctionStmt& method) {
+CompiledMethod Compiler::compile_method(const FunctionStmt& method) {
+    return compile_function(method.params, method.body);
+}
+
+int Compiler::resolve_local(const std::string& name) const {
+    if (local_scopes_.empty())
+        return -1;
+    const auto& slots = local_scopes_.back().slots;
+    auto it = slots.find(name);
+    return it != slots.end() ? it->second : -1;
+}
+
+// An integer literal or an integer-typed local of the current function.
+bool Compiler::is_integer_source(const ExprPtr& expr) const {
+    if (auto* ge = dynamic_cast<const Grouping*>(expr.get()))
+        return is_integer_source(ge->expression);
+    if (is_integer_literal(expr))
+        return true;
+    auto* ve = dynamic_cast<const Variable*>(expr.get());
+    if (!ve || local_scopes_.empty())
+        return false;
+    int slot = resolve_local(sv_to_str(ve->name.lexeme));
+    const auto& int_slots = local_scopes_.back().int_slots;
+    return slot >= 0 && static_cast<size_t>(slot) < int_slots.size() && int_slots[slot];
+}
+
+size_t Compiler::add_constant(const Operand& value) {
+    std::string key;
+    if (auto* i = std::get_if<int64_t>(&value)) {
+        key = "i" + std::to_string(*i);
+    } else if (auto* d = std::get_if<double>(&value)) {
+        std::ostringstream oss;
+        oss.precision(17);
+        oss << "d" << *d;
+        key = oss.str();
+    } else if (auto* str = std::get_if<std::string>(&value)) {
+        key = "s" + *str;
+    } else {
+        key = "n";
+    }
+    auto it = constant_pool_map_.find(key);
+    if (it != constant_pool_map_.end())
+        return it->second;
+    constant_pool_.push_back(value);
+    constant_pool_map_[key] = constant_pool_.size() - 1;
+    return constant_pool_.size() - 1;
+}
+
+bool Compiler::register_source(const ExprPtr& expr, uint16_t& index, bool& is_const) {
+    if (auto* ge = dynamic_cast<const Grouping*>(expr.get())) {
+        return register_source(ge->expression, index, is_const);
+    }
+    if (auto* ve = dynamic_cast<const Variable*>(expr.get())) {
+        int slot = resolve_local(sv_to_str(ve->name.lexeme));
+        if (slot < 0)
+            return false;
+        index = static_cast<uint16_t>(slot);
+        is_const = false;
+        return true;
+    }
+    if (auto* le = dynamic_cast<const Literal*>(expr.get())) {
+        Operand value;
+        if (auto* i = std::get_if<int64_t>(&le->value)) {
+            value = *i;
+        } else if (auto* d = std::get_if<double>(&le->value)) {
+            value = *d;
+        } else if (auto* str = std::get_if<std::string>(&le->value)) {
+            value = *str;
+        } else {
+            return false;
+        }
+        size_t k = add_constant(value);
+        if (k > UINT16_MAX)
+            return false;
+        index = static_cast<uint16_t>(k);
+        is_const = true;
+        return true;
+    }
+    return false;
+}
+
+bool Compiler::emit_register_binary(const Binary& expr, int dst) {
+    static const std::unordered_map<TokenType, OpCode> REGISTER_OPS = {
+        {TokenType::PLUS, OpCode::ADD_R},          {TokenType::MINUS, OpCode::SUB_R},
+        {TokenType::STAR, OpCode::MUL_R},          {TokenType::SLASH, OpCode::DIV_R},
+        {TokenType::PERCENT, OpCode::PERCENT_R},   {TokenType::DOUBLE_EQUALS, OpCode::EQ_R},
+        {TokenType::NOT_EQUALS, OpCode::NE_R},     {TokenType::GREATER, OpCode::GT_R},
+        {TokenType::GREATER_EQUALS, OpCode::GE_R}, {TokenType::LESS, OpCode::LT_R},
+        {TokenType::LESS_EQUALS, OpCode::LE_R},
+    };
+    if (local_scopes_.empty())
+        return false;
+    auto op_it = REGISTER_OPS.find(expr.op.type);
+    if (op_it == REGISTER_OPS.end())
+        return false;
+
+    RegisterOperands regs;
+    if (!register_source(expr.left, regs.lhs, regs.lhs_const) ||
+        !register_source(expr.right, regs.rhs, regs.rhs_const))
+        return false;
+    // Two literals are left to constant folding.
+    if (regs.lhs_const && regs.rhs_const)
+        return false;
+    regs.push = dst < 0;
+    regs.dst = regs.push ? 0 : static_cast<uint16_t>(dst);
+    OpCode op = op_it->second;
+    if (is_integer_source(expr.left) && is_integer_source(expr.right)) {
+        static const std::unordered_map<OpCode, OpCode> INTEGER_OPS = {
+            {OpCode::ADD_R, OpCode::ADD_I},
+            {OpCode::SUB_R, OpCode::SUB_I},
+            {OpCode::LT_R, OpCode::LT_I},
+            {OpCode::LE_R, OpCode::LE_I},
+        };
+        auto int_it = INTEGER_OPS.find(op);
+        if (int_it != INTEGER_OPS.end())
+            op = int_it->second;
+    }
+    emit(op, regs.pack(), expr.op.line);
+    return true;
+}
+
+// `x = x + c` and `x = x - c` on an integer local with a small literal c.
+bool Compiler::emit_increment(const Binary& expr, int slot, int line) {
+    if (expr.op.type != TokenType::PLUS && expr.op.type != TokenType::MINUS)
+        return false;
+    auto* target = dynamic_cast<const Variable*>(expr.left.get());
+    if (!target || resolve_local(sv_to_str(target->name.lexeme)) != slot || !is_integer_source(expr.left))
+        return false;
+    auto* le = dynamic_cast<const Literal*>(expr.right.get());
+    auto* c = le ? std::get_if<int64_t>(&le->value) : nullptr;
+    if (!c || *c > INT32_MAX)
+        return false;
+    IncrementOperands inc;
+    inc.slot = static_cast<uint16_t>(slot);
+    inc.delta = static_cast<int32_t>(expr.op.type == TokenType::MINUS ? -*c : *c);
+    emit(OpCode::INC_I, inc.pack(), line);
+    return true;
+}
+
+bool Compiler::emit_register_store(const ExprPtr& value, int slot, int line) {
+    const Expr* inner = value.get();
+    while (auto* ge = dynamic_cast<const Grouping*>(inner)) {
+        inner = ge->expression.get();
+    }
+    if (auto* be = dynamic_cast<const Binary*>(inner)) {
+        return emit_increment(*be, slot, line) || emit_register_binary(*be, slot);
+    }
+    RegisterOperands regs;
+    if (!register_source(value, regs.lhs, regs.lhs_const))
+        return false;
+    regs.dst = static_cast<uint16_t>(slot);
+    emit(OpCode::MOVE_R, regs.pack(), line);
+    return true;
+}
+
+// `x = x + a + b ...` when the result is known to be a string: the target
+// is loaded, the pieces pushed, and APPEND_LOCAL or APPEND_VAR stores the
+// sum, appending in place when it can.
+bool Compiler::emit_append(const Assign& expr) {
+    std::string name = sv_to_str(expr.name.lexeme);
+    if (const_vars_.count(name) || infer_expression_type(expr.value) != TypeManager::STR)
+        return false;
+    std::vector<const ExprPtr*> pieces;
+    const ExprPtr* head = &expr.value;
+    while (auto* be = dynamic_cast<const Binary*>(head->get())) {
+        if (be->op.type != TokenType::PLUS)
+            return false;
+        pieces.push_back(&be->right);
+        head = &be->left;
+    }
+    auto* target = dynamic_cast<const Variable*>(head->get());
+    if (pieces.empty() || !target || sv_to_str(target->name.lexeme) != name)
+        return false;
+
+    AppendOperands app;
+    OpCode op;
+    int slot = resolve_local(name);
+    auto global_it = std::find(globals_.begin(), globals_.end(), name);
+    if (slot >= 0) {
+        op = OpCode::APPEND_LOCAL;
+        app.target = static_cast<uint32_t>(slot);
+    } else if (global_it != globals_.end()) {
+        op = OpCode::APPEND_VAR;
+        app.target = static_cast<uint32_t>(global_it - globals_.begin());
+    } else {
+        return false;
+    }
+    app.count = static_cast<uint32_t>(pieces.size());
+    visit_expr(*head);
+    for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+        visit_expr(**it);
+    }
+    emit(op, app.pack(), expr.name.line);
+    return true;
+}
+
+// An expression evaluated for its side effects only. Assignments of simple
+// arithmetic to locals go straight to the destination slot, and string
+// appends to a variable may grow it in place.
+void Compiler::visit_discarded(const ExprPtr& expr) {
+    if (auto* ae = dynamic_cast<const Assign*>(expr.get())) {
+        std::string name = sv_to_str(ae->name.lexeme);
+        int slot = resolve_local(name);
+        if (slot >= 0 && !const_vars_.count(name) && emit_register_store(ae->value, slot, ae->name.line)) {
+            return;
+        }
+        if (emit_append(*ae)) {
+            return;
+        }
+    }
+    visit_expr(expr);
+    emit(OpCode::POP);
+}
+
+CompiledMethod Compiler::compile_function(const std::vector<VarStmt>& params, const std::vector<StmtPtr>& body) {
+    LocalScope scope;
+    auto add_slot = [&scope](const std::string& name) {
+        if (scope.slots.count(name))
+            return;
+        scope.slots[name] = static_cast<uint16_t>(scope.names.size());
+        scope.names.push_back(name);
+    };
+    for (const auto& param : params) {
+        add_slot(sv_to_str(param.name.lexeme));
+        scope.int_slots.push_back(is_integer_type(resolve_type_id(param.type_id)));
+        scope.types.push_back(resolve_type_id(param.type_id));
+    }
+
+    std::vector<std::string> declared;
+    std::unordered_set<std::string> captured;
+    for (const auto& stmt : body) {
+        collect_declared(stmt, declared);
+        collect_captured(stmt, false, captured);
+    }
+    for (const auto& name : declared) {
+        if (!captured.count(name) && !const_vars_.count(name))
+            add_slot(name);
+    }
+    if (scope.names.size() > UINT16_MAX) {
+        throw CompileError("Too many local variables in function body");
+    }
+    scope.int_slots.resize(scope.names.size(), false);
+    scope.types.resize(scope.names.size(), LocalScope::UNDECLARED);
+
     std::vector<Instruction> old_bytecode = std::move(bytecode_);
     bytecode_.clear();
+    local_scopes_.push_back(std::move(scope));
 
-    for (const auto& stmt : method.body) {
+    for (const auto& stmt : body) {
         visit(stmt);
     }
 
@@ -1134,10 +1830,22 @@ std::vector<Instruction> Compiler::compile_method(const FunctionStmt& method) {
         emit(OpCode::RET);
     }
 
-    std::vector<Instruction> result = std::move(bytecode_);
+    CompiledMethod info;
+    info.bytecode = std::move(bytecode_);
+    for (const auto& param : params) {
+        info.param_names.push_back(sv_to_str(param.name.lexeme));
+    }
+    info.local_names = std::move(local_scopes_.back().names);
+    std::vector<uint16_t> slot_types = std::move(local_scopes_.back().types);
+    local_scopes_.pop_back();
     bytecode_ = std::move(old_bytecode);
 
-    return result;
+    if (strict_mode_) {
+        optimize_method(info);
+        specialize_integers(info, slot_types);
+    }
+
+    return info;
 }
 
 void Compiler::load_module(const std::string& path) {
@@ -1224,18 +1932,57 @@ void Compiler::load_module(const std::string& path) {
 
         if (auto* fs = dynamic_cast<const FunctionStmt*>(stmt.get())) {
             std::string func_name = sv_to_str(fs->name.lexeme);
-            CompiledMethod info;
-            info.bytecode = compile_method(*fs);
-            for (const auto& param : fs->params) {
-                info.param_names.push_back(sv_to_str(param.name.lexeme));
-            }
-            pending_functions_[func_name] = std::move(info);
+            pending_functions_[func_name] = compile_method(*fs);
         } else if (auto* vs = dynamic_cast<const VarStmt*>(stmt.get())) {
             visit_var(*vs);
         }
     }
 }
 
+std::string Compiler::format_operand(const Instruction& instr) {
+    std::ostringstream oss;
+    if (is_register_op(instr.op) && std::holds_alternative<int64_t>(instr.operand)) {
+        RegisterOperands regs = RegisterOperands::unpack(std::get<int64_t>(instr.operand));
+        auto source = [](uint16_t index, bool is_const) { return (is_const ? "k" : "r") + std::to_string(index); };
+        oss << (regs.push ? std::string("push") : "r" + std::to_string(regs.dst)) << ", "
+            << source(regs.lhs, regs.lhs_const);
+        if (instr.op != OpCode::MOVE_R && instr.op != OpCode::MOVE_I)
+            oss << ", " << source(regs.rhs, regs.rhs_const);
+        return oss.str();
+    }
+    if ((instr.op == OpCode::INC_I || instr.op == OpCode::INC_II) && std::holds_alternative<int64_t>(instr.operand)) {
+        IncrementOperands inc = IncrementOperands::unpack(std::get<int64_t>(instr.operand));
+        oss << "r" << inc.slot << ", " << inc.delta;
+        return oss.str();
+    }
+    if ((instr.op == OpCode::APPEND_LOCAL || instr.op == OpCode::APPEND_VAR) &&
+        std::holds_alternative<int64_t>(instr.operand)) {
+        AppendOperands app = AppendOperands::unpack(std::get<int64_t>(instr.operand));
+        oss << (instr.op == OpCode::APPEND_LOCAL ? "r" : "") << app.target << ", " << app.count;
+        return oss.str();
+    }
+    if (instr.op == OpCode::CALL_BUILTIN && std::holds_alternative<int64_t>(instr.operand)) {
+        BuiltinCall call = BuiltinCall::unpack(std::get<int64_t>(instr.operand));
+        oss << (call.id < BUILTIN_COUNT ? BUILTIN_NAMES[call.id] : "?") << "/" << call.arg_count;
+        return oss.str();
+    }
+    std::visit(
+        [&oss](const auto& op) {
+            using T = std::decay_t<decltype(op)>;
+            if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, double>) {
+                oss << op;
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                oss << "\"" << op << "\"";
+            } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+                oss << "null";
+            } else if constexpr (std::is_same_v<T, std::pair<std::string, int>>) {
+                oss << op.first << "/" << op.second;
+            }
+        },
+        instr.operand);
+    return oss.str();
+}
+
 std::string Compiler::dump_program(const Program& program) {
     std::ostringstream oss;
 
@@ -1244,20 +1991,9 @@ std::string Compiler::dump_program(const Program& program) {
         for (size_t i = 0; i < bytecode.size(); ++i) {
             const auto& instr = bytecode[i];
             oss << "  " << i << ": " << opcode_to_string(instr.op);
-            std::visit(
-                [&oss](const auto& op) {
-                    using T = std::decay_t<decltype(op)>;
-                    if constexpr (std::is_same_v<T, int64_t>) {
-                        oss << " " << op;
-                    } else if constexpr (std::is_same_v<T, double>) {
-                        oss << " " << op;
-                    } else if constexpr (std::is_same_v<T, std::string>) {
-                        oss << " \"" << op << "\"";
-                    } else if constexpr (std::is_same_v<T, std::pair<std::string, int>>) {
-                        oss << " " << op.first << "/" << op.second;
-                    }
-                },
-                instr.operand);
+            std::string operand = format_operand(instr);
+            if (!operand.empty())
+                oss << " " << operand;
             if (instr.line > 0)
                 oss << "  (line " << instr.line << ")";
             oss << "\n";
@@ -1278,6 +2014,8 @@ std::string Compiler::dump_program(const Program& program) {
             params += func.param_names[i];
         }
         dump_instructions(func.bytecode, "FUNCTION " + name + "(" + params + ")");
+        if (!func.specialized.empty())
+            dump_instructions(func.specialized, "FUNCTION " + name + "(" + params + ") SPECIALIZED");
     }
 
     for (const auto& [id, cls] : program.classes) {
@@ -1293,9 +2031,31 @@ std::string Compiler::dump_program(const Program& program) {
                 params += method.param_names[i];
             }
             dump_instructions(method.bytecode, "  METHOD " + mname + "(" + params + ")");
+            if (!method.specialized.empty())
+                dump_instructions(method.specialized, "  METHOD " + mname + "(" + params + ") SPECIALIZED");
         }
         for (const auto& [mname, method] : cls.static_methods) {
             dump_instructions(method.bytecode, "  STATIC " + mname);
+            if (!method.specialized.empty())
+                dump_instructions(method.specialized, "  STATIC " + mname + " SPECIALIZED");
+        }
+    }
+
+    if (!program.constant_pool.empty()) {
+        oss << "\n=== CONSTANTS ===\n";
+        for (size_t i = 0; i < program.constant_pool.size(); ++i) {
+            oss << "  k" << i << ":";
+            std::visit(
+                [&oss](const auto& op) {
+                    using T = std::decay_t<decltype(op)>;
+                    if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, double>) {
+                        oss << " " << op;
+                    } else if constexpr (std::is_same_v<T, std::string>) {
+                        oss << " \"" << op << "\"";
+                    }
+                },
+                program.constant_pool[i]);
+            oss << "\n";
         }
     }
 
@@ -0,0 +1,196 @@
+#include "gc.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace alphabet {
+
+namespace {
+
+// Collections run at least this many container allocations apart, and
+// otherwise once the allocations since the last one match the survivors,
+// so the cost of scanning stays proportional to allocation.
+constexpr size_t MIN_THRESHOLD = 10000;
+constexpr int64_t REACHABLE = -1;
+
+std::mutex list_mutex;
+ContainerCell* list_head = nullptr;
+size_t tracked_count = 0;
+std::atomic<bool> shared{false};
+std::atomic<size_t> running_threads{0};
+CycleCollector::Stats totals;
+
+// Locks the container list only once another thread could touch it.
+std::unique_lock<std::mutex> lock_list() {
+    std::unique_lock<std::mutex> lock(list_mutex, std::defer_lock);
+    if (shared.load(std::memory_order_acquire))
+        lock.lock();
+    return lock;
+}
+
+ContainerCell* container(const Value& value) {
+    if (!value.is_list() && !value.is_map() && !value.is_object())
+        return nullptr;
+    return static_cast<ContainerCell*>(const_cast<HeapCell*>(value.cell()));
+}
+
+template <typename F> void for_each_child(ContainerCell* cell, F&& visit) {
+    auto each = [&](const Value& value) {
+        if (ContainerCell* child = container(value))
+            visit(child);
+    };
+    switch (cell->gc_kind) {
+    case ContainerCell::Kind::List:
+        for (const Value& item : static_cast<ListCell*>(cell)->items)
+            each(item);
+        break;
+    case ContainerCell::Kind::Map:
+        for (const auto& [key, item] : static_cast<MapCell*>(cell)->items)
+            each(item);
+        break;
+    case ContainerCell::Kind::Object:
+        for (const Value& field : static_cast<AlphabetObject*>(cell)->slots)
+            each(field);
+        break;
+    }
+}
+
+// Drops everything the cell holds. The contents are moved out first so the
+// cell is already empty if releasing them reaches it again.
+void clear(ContainerCell* cell) {
+    switch (cell->gc_kind) {
+    case ContainerCell::Kind::List: {
+        Value::List items;
+        items.swap(static_cast<ListCell*>(cell)->items);
+        break;
+    }
+    case ContainerCell::Kind::Map: {
+        Value::Map items;
+        items.swap(static_cast<MapCell*>(cell)->items);
+        break;
+    }
+    case ContainerCell::Kind::Object: {
+        std::vector<Value> slots;
+        slots.swap(static_cast<AlphabetObject*>(cell)->slots);
+        break;
+    }
+    }
+}
+
+void destroy(ContainerCell* cell) {
+    switch (cell->gc_kind) {
+    case ContainerCell::Kind::List:
+        delete static_cast<ListCell*>(cell);
+        break;
+    case ContainerCell::Kind::Map:
+        delete static_cast<MapCell*>(cell);
+        break;
+    case ContainerCell::Kind::Object:
+        delete static_cast<AlphabetObject*>(cell);
+        break;
+    }
+}
+
+} // namespace
+
+std::atomic<size_t> CycleCollector::allocations_{0};
+std::atomic<size_t> CycleCollector::threshold_{MIN_THRESHOLD};
+
+void CycleCollector::track(ContainerCell* cell) {
+    auto lock = lock_list();
+    cell->gc_prev = nullptr;
+    cell->gc_next = list_head;
+    if (list_head)
+        list_head->gc_prev = cell;
+    list_head = cell;
+    ++tracked_count;
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CycleCollector::untrack(ContainerCell* cell) {
+    auto lock = lock_list();
+    if (cell->gc_prev)
+        cell->gc_prev->gc_next = cell->gc_next;
+    else
+        list_head = cell->gc_next;
+    if (cell->gc_next)
+        cell->gc_next->gc_prev = cell->gc_prev;
+    --tracked_count;
+}
+
+size_t CycleCollector::collect() {
+    if (running_threads.load(std::memory_order_acquire) > 0) {
+        allocations_.store(0, std::memory_order_relaxed);
+        return 0;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<ContainerCell*> cells;
+    cells.reserve(tracked_count);
+    for (ContainerCell* cell = list_head; cell; cell = cell->gc_next) {
+        cell->gc_refs = cell->ref_count.load(std::memory_order_relaxed);
+        cells.push_back(cell);
+    }
+    for (ContainerCell* cell : cells)
+        for_each_child(cell, [](ContainerCell* child) { --child->gc_refs; });
+
+    // A count left over means a reference from outside the containers.
+    std::vector<ContainerCell*> pending;
+    for (ContainerCell* cell : cells) {
+        if (cell->gc_refs > 0) {
+            cell->gc_refs = REACHABLE;
+            pending.push_back(cell);
+        }
+    }
+    while (!pending.empty()) {
+        ContainerCell* cell = pending.back();
+        pending.pop_back();
+        for_each_child(cell, [&](ContainerCell* child) {
+            if (child->gc_refs != REACHABLE) {
+                child->gc_refs = REACHABLE;
+                pending.push_back(child);
+            }
+        });
+    }
+
+    std::vector<ContainerCell*> garbage;
+    for (ContainerCell* cell : cells)
+        if (cell->gc_refs != REACHABLE)
+            garbage.push_back(cell);
+    // Hold every garbage cell while the cycles are broken, so none is freed
+    // while another still points at it.
+    for (ContainerCell* cell : garbage)
+        cell->retain();
+    for (ContainerCell* cell : garbage)
+        clear(cell);
+    for (ContainerCell* cell : garbage)
+        if (cell->release())
+            destroy(cell);
+
+    allocations_.store(0, std::memory_order_relaxed);
+    threshold_.store(std::max(MIN_THRESHOLD, tracked_count), std::memory_order_relaxed);
+    ++totals.collections;
+    totals.freed += garbage.size();
+    totals.pause_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return garbage.size();
+}
+
+CycleCollector::Stats CycleCollector::stats() {
+    auto lock = lock_list();
+    Stats stats = totals;
+    stats.tracked = tracked_count;
+    return stats;
+}
+
+void CycleCollector::thread_started() {
+    shared.store(true, std::memory_order_release);
+    running_threads.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void CycleCollector::thread_joined() {
+    running_threads.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+} // namespace alphabet
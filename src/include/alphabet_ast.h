@@ -226,6 +226,20 @@ struct ForStmt : Stmt {
           label(std::move(l)) {}
 };
 
+// `l (item : collection) body`. The statements are the indexing loop it
+// stands for (`__feN = collection`, `__iN = 0`, then a LoopStmt assigning
+// `item = __feN[__iN]`), so passes that only walk blocks see ordinary
+// declarations; the compiler emits the iterator loop from the fields.
+struct ForEachStmt : Block {
+    Token item;
+    ExprPtr collection;
+    StmtPtr body;
+    std::string label;
+
+    ForEachStmt(std::vector<StmtPtr> stmts, Token i, ExprPtr coll, StmtPtr b, std::string l = "")
+        : Block(std::move(stmts)), item(i), collection(std::move(coll)), body(std::move(b)), label(std::move(l)) {}
+};
+
 struct TryStmt : Stmt {
     Block try_block;
     Token exception_type;
@@ -326,6 +340,7 @@ struct ClassStmt;
 struct ContinueStmt;
 struct ExportStmt;
 struct ExpressionStmt;
+struct ForEachStmt;
 struct ForStmt;
 struct FString;
 struct FunctionStmt;
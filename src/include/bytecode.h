@@ -56,10 +56,301 @@ enum class OpCode : uint8_t {
     NOP = 51,
     PUSH_CONST_POOL = 52,
     LOAD_SUPER = 53,
+    LOAD_LOCAL = 54,
+    STORE_LOCAL = 55,
+    // Register forms: operands are frame slots or constants, see RegisterOperands.
+    ADD_R = 56,
+    SUB_R = 57,
+    MUL_R = 58,
+    DIV_R = 59,
+    PERCENT_R = 60,
+    EQ_R = 61,
+    NE_R = 62,
+    GT_R = 63,
+    GE_R = 64,
+    LT_R = 65,
+    LE_R = 66,
+    MOVE_R = 67,
+    CALL_BUILTIN = 68, // z.* builtin resolved at compile time, see BuiltinCall
+    // Integer-specialized register forms, emitted when both sources are known
+    // to hold integers. They check that guess and fall back to the generic op.
+    ADD_I = 69,
+    SUB_I = 70,
+    LT_I = 71,
+    LE_I = 72,
+    INC_I = 73, // slot += immediate, see IncrementOperands
+    // Strict-mode forms, only found in CompiledMethod::specialized. Integer
+    // sources are proven by the compiler and read without checks; a failed
+    // guard or an overflow deoptimizes to the generic twin.
+    GUARD_INT = 74, // deoptimize unless the slot holds an integer
+    ADD_II = 75,
+    SUB_II = 76,
+    MUL_II = 77,
+    PERCENT_II = 78,
+    EQ_II = 79,
+    NE_II = 80,
+    GT_II = 81,
+    GE_II = 82,
+    LT_II = 83,
+    LE_II = 84,
+    INC_II = 85,
+    STORE_LOCAL_I = 86, // STORE_LOCAL into a proven slot
+    MOVE_I = 87,        // MOVE_R of an unproven source into a proven slot
+    LOAD_INDEX_I = 88,  // LOAD_INDEX with an integer index
+    // `x = x + a + b ...` as a statement, see AppendOperands.
+    APPEND_LOCAL = 89,
+    APPEND_VAR = 90,
+    // CALL of `r f(...)`, always followed by RET. The callee takes over the
+    // caller's frame, or it runs as a CALL when the frame must stay.
+    TAIL_CALL = 91,
+    // for-each loops: GET_ITER turns what the loop walks into an iterator,
+    // see IterSource; FOR_ITER pops it and pushes its next element and
+    // whether there was one.
+    GET_ITER = 92,
+    FOR_ITER = 93,
 };
 
 using Operand = std::variant<std::monostate, int64_t, double, std::string, std::nullptr_t, std::pair<std::string, int>>;
 
+// Operands of the register-form opcodes, packed into one int64 operand:
+// destination, left and right in 16-bit fields, then flag bits. Registers
+// are frame slots. A source with its constant flag set indexes
+// Program::constant_pool instead. A PUSH destination pushes the result onto
+// the value stack rather than storing it. MOVE_R uses only dst and lhs.
+struct RegisterOperands {
+    static constexpr int64_t LHS_CONST = int64_t(1) << 48;
+    static constexpr int64_t RHS_CONST = int64_t(1) << 49;
+    static constexpr int64_t PUSH = int64_t(1) << 50;
+
+    uint16_t dst = 0;
+    uint16_t lhs = 0;
+    uint16_t rhs = 0;
+    bool lhs_const = false;
+    bool rhs_const = false;
+    bool push = false;
+
+    int64_t pack() const {
+        return int64_t(dst) | (int64_t(lhs) << 16) | (int64_t(rhs) << 32) | (lhs_const ? LHS_CONST : 0) |
+               (rhs_const ? RHS_CONST : 0) | (push ? PUSH : 0);
+    }
+
+    static RegisterOperands unpack(int64_t packed) {
+        RegisterOperands r;
+        r.dst = static_cast<uint16_t>(packed);
+        r.lhs = static_cast<uint16_t>(packed >> 16);
+        r.rhs = static_cast<uint16_t>(packed >> 32);
+        r.lhs_const = (packed & LHS_CONST) != 0;
+        r.rhs_const = (packed & RHS_CONST) != 0;
+        r.push = (packed & PUSH) != 0;
+        return r;
+    }
+};
+
+// Stack opcode computing the same operation as a register-form binary opcode.
+inline OpCode register_base_op(OpCode op) {
+    switch (op) {
+    case OpCode::ADD_R:
+        return OpCode::ADD;
+    case OpCode::SUB_R:
+        return OpCode::SUB;
+    case OpCode::MUL_R:
+        return OpCode::MUL;
+    case OpCode::DIV_R:
+        return OpCode::DIV;
+    case OpCode::PERCENT_R:
+        return OpCode::PERCENT;
+    case OpCode::EQ_R:
+        return OpCode::EQ;
+    case OpCode::NE_R:
+        return OpCode::NE;
+    case OpCode::GT_R:
+        return OpCode::GT;
+    case OpCode::GE_R:
+        return OpCode::GE;
+    case OpCode::LT_R:
+        return OpCode::LT;
+    case OpCode::LE_R:
+        return OpCode::LE;
+    case OpCode::ADD_I:
+        return OpCode::ADD;
+    case OpCode::SUB_I:
+        return OpCode::SUB;
+    case OpCode::LT_I:
+        return OpCode::LT;
+    case OpCode::LE_I:
+        return OpCode::LE;
+    case OpCode::ADD_II:
+        return OpCode::ADD;
+    case OpCode::SUB_II:
+        return OpCode::SUB;
+    case OpCode::MUL_II:
+        return OpCode::MUL;
+    case OpCode::PERCENT_II:
+        return OpCode::PERCENT;
+    case OpCode::EQ_II:
+        return OpCode::EQ;
+    case OpCode::NE_II:
+        return OpCode::NE;
+    case OpCode::GT_II:
+        return OpCode::GT;
+    case OpCode::GE_II:
+        return OpCode::GE;
+    case OpCode::LT_II:
+        return OpCode::LT;
+    case OpCode::LE_II:
+        return OpCode::LE;
+    default:
+        return OpCode::NOP;
+    }
+}
+
+inline bool is_register_op(OpCode op) {
+    return (op >= OpCode::ADD_R && op <= OpCode::MOVE_R) || (op >= OpCode::ADD_I && op <= OpCode::LE_I) ||
+           (op >= OpCode::ADD_II && op <= OpCode::LE_II) || op == OpCode::MOVE_I;
+}
+
+// Opcodes whose operand is an absolute instruction index. A target equal to
+// the body's size runs off the end.
+inline bool is_jump_op(OpCode op) {
+    switch (op) {
+    case OpCode::JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::JUMP_IF_TRUE:
+    case OpCode::BREAK_JUMP:
+    case OpCode::CONTINUE_JUMP:
+    case OpCode::SETUP_TRY:
+    case OpCode::LOOP_START:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Operand of GET_ITER. Value walks the value on the stack: a list's items,
+// a map's keys, a string's code points, or an iterator as it is. The range
+// forms take z.range's one to three numbers from the stack and never build
+// the list; Keys and Values walk a map in place of z.keys and z.values.
+enum class IterSource : int64_t { Value = 0, Range1 = 1, Range2 = 2, Range3 = 3, Keys = 4, Values = 5 };
+
+// Operand of INC_I: frame slot in the low 16 bits, signed immediate in the
+// high 32.
+struct IncrementOperands {
+    uint16_t slot = 0;
+    int32_t delta = 0;
+
+    int64_t pack() const { return int64_t(slot) | (int64_t(delta) * (int64_t(1) << 32)); }
+
+    static IncrementOperands unpack(int64_t packed) {
+        IncrementOperands inc;
+        inc.slot = static_cast<uint16_t>(packed);
+        inc.delta = static_cast<int32_t>(packed >> 32);
+        return inc;
+    }
+};
+
+// Operand of APPEND_LOCAL and APPEND_VAR: the target's slot or global index
+// in the low 32 bits, the number of pieces in the high 32. The stack holds
+// the target's value as loaded before the pieces were evaluated, then the
+// pieces; all are popped and the target becomes their sum. A string held
+// only by the target is appended to in place.
+struct AppendOperands {
+    uint32_t target = 0;
+    uint32_t count = 0;
+
+    int64_t pack() const { return int64_t(target) | (int64_t(count) << 32); }
+
+    static AppendOperands unpack(int64_t packed) {
+        AppendOperands app;
+        app.target = static_cast<uint32_t>(packed);
+        app.count = static_cast<uint32_t>(static_cast<uint64_t>(packed) >> 32);
+        return app;
+    }
+};
+
+// Integer arithmetic for the compiler's folding and the VM's integer paths.
+// Each returns false on overflow, in which case callers use doubles.
+inline bool checked_add(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_add_overflow(a, b, &out);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        return false;
+    out = a + b;
+    return true;
+#endif
+}
+
+inline bool checked_sub(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_sub_overflow(a, b, &out);
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+        return false;
+    out = a - b;
+    return true;
+#endif
+}
+
+inline bool checked_mul(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_mul_overflow(a, b, &out);
+#else
+    if (a != 0 && b != 0) {
+        if ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN))
+            return false;
+        int64_t p = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+        if (p / b != a)
+            return false;
+        out = p;
+        return true;
+    }
+    out = 0;
+    return true;
+#endif
+}
+
+// The z.* builtins, indexed by builtin id. Ids are stored in compiled
+// bytecode, so new builtins are only ever appended.
+inline constexpr const char* BUILTIN_NAMES[] = {
+    "o", "i", "t", "f", "fw", "sqrt", "sin", "cos", "tan", "abs", "floor", "ceil", "round", "pow", "min", "max", "log",
+    "log10", "len", "tostr", "tonum", "type", "split", "join", "replace", "trim", "upper", "lower", "substr", "chr",
+    "ord", "starts_with", "ends_with", "find", "count", "range", "append", "pop_back", "contains", "keys", "values",
+    "builder", "set", "add", "has", "set_size", "append_str", "build", "reverse", "sort", "insert", "remove", "fa",
+    "exists", "file_size", "args", "exit", "sleep", "thread", "join_all", "lock", "acquire", "release", "http_get",
+    "http_post", "timestamp", "env", "json_parse", "json_stringify", "exec", "system", "assert", "assert_eq", "rand",
+    "randint", "slice", "flatten", "is_null", "is_empty", "clamp", "swap", "unique", "zip", "enumerate", "sum", "avg",
+    "flatten_str", "map", "filter", "reduce", "dyn", "lines", "stream",
+};
+inline constexpr size_t BUILTIN_COUNT = sizeof(BUILTIN_NAMES) / sizeof(BUILTIN_NAMES[0]);
+
+// Builtin id for a z.* name, or -1 if there is no such builtin.
+inline int builtin_id(const std::string& name) {
+    static const std::unordered_map<std::string, int> ids = [] {
+        std::unordered_map<std::string, int> m;
+        for (size_t i = 0; i < BUILTIN_COUNT; ++i)
+            m.emplace(BUILTIN_NAMES[i], static_cast<int>(i));
+        return m;
+    }();
+    auto it = ids.find(name);
+    return it != ids.end() ? it->second : -1;
+}
+
+// Operand of CALL_BUILTIN: builtin id in the high 32 bits, argument count in
+// the low 32.
+struct BuiltinCall {
+    uint32_t id = 0;
+    uint32_t arg_count = 0;
+
+    int64_t pack() const { return (int64_t(id) << 32) | int64_t(arg_count); }
+
+    static BuiltinCall unpack(int64_t packed) {
+        BuiltinCall c;
+        c.id = static_cast<uint32_t>(static_cast<uint64_t>(packed) >> 32);
+        c.arg_count = static_cast<uint32_t>(packed);
+        return c;
+    }
+};
+
 struct Instruction {
     OpCode op;
     Operand operand;
@@ -74,6 +365,12 @@ struct CompiledMethod {
     std::vector<Instruction> bytecode;
     std::vector<std::string> param_names;
     std::vector<std::vector<Instruction>> default_value_bytecodes;
+    // Frame slot layout: parameters first, then body-declared locals.
+    std::vector<std::string> local_names;
+    // Strict mode: the body with integer-specialized opcodes, or empty. It
+    // matches bytecode instruction for instruction, so a frame can switch
+    // to bytecode at the same ip when an assumption fails.
+    std::vector<Instruction> specialized;
 };
 
 struct CompiledClass {
@@ -90,7 +387,7 @@ struct CompiledClass {
 };
 
 struct Program {
-    static constexpr uint16_t VERSION = 1;
+    static constexpr uint16_t VERSION = 9;
     uint16_t version = VERSION;
     std::vector<Instruction> main;
     std::vector<Instruction> static_init;
@@ -195,6 +492,86 @@ inline const char* opcode_to_string(OpCode op) {
         return "PUSH_CONST_POOL";
     case OpCode::LOAD_SUPER:
         return "LOAD_SUPER";
+    case OpCode::LOAD_LOCAL:
+        return "LOAD_LOCAL";
+    case OpCode::STORE_LOCAL:
+        return "STORE_LOCAL";
+    case OpCode::ADD_R:
+        return "ADD_R";
+    case OpCode::SUB_R:
+        return "SUB_R";
+    case OpCode::MUL_R:
+        return "MUL_R";
+    case OpCode::DIV_R:
+        return "DIV_R";
+    case OpCode::PERCENT_R:
+        return "PERCENT_R";
+    case OpCode::EQ_R:
+        return "EQ_R";
+    case OpCode::NE_R:
+        return "NE_R";
+    case OpCode::GT_R:
+        return "GT_R";
+    case OpCode::GE_R:
+        return "GE_R";
+    case OpCode::LT_R:
+        return "LT_R";
+    case OpCode::LE_R:
+        return "LE_R";
+    case OpCode::MOVE_R:
+        return "MOVE_R";
+    case OpCode::CALL_BUILTIN:
+        return "CALL_BUILTIN";
+    case OpCode::ADD_I:
+        return "ADD_I";
+    case OpCode::SUB_I:
+        return "SUB_I";
+    case OpCode::LT_I:
+        return "LT_I";
+    case OpCode::LE_I:
+        return "LE_I";
+    case OpCode::INC_I:
+        return "INC_I";
+    case OpCode::GUARD_INT:
+        return "GUARD_INT";
+    case OpCode::ADD_II:
+        return "ADD_II";
+    case OpCode::SUB_II:
+        return "SUB_II";
+    case OpCode::MUL_II:
+        return "MUL_II";
+    case OpCode::PERCENT_II:
+        return "PERCENT_II";
+    case OpCode::EQ_II:
+        return "EQ_II";
+    case OpCode::NE_II:
+        return "NE_II";
+    case OpCode::GT_II:
+        return "GT_II";
+    case OpCode::GE_II:
+        return "GE_II";
+    case OpCode::LT_II:
+        return "LT_II";
+    case OpCode::LE_II:
+        return "LE_II";
+    case OpCode::INC_II:
+        return "INC_II";
+    case OpCode::STORE_LOCAL_I:
+        return "STORE_LOCAL_I";
+    case OpCode::MOVE_I:
+        return "MOVE_I";
+    case OpCode::LOAD_INDEX_I:
+        return "LOAD_INDEX_I";
+    case OpCode::APPEND_LOCAL:
+        return "APPEND_LOCAL";
+    case OpCode::APPEND_VAR:
+        return "APPEND_VAR";
+    case OpCode::TAIL_CALL:
+        return "TAIL_CALL";
+    case OpCode::GET_ITER:
+        return "GET_ITER";
+    case OpCode::FOR_ITER:
+        return "FOR_ITER";
     default:
         return "UNKNOWN";
     }
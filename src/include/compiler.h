@@ -35,6 +35,10 @@ class Compiler {
     Program compile(const std::vector<StmtPtr>& statements);
     void optimize();
     void set_strict_mode(bool strict) { strict_mode_ = strict; }
+    // Bytecode optimization level, see optimize_body. The default applies
+    // to compilers created afterwards (the -O command-line options).
+    static void set_default_opt_level(int level) { default_opt_level_ = level; }
+    void set_opt_level(int level) { opt_level_ = level; }
     const std::vector<CompileWarning>& get_warnings() const { return warnings_; }
     void set_source_dir(const std::string& dir) { source_dir_ = dir; }
 
@@ -67,10 +71,41 @@ class Compiler {
     std::vector<Operand> constant_pool_;
     std::unordered_map<std::string, uint16_t> method_return_types_;
     bool strict_mode_ = false;
+    static int default_opt_level_;
+    int opt_level_ = default_opt_level_;
     std::vector<CompileWarning> warnings_;
     std::unordered_map<std::string, int> declared_vars_;
     std::unordered_set<std::string> used_vars_;
 
+    // Frame slots of the function body being compiled. Only the innermost
+    // scope is consulted; top-level code has no scope and uses globals.
+    struct LocalScope {
+        std::unordered_map<std::string, uint16_t> slots;
+        std::vector<std::string> names;
+        // Slots declared with an integer type and no non-integer initializer.
+        // Only a hint: the integer opcodes check it at run time.
+        std::vector<bool> int_slots;
+        // Declared type id of each slot: UNDECLARED until its first
+        // declaration, 0 once declarations disagree.
+        static constexpr uint16_t UNDECLARED = UINT16_MAX;
+        std::vector<uint16_t> types;
+    };
+    std::vector<LocalScope> local_scopes_;
+    int resolve_local(const std::string& name) const;
+    bool is_integer_source(const ExprPtr& expr) const;
+
+    // Register-form emission. Returns false when the expression does not fit
+    // (operands must be locals or literals), leaving the caller to use the
+    // stack form.
+    size_t add_constant(const Operand& value);
+    bool register_source(const ExprPtr& expr, uint16_t& index, bool& is_const);
+    bool emit_register_binary(const Binary& expr, int dst);
+    bool emit_register_store(const ExprPtr& value, int slot, int line);
+    bool emit_increment(const Binary& expr, int slot, int line);
+    bool emit_append(const Assign& expr);
+    void visit_discarded(const ExprPtr& expr);
+    void emit_store(const std::string& name, int line = 0);
+
     void load_module(const std::string& path);
 
     void validate_types(const std::vector<StmtPtr>& statements);
@@ -80,7 +115,8 @@ class Compiler {
     uint16_t resolve_type_id(const Token& type_id);
 
     void emit(OpCode op, Operand operand = std::monostate{}, int line = 0);
-    void optimize_bytecode(std::vector<Instruction>& code);
+    void optimize_method(CompiledMethod& method);
+    void specialize_integers(CompiledMethod& method, const std::vector<uint16_t>& slot_types);
 
     void patch_jump(size_t index, size_t target);
     size_t get_global_index(const std::string& name);
@@ -99,6 +135,7 @@ class Compiler {
     void visit_break(const BreakStmt& stmt);
     void visit_continue(const ContinueStmt& stmt);
     void visit_for(const ForStmt& stmt);
+    void visit_for_each(const ForEachStmt& stmt);
 
     void visit_binary(const Binary& expr);
     void visit_unary(const Unary& expr);
@@ -121,10 +158,14 @@ class Compiler {
     void visit_fstring(const FString& expr);
 
     CompiledClass compile_class_def(const ClassStmt& stmt);
-    std::vector<Instruction> compile_method(const FunctionStmt& method);
+    CompiledMethod compile_method(const FunctionStmt& method);
+    CompiledMethod compile_function(const std::vector<VarStmt>& params, const std::vector<StmtPtr>& body);
 
   public:
     static std::string dump_program(const Program& program);
+    // An instruction's operand as --dump-bytecode prints it, with packed
+    // register, increment, append and builtin operands decoded.
+    static std::string format_operand(const Instruction& instr);
 };
 
 } // namespace alphabet
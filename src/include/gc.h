@@ -0,0 +1,53 @@
+#ifndef ALPHABET_GC_H
+#define ALPHABET_GC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace alphabet {
+
+struct ContainerCell;
+
+// Reference counting frees every value as soon as it is dropped, except
+// cycles of lists, maps and objects. The cycle collector finds those by
+// trial deletion: every live container is on one list, and subtracting the
+// references containers hold to each other leaves the references from
+// outside (VM stacks, locals, globals, C++ temporaries, other threads).
+// Containers reachable from one of those are live; the rest are cyclic
+// garbage and are cleared and freed. No roots need to be enumerated, so a
+// collection is safe wherever the VM calls it.
+class CycleCollector {
+  public:
+    struct Stats {
+        uint64_t collections = 0;
+        uint64_t freed = 0; // containers freed as cyclic garbage
+        size_t tracked = 0; // containers alive now
+        double pause_ms = 0; // total time spent collecting
+    };
+
+    static void track(ContainerCell* cell);
+    static void untrack(ContainerCell* cell);
+
+    // True once enough containers were allocated since the last collection.
+    static bool due() {
+        return allocations_.load(std::memory_order_relaxed) >= threshold_.load(std::memory_order_relaxed);
+    }
+    // Frees unreachable cycles and returns how many containers were freed.
+    // Does nothing while thread VMs may be running.
+    static size_t collect();
+    static Stats stats();
+
+    // Bracket the life of a thread VM: collections wait until every thread
+    // has been joined, and the container list is locked once any exists.
+    static void thread_started();
+    static void thread_joined();
+
+  private:
+    static std::atomic<size_t> allocations_;
+    static std::atomic<size_t> threshold_;
+};
+
+} // namespace alphabet
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ALPHABET_INLINER_H
+#define ALPHABET_INLINER_H
+
+#include "bytecode.h"
+#include <cstddef>
+
+namespace alphabet {
+
+// Callees longer than this many instructions keep their call.
+constexpr size_t INLINE_BUDGET = 16;
+
+// -O2: copies the bodies of small callees into the function and method
+// bodies that call them, in place of the CALL. A call is inlined when it
+// can only reach one body: a global function, called by name where no
+// global or field of that name can exist, or a method called on `this`
+// that only one class, the caller's or an ancestor, defines. The callee
+// must fit INLINE_BUDGET, have no loops or try handlers, and not reach
+// itself; its parameters and locals become slots of the caller named
+// `$callee.name`. Copied instructions keep the callee's source lines, so
+// errors raised in them report the same line as before.
+void inline_calls(Program& program);
+
+} // namespace alphabet
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ALPHABET_JIT_H
+#define ALPHABET_JIT_H
+
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The baseline JIT only targets x86-64 Linux. Elsewhere, or with
+// ALPHABET_NO_JIT defined, compile() always returns null.
+#if defined(__x86_64__) && defined(__linux__) && !defined(ALPHABET_NO_JIT)
+#define ALPHABET_JIT 1
+#endif
+
+namespace alphabet {
+
+struct Value;
+class GlobalTable;
+
+// Native code for one bytecode body, built from one machine-code template
+// per instruction. Integer and float arithmetic, comparisons, jumps and
+// moves between locals, globals and the stack run natively. Any other
+// instruction, and any operand its template does not handle, is a side exit:
+// the native code stops before that instruction and returns its index, and
+// the interpreter carries on from there with the same stack and locals.
+class JitCode {
+  public:
+    static constexpr uint32_t NO_ENTRY = UINT32_MAX; // instruction without a template
+
+    ~JitCode();
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    static constexpr bool available() {
+#ifdef ALPHABET_JIT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Null when the platform has no JIT or executable memory is refused.
+    // `global_slots` maps the program's global indices to GlobalTable slots.
+    static std::unique_ptr<JitCode> compile(const std::vector<Instruction>& bytecode, size_t slot_count,
+                                            const std::vector<Operand>& constant_pool,
+                                            const std::vector<uint32_t>& global_slots);
+
+    // True when instruction `ip` has a native template to start from.
+    bool can_enter(size_t ip) const { return ip < entry_.size() && entry_[ip] != NO_ENTRY; }
+
+    // Runs from instruction `ip` until a side exit and returns the index of
+    // the instruction to resume at. `sp` is updated to the new stack top.
+    size_t run(size_t ip, Value* slots, Value*& sp, Value* stack_base, Value* stack_limit,
+               GlobalTable& globals) const;
+
+  private:
+    JitCode() = default;
+
+    uint8_t* memory_ = nullptr;
+    size_t size_ = 0;
+    std::vector<uint32_t> entry_; // code offset of each instruction's template
+};
+
+} // namespace alphabet
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ALPHABET_OPTIMIZER_H
+#define ALPHABET_OPTIMIZER_H
+
+#include "bytecode.h"
+#include <cstddef>
+#include <vector>
+
+namespace alphabet {
+
+// Basic blocks of one bytecode body. A block starts at the entry, at every
+// jump or handler target, and after every jump, return, throw or halt.
+// Successors are block indices; a jump past the last instruction leads to
+// EXIT.
+class ControlFlowGraph {
+  public:
+    static constexpr size_t EXIT = SIZE_MAX;
+
+    struct Block {
+        size_t begin = 0; // first instruction
+        size_t end = 0;   // one past the last instruction
+        std::vector<size_t> successors;
+    };
+
+    explicit ControlFlowGraph(const std::vector<Instruction>& code);
+
+    const std::vector<Block>& blocks() const { return blocks_; }
+    // True when instruction i starts a block, so control can reach it other
+    // than by falling through from i - 1.
+    bool is_leader(size_t i) const { return i < leader_.size() && leader_[i]; }
+    // Blocks reachable from the entry, by index.
+    std::vector<bool> reachable() const;
+
+  private:
+    std::vector<Block> blocks_;
+    std::vector<bool> leader_;
+    std::vector<size_t> block_of_; // block index of each instruction
+};
+
+// Bytecode optimization levels, chosen with -O0, -O1 and -O2:
+//   0  code runs as compiled
+//   1  constant folding, constant branches, unreachable code, NOPs and
+//      loop headers without a back edge
+//   2  first inlining of small callees (inliner.h), then also jump
+//      threading, with all passes repeated until none applies, then the
+//      SSA passes of ssa.h over function bodies
+constexpr int DEFAULT_OPT_LEVEL = 2;
+
+// Drops the marked instructions. A jump to a dropped instruction lands on
+// the next one kept, and a dropped line number moves to the next kept
+// instruction that has none, so the source lines read as before. Returns
+// whether anything was dropped.
+bool drop_instructions(std::vector<Instruction>& code, const std::vector<bool>& drop);
+
+// Runs the passes for `level` over one body in place. Every pass removes
+// instructions by renumbering the jumps across them, so the body stays
+// valid whatever its jumps cross.
+void optimize_body(std::vector<Instruction>& code, int level);
+
+} // namespace alphabet
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef ALPHABET_SSA_H
+#define ALPHABET_SSA_H
+
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace alphabet {
+
+// SSA form of one function body, lifted from its bytecode. Each block
+// starts with the value of every frame slot, merged by a phi where several
+// predecessors meet; every instruction that computes something defines a
+// new value. Values carried on the stack into a block with several
+// predecessors, and everything the IR does not look into (calls, loads
+// from containers and fields, globals), are opaque.
+//
+// Only the arithmetic and ordered comparisons, which depend on nothing but
+// their operands, and z.len are pure values that passes may compute
+// elsewhere. EQ and NE compare containers by content, so they stay opaque.
+class SsaBody {
+  public:
+    using ValueId = uint32_t;
+    static constexpr ValueId NONE = UINT32_MAX;
+    static constexpr size_t NO_BLOCK = SIZE_MAX;
+
+    enum class Kind : uint8_t {
+        Entry,  // a slot's value when the frame starts
+        Const,  // a PUSH_CONST literal or a constant pool entry
+        Phi,    // a slot where predecessors disagree
+        Pure,   // op applied to args
+        Opaque, // anything else
+    };
+
+    struct Value {
+        Kind kind = Kind::Opaque;
+        OpCode op = OpCode::NOP;   // Pure: the stack opcode, or CALL_BUILTIN for z.len
+        std::vector<ValueId> args; // Pure: operands; Phi: one per predecessor
+        Operand constant;          // Const literal
+        int64_t pool_index = -1;   // Const from the pool
+        size_t block = NO_BLOCK;   // defining block; NO_BLOCK for Entry
+        size_t instr = SIZE_MAX;   // defining instruction
+        uint32_t slot = 0;         // Entry and Phi
+    };
+
+    struct Block {
+        size_t begin = 0;
+        size_t end = 0;
+        std::vector<size_t> successors;
+        std::vector<size_t> predecessors;
+        size_t idom = NO_BLOCK; // immediate dominator; the entry has none
+        bool reachable = false;
+    };
+
+    // Lifts `code` for a frame of `slot_count` slots. Returns false, leaving
+    // the body empty, for code it does not model: try handlers, whose
+    // entry state is that of whichever instruction raised, and
+    // instructions with an unknown stack effect.
+    bool build(const std::vector<Instruction>& code, size_t slot_count);
+
+    const std::vector<Block>& blocks() const { return blocks_; }
+    const Value& value(ValueId id) const { return values_[resolve(id)]; }
+    // The value a removed phi stands for, following replacements.
+    ValueId resolve(ValueId id) const;
+
+    size_t block_of(size_t instr) const { return block_of_[instr]; }
+    // What instruction `instr` pushes or stores, or NONE.
+    ValueId defined_by(size_t instr) const { return defined_[instr]; }
+    // Slot values just before `instr` runs.
+    const ValueId* slots_before(size_t instr) const { return &slot_states_[instr * slot_count_]; }
+    // Slot values on entry to `block`.
+    const std::vector<ValueId>& entry_slots(size_t block) const { return block_entry_[block]; }
+    // Values on the stack just before `instr` runs.
+    size_t stack_depth(size_t instr) const { return stack_depths_[instr]; }
+    size_t slot_count() const { return slot_count_; }
+
+    bool dominates(size_t a, size_t b) const;
+    // Blocks in reverse postorder from the entry.
+    const std::vector<size_t>& order() const { return order_; }
+
+  private:
+    ValueId add(Value value);
+
+    std::vector<Block> blocks_;
+    std::vector<size_t> block_of_;
+    std::vector<size_t> order_;
+    std::vector<size_t> rpo_index_;
+    std::vector<Value> values_;
+    mutable std::vector<ValueId> replaced_;
+    std::vector<ValueId> defined_;
+    std::vector<ValueId> slot_states_;
+    std::vector<size_t> stack_depths_;
+    std::vector<std::vector<ValueId>> block_entry_;
+    size_t slot_count_ = 0;
+};
+
+// -O2 passes over the SSA form of a function body: common subexpressions
+// computed again while an earlier result is still in a slot become reads of
+// that slot, and loop-invariant arithmetic and z.len move out of their loop
+// into a temporary slot. Temporaries are appended to method.local_names.
+// Finally two slot loads feeding a binary op fold into its register form.
+void optimize_ssa(CompiledMethod& method);
+
+} // namespace alphabet
+
+#endif
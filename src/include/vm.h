@@ -3,9 +3,14 @@
 
 #include "bytecode.h"
 #include "compiler.h"
+#include "gc.h"
+#include "jit.h"
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <functional>
+#include <istream>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -24,121 +29,428 @@ class RuntimeError : public std::runtime_error {
 
 struct Value;
 
-struct AlphabetObject {
+// Base for heap payloads referenced from a Value. The count is atomic because
+// thread VMs share lists, maps and objects with the spawning VM.
+struct HeapCell {
+    mutable std::atomic<uint32_t> ref_count{0};
+
+    void retain() const { ref_count.fetch_add(1, std::memory_order_relaxed); }
+    bool release() const { return ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+};
+
+// Intrusive reference-counted pointer to a HeapCell subclass.
+template <typename T> class Ref {
+  public:
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+    explicit Ref(T* p) : ptr_(p) {
+        if (ptr_)
+            ptr_->retain();
+    }
+    Ref(const Ref& other) : Ref(other.ptr_) {}
+    Ref(Ref&& other) noexcept : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+    ~Ref() {
+        if (ptr_ && ptr_->release())
+            delete ptr_;
+    }
+    Ref& operator=(Ref other) noexcept {
+        std::swap(ptr_, other.ptr_);
+        return *this;
+    }
+
+    T* get() const { return ptr_; }
+    T* operator->() const { return ptr_; }
+    T& operator*() const { return *ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+    bool operator==(const Ref& other) const { return ptr_ == other.ptr_; }
+    bool operator!=(const Ref& other) const { return ptr_ != other.ptr_; }
+
+  private:
+    T* ptr_ = nullptr;
+};
+
+template <typename T, typename... Args> Ref<T> make_ref(Args&&... args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+// Base for cells that hold other values and so can form reference cycles.
+// Each one is on the cycle collector's list for its whole life.
+struct ContainerCell : HeapCell {
+    enum class Kind : uint8_t { List, Map, Object };
+
+    const Kind gc_kind;
+    int64_t gc_refs = 0; // scratch count for CycleCollector::collect
+    ContainerCell* gc_prev = nullptr;
+    ContainerCell* gc_next = nullptr;
+
+    explicit ContainerCell(Kind kind) : gc_kind(kind) { CycleCollector::track(this); }
+    ~ContainerCell() { CycleCollector::untrack(this); }
+    ContainerCell(const ContainerCell&) = delete;
+    ContainerCell& operator=(const ContainerCell&) = delete;
+};
+
+// Field layout shared by every object of a class that gained the same fields
+// in the same order. Shapes form a transition tree with one root per class
+// id. They are interned for the life of the process, so a raw Shape pointer
+// is a stable key for inline caches and also identifies the class.
+class Shape {
+  public:
+    static const Shape* root(uint16_t class_id);
+
+    // The shape reached by appending `name`; created on first use.
+    const Shape* with_field(const std::string& name) const;
+
+    int find(const std::string& name) const {
+        auto it = slots_.find(name);
+        return it != slots_.end() ? static_cast<int>(it->second) : -1;
+    }
+    size_t size() const { return names_.size(); }
+    uint16_t class_id() const { return class_id_; }
+    const std::vector<std::string>& field_names() const { return names_; }
+
+  private:
+    explicit Shape(uint16_t class_id) : class_id_(class_id) {}
+
+    uint16_t class_id_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> slots_;
+    // Guarded by a process-wide lock: thread VMs share objects and shapes.
+    mutable std::unordered_map<std::string, std::unique_ptr<Shape>> transitions_;
+};
+
+// Fields live inline in `slots`, indexed by the object's current shape.
+struct AlphabetObject : ContainerCell {
     uint16_t class_id;
-    std::unordered_map<std::string, std::shared_ptr<Value>> fields;
+    const Shape* shape;
+    std::vector<Value> slots;
 
-    explicit AlphabetObject(uint16_t id) : class_id(id) {}
+    explicit AlphabetObject(uint16_t id) : ContainerCell(Kind::Object), class_id(id), shape(Shape::root(id)) {}
+
+    const Value* get_field(const std::string& name) const;
+    void set_field(const std::string& name, Value value);
 };
 
-using ObjectPtr = std::shared_ptr<AlphabetObject>;
+using ObjectPtr = Ref<AlphabetObject>;
+
+struct IteratorCell;
+using IteratorPtr = Ref<IteratorCell>;
 
+// A 16-byte tagged value: numbers, bools and null are stored inline; strings,
+// lists, maps, objects and iterators live behind one reference-counted
+// pointer, and cycles among lists, maps and objects are reclaimed by
+// CycleCollector. Strings are immutable
+// once boxed, so copies share the same cell.
 struct Value {
     using List = std::vector<Value>;
     using Map = std::unordered_map<std::string, Value>;
 
-    std::variant<std::monostate, int64_t, double, bool, std::string, std::shared_ptr<List>, std::shared_ptr<Map>,
-                 ObjectPtr>
-        data;
-
-    Value() : data(std::monostate{}) {}
-    Value(std::nullptr_t) : data(std::monostate{}) {}
-    Value(int64_t i) : data(i) {}
-    Value(int i) : data(static_cast<int64_t>(i)) {}
-    Value(double d) : data(d) {}
-    Value(bool b) : data(b) {}
-    Value(const std::string& s) : data(s) {}
-    Value(std::string&& s) : data(std::move(s)) {}
-    Value(const List& l) : data(std::make_shared<List>(l)) {}
-    Value(List&& l) : data(std::make_shared<List>(std::move(l))) {}
-    Value(const Map& m) : data(std::make_shared<Map>(m)) {}
-    Value(Map&& m) : data(std::make_shared<Map>(std::move(m))) {}
-    Value(const ObjectPtr& o) : data(o) {}
-
-    bool is_null() const { return std::holds_alternative<std::monostate>(data); }
-    bool is_integer() const { return std::holds_alternative<int64_t>(data); }
-    bool is_number() const { return std::holds_alternative<double>(data) || std::holds_alternative<int64_t>(data); }
-    bool is_bool() const { return std::holds_alternative<bool>(data); }
-    bool is_string() const { return std::holds_alternative<std::string>(data); }
-    bool is_list() const { return std::holds_alternative<std::shared_ptr<List>>(data); }
-    bool is_map() const { return std::holds_alternative<std::shared_ptr<Map>>(data); }
-    bool is_object() const { return std::holds_alternative<ObjectPtr>(data); }
+    enum class Kind : uint8_t { Null, Integer, Number, Bool, String, List, Map, Object, Iterator };
+
+    Value() : kind_(Kind::Null), i_(0) {}
+    Value(std::nullptr_t) : Value() {}
+    Value(int64_t i) : kind_(Kind::Integer), i_(i) {}
+    Value(int i) : kind_(Kind::Integer), i_(i) {}
+    Value(double d) : kind_(Kind::Number), d_(d) {}
+    Value(bool b) : kind_(Kind::Bool), i_(0) { b_ = b; }
+    Value(const std::string& s);
+    Value(std::string&& s);
+    Value(const List& l);
+    Value(List&& l);
+    Value(const Map& m);
+    Value(Map&& m);
+    Value(const ObjectPtr& o);
+    Value(const IteratorPtr& it);
+
+    Value(const Value& other) : kind_(other.kind_), i_(other.i_) {
+        if (is_heap())
+            cell_->retain();
+    }
+    Value(Value&& other) noexcept : kind_(other.kind_), i_(other.i_) { other.kind_ = Kind::Null; }
+    Value& operator=(const Value& other) {
+        if (other.is_heap())
+            other.cell_->retain();
+        release();
+        kind_ = other.kind_;
+        i_ = other.i_;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            kind_ = other.kind_;
+            i_ = other.i_;
+            other.kind_ = Kind::Null;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    Kind kind() const { return kind_; }
+
+    bool is_null() const { return kind_ == Kind::Null; }
+    bool is_integer() const { return kind_ == Kind::Integer; }
+    bool is_number() const { return kind_ == Kind::Number || kind_ == Kind::Integer; }
+    bool is_bool() const { return kind_ == Kind::Bool; }
+    bool is_string() const { return kind_ == Kind::String; }
+    bool is_list() const { return kind_ == Kind::List; }
+    bool is_map() const { return kind_ == Kind::Map; }
+    bool is_object() const { return kind_ == Kind::Object; }
+    bool is_iterator() const { return kind_ == Kind::Iterator; }
 
     int64_t as_integer() const {
-        if (auto* i = std::get_if<int64_t>(&data))
-            return *i;
-        if (auto* d = std::get_if<double>(&data))
-            return static_cast<int64_t>(*d);
-        if (auto* b = std::get_if<bool>(&data))
-            return *b ? 1 : 0;
-        return 0;
+        switch (kind_) {
+        case Kind::Integer:
+            return i_;
+        case Kind::Number:
+            return static_cast<int64_t>(d_);
+        case Kind::Bool:
+            return b_ ? 1 : 0;
+        default:
+            return 0;
+        }
     }
 
+    // The integer payload without a kind check, for code that has proven
+    // the value is an integer.
+    int64_t raw_integer() const { return i_; }
+    // Likewise for a value known to be a double.
+    double raw_number() const { return d_; }
+
     double as_number() const {
-        if (auto* i = std::get_if<int64_t>(&data))
-            return static_cast<double>(*i);
-        if (auto* d = std::get_if<double>(&data))
-            return *d;
-        if (auto* b = std::get_if<bool>(&data))
-            return *b ? 1.0 : 0.0;
-        return 0.0;
+        switch (kind_) {
+        case Kind::Integer:
+            return static_cast<double>(i_);
+        case Kind::Number:
+            return d_;
+        case Kind::Bool:
+            return b_ ? 1.0 : 0.0;
+        default:
+            return 0.0;
+        }
     }
 
     bool as_bool() const {
-        if (auto* b = std::get_if<bool>(&data))
-            return *b;
-        if (auto* i = std::get_if<int64_t>(&data))
-            return *i != 0;
-        if (auto* d = std::get_if<double>(&data))
-            return *d != 0.0;
-        return false;
+        switch (kind_) {
+        case Kind::Bool:
+            return b_;
+        case Kind::Integer:
+            return i_ != 0;
+        case Kind::Number:
+            return d_ != 0.0;
+        default:
+            return false;
+        }
     }
 
-    const std::string& as_string() const {
-        static const std::string empty;
-        if (auto* s = std::get_if<std::string>(&data))
-            return *s;
-        return empty;
-    }
+    const std::string& as_string() const;
+    // The string's buffer when this Value holds the only reference to it,
+    // so appending in place is invisible to everyone else; null otherwise.
+    std::string* sole_string();
+    // Length in UTF-8 code points, counted once per string and cached.
+    size_t char_count() const;
+    List& as_list();
+    const List& as_list() const;
+    Map& as_map();
+    const Map& as_map() const;
+    ObjectPtr as_object() const;
+    // Null unless this is an iterator.
+    IteratorCell* as_iterator() const;
+
+    // Identity of the heap payload; null for inline kinds.
+    const HeapCell* cell() const { return is_heap() ? cell_ : nullptr; }
 
-    List& as_list() {
-        if (auto* l = std::get_if<std::shared_ptr<List>>(&data)) {
-            if (*l)
-                return **l;
-        }
-        throw RuntimeError("Value is not a list");
+  private:
+    friend class JitCompiler; // generated code reads and writes values directly
+
+    Kind kind_;
+    union {
+        int64_t i_;
+        double d_;
+        bool b_;
+        HeapCell* cell_;
+    };
+
+    bool is_heap() const { return kind_ >= Kind::String; }
+    void box(Kind kind, HeapCell* cell) {
+        kind_ = kind;
+        cell_ = cell;
+        cell_->retain();
     }
+    void release();
+};
 
-    const List& as_list() const {
-        if (auto* l = std::get_if<std::shared_ptr<List>>(&data)) {
-            if (*l)
-                return **l;
-        }
-        throw RuntimeError("Value is not a list");
-    }
+static_assert(sizeof(Value) == 16, "Value must stay two words");
 
-    Map& as_map() {
-        if (auto* m = std::get_if<std::shared_ptr<Map>>(&data)) {
-            if (*m)
-                return **m;
-        }
-        throw RuntimeError("Value is not a map");
-    }
+// String payloads are immutable once shared: only a sole owner may change
+// one (see Value::sole_string), so copies of a string Value share the bytes.
+struct StringCell : HeapCell {
+    std::string value;
+    mutable std::atomic<int64_t> chars{-1}; // cached code point count, -1 if not counted
+    explicit StringCell(std::string v) : value(std::move(v)) {}
+};
 
-    const Map& as_map() const {
-        if (auto* m = std::get_if<std::shared_ptr<Map>>(&data)) {
-            if (*m)
-                return **m;
-        }
-        throw RuntimeError("Value is not a map");
+struct ListCell : ContainerCell {
+    Value::List items;
+    explicit ListCell(Value::List l) : ContainerCell(Kind::List), items(std::move(l)) {}
+};
+
+struct MapCell : ContainerCell {
+    Value::Map items;
+    explicit MapCell(Value::Map m) : ContainerCell(Kind::Map), items(std::move(m)) {}
+};
+
+// A lazy sequence for for-each loops and z.lines: numbers of a range, or a
+// cursor over a list, a map's keys or values, a string's code points or a
+// file's lines. Lists, maps and strings are read in place rather than
+// copied, so a loop sees changes its body makes; a map walk continues from
+// the key it returned last and ends if the body removed that key.
+struct IteratorCell : HeapCell {
+    enum class Source : uint8_t { Empty, Range, List, Keys, Values, String, Lines };
+
+    Source source = Source::Empty;
+    Value items;                         // List, Keys, Values, String
+    size_t pos = 0;                      // List index, String byte offset
+    std::string key;                     // Keys, Values: last key returned
+    bool started = false;                // Keys, Values
+    double next = 0, stop = 0, step = 1; // Range
+    bool integral = false;               // Range: yields integers
+    std::unique_ptr<std::istream> file;  // Lines
+
+    // Stream stages, applied in order to each element by VM::next_item.
+    struct Stage {
+        const CompiledMethod* fn;
+        bool filter; // keep the elements fn accepts instead of mapping them
+    };
+    std::vector<Stage> stages;
+
+    // The iterator GET_ITER makes for `source` walking `value`.
+    static IteratorPtr over(IterSource source, const Value& value);
+    static IteratorPtr range(double start, double stop, double step);
+
+    // Stores the next element in `out`, or returns false at the end.
+    bool advance(Value& out);
+};
+
+inline Value::Value(const std::string& s) {
+    box(Kind::String, new StringCell(s));
+}
+inline Value::Value(std::string&& s) {
+    box(Kind::String, new StringCell(std::move(s)));
+}
+inline Value::Value(const List& l) {
+    box(Kind::List, new ListCell(l));
+}
+inline Value::Value(List&& l) {
+    box(Kind::List, new ListCell(std::move(l)));
+}
+inline Value::Value(const Map& m) {
+    box(Kind::Map, new MapCell(m));
+}
+inline Value::Value(Map&& m) {
+    box(Kind::Map, new MapCell(std::move(m)));
+}
+inline Value::Value(const ObjectPtr& o) : Value() {
+    if (o)
+        box(Kind::Object, o.get());
+}
+inline Value::Value(const IteratorPtr& it) : Value() {
+    if (it)
+        box(Kind::Iterator, it.get());
+}
+
+inline void Value::release() {
+    if (!is_heap() || !cell_->release())
+        return;
+    switch (kind_) {
+    case Kind::String:
+        delete static_cast<StringCell*>(cell_);
+        break;
+    case Kind::List:
+        delete static_cast<ListCell*>(cell_);
+        break;
+    case Kind::Map:
+        delete static_cast<MapCell*>(cell_);
+        break;
+    case Kind::Object:
+        delete static_cast<AlphabetObject*>(cell_);
+        break;
+    case Kind::Iterator:
+        delete static_cast<IteratorCell*>(cell_);
+        break;
+    default:
+        break;
     }
+}
+
+inline const std::string& Value::as_string() const {
+    static const std::string empty;
+    if (kind_ == Kind::String)
+        return static_cast<const StringCell*>(cell_)->value;
+    return empty;
+}
 
-    ObjectPtr as_object() const {
-        if (auto* o = std::get_if<ObjectPtr>(&data))
-            return *o;
+inline std::string* Value::sole_string() {
+    if (kind_ != Kind::String || cell_->ref_count.load(std::memory_order_acquire) != 1)
         return nullptr;
+    auto* cell = static_cast<StringCell*>(cell_);
+    cell->chars.store(-1, std::memory_order_relaxed);
+    return &cell->value;
+}
+
+inline size_t Value::char_count() const {
+    if (kind_ != Kind::String)
+        return 0;
+    auto* cell = static_cast<const StringCell*>(cell_);
+    int64_t cached = cell->chars.load(std::memory_order_relaxed);
+    if (cached >= 0)
+        return static_cast<size_t>(cached);
+    size_t count = 0;
+    for (unsigned char c : cell->value) {
+        if ((c & 0xC0) != 0x80)
+            ++count;
     }
-};
+    cell->chars.store(static_cast<int64_t>(count), std::memory_order_relaxed);
+    return count;
+}
+
+inline Value::List& Value::as_list() {
+    if (kind_ == Kind::List)
+        return static_cast<ListCell*>(cell_)->items;
+    throw RuntimeError("Value is not a list");
+}
+
+inline const Value::List& Value::as_list() const {
+    if (kind_ == Kind::List)
+        return static_cast<const ListCell*>(cell_)->items;
+    throw RuntimeError("Value is not a list");
+}
+
+inline Value::Map& Value::as_map() {
+    if (kind_ == Kind::Map)
+        return static_cast<MapCell*>(cell_)->items;
+    throw RuntimeError("Value is not a map");
+}
+
+inline const Value::Map& Value::as_map() const {
+    if (kind_ == Kind::Map)
+        return static_cast<const MapCell*>(cell_)->items;
+    throw RuntimeError("Value is not a map");
+}
+
+inline ObjectPtr Value::as_object() const {
+    if (kind_ == Kind::Object)
+        return ObjectPtr(static_cast<AlphabetObject*>(cell_));
+    return nullptr;
+}
+
+inline IteratorCell* Value::as_iterator() const {
+    return kind_ == Kind::Iterator ? static_cast<IteratorCell*>(cell_) : nullptr;
+}
+
+inline const Value* AlphabetObject::get_field(const std::string& name) const {
+    int slot = shape->find(name);
+    return slot >= 0 ? &slots[slot] : nullptr;
+}
 
 inline bool operator==(const Value& a, const Value& b) {
     if (a.is_list() && b.is_list()) {
@@ -171,23 +483,246 @@ inline bool operator==(const Value& a, const Value& b) {
             return a.as_integer() == b.as_integer();
         return a.as_number() == b.as_number();
     }
-    return a.data == b.data;
+    if (a.kind() != b.kind())
+        return false;
+    if (a.is_string())
+        return a.cell() == b.cell() || a.as_string() == b.as_string();
+    return a.is_null() || a.cell() == b.cell();
 }
 
 inline bool operator!=(const Value& a, const Value& b) {
     return !(a == b);
 }
 
+// Polymorphic inline cache for one LOAD_FIELD/STORE_FIELD site, mapping the
+// receiver's shape to a slot. For a store that adds the field, `next` is the
+// shape after the transition. A full cache stops learning and the site looks
+// slots up in the shape directly.
+struct FieldCache {
+    static constexpr size_t WAYS = 4;
+    struct Entry {
+        const Shape* shape = nullptr;
+        const Shape* next = nullptr;
+        uint32_t slot = 0;
+    };
+    Entry entries[WAYS];
+    size_t count = 0;
+
+    const Entry* find(const Shape* shape) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (entries[i].shape == shape)
+                return &entries[i];
+        }
+        return nullptr;
+    }
+    void add(const Shape* shape, const Shape* next, uint32_t slot) {
+        if (count < WAYS)
+            entries[count++] = Entry{shape, next, slot};
+    }
+};
+
+// Polymorphic inline cache for one CALL site whose receiver is an object,
+// mapping the receiver's class to the method its vtable resolves to.
+struct MethodCache {
+    static constexpr size_t WAYS = 4;
+    struct Entry {
+        uint16_t class_id = 0;
+        const CompiledMethod* method = nullptr;
+    };
+    Entry entries[WAYS];
+    size_t count = 0;
+
+    const CompiledMethod* find(uint16_t class_id) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (entries[i].class_id == class_id)
+                return entries[i].method;
+        }
+        return nullptr;
+    }
+    void add(uint16_t class_id, const CompiledMethod* method) {
+        if (count < WAYS)
+            entries[count++] = Entry{class_id, method};
+    }
+};
+
+// One instruction as seen by VM::dispatch, kept to 24 bytes so hot loops
+// stay in few cache lines. Operands are unpacked ahead of time into `arg`;
+// anything larger lives in a side table of the DecodedCode, indexed by
+// `site`: `constants` for PUSH_CONST, PUSH_LITERAL and constant register
+// sources, `names` for named LOAD_VAR/STORE_VAR, and the per-site caches
+// for field, call and static accesses. Source lines are in a run-length
+// table that is only read when an instruction may raise.
+struct DecodedInstruction {
+    const void* handler = nullptr; // computed-goto target when threaded
+    int64_t arg = 0;               // jump target, slot, global slot or argument count
+    OpCode op = OpCode::NOP;
+    uint8_t quicken_misses = 0; // guard failures of quickened forms, see dispatch
+    uint32_t site = 0;          // index into the side table for op
+};
+
+struct FieldSite {
+    const std::string* name;
+    FieldCache cache;
+};
+
+struct CallSite {
+    const std::string* name;
+    const CompiledMethod* callee = nullptr; // global function linked at decode time
+    int line = 0;                           // the call's line, so calls skip the line table
+    MethodCache cache;
+};
+
+// GET_STATIC/SET_STATIC: the global slot of `name` in the last class seen.
+struct StaticSite {
+    const std::string* name;
+    uint32_t class_id = UINT32_MAX;
+    uint32_t slot = 0;
+};
+
+// Instruction `first` and everything after it up to the next run is on `line`.
+struct LineRun {
+    uint32_t first;
+    int line;
+};
+
+struct DecodedCode {
+    std::vector<DecodedInstruction> code;
+    std::vector<Value> constants;
+    std::vector<const std::string*> names{nullptr}; // site 0: a slot operand, not a name
+    std::vector<FieldSite> field_sites;
+    std::vector<CallSite> call_sites;
+    std::vector<StaticSite> static_sites;
+    std::vector<LineRun> lines;
+
+    // Nearest source line at or before instruction `index`, 0 if none.
+    int line_at(size_t index) const {
+        auto run = std::upper_bound(lines.begin(), lines.end(), index,
+                                    [](size_t i, const LineRun& r) { return i < r.first; });
+        return run == lines.begin() ? 0 : std::prev(run)->line;
+    }
+
+    uint32_t hotness = 0;     // entries and loop iterations counted toward the JIT threshold
+    bool jit_tried = false;
+    std::unique_ptr<JitCode> native; // null until hot, or if the body could not be compiled
+};
+
+// Per-class dispatch data flattened over the superclass chain by
+// VM::link_classes, so calls and construction never walk the chain by name.
+struct ClassLink {
+    const CompiledClass* cls = nullptr;
+    std::unordered_map<std::string, const CompiledMethod*> vtable; // own and inherited methods
+    const CompiledMethod* constructor = nullptr;
+    std::vector<const CompiledClass*> init_chain; // root class first
+};
+
 struct CallFrame {
     const std::vector<Instruction>* bytecode;
+    const std::vector<Instruction>* generic = nullptr; // twin of a specialized bytecode, see deoptimize
+    DecodedCode* decoded = nullptr;                    // decoded form of bytecode, filled lazily
     size_t ip = 0;
-    std::unordered_map<std::string, Value> locals;
+    size_t slot_base = 0;
+    size_t slot_count = 0;
+    const std::vector<std::string>* slot_names = nullptr;
+    Value self;
     std::vector<std::pair<size_t, size_t>> try_stack;
     Value post_action_value;
     bool push_post_action_on_return = false;
 
     CallFrame() : bytecode(nullptr) {}
     explicit CallFrame(const std::vector<Instruction>* bc) : bytecode(bc) {}
+
+    // Whether a tail call may hand this frame to its callee: not while a
+    // handler is set up in it, nor when it returns something else than its
+    // RET's value (a constructor returns its object).
+    bool reusable() const { return try_stack.empty() && !push_post_action_on_return; }
+
+    // Back to a fresh frame, releasing its values but keeping the try
+    // stack's buffer for the next call.
+    void reset() {
+        bytecode = nullptr;
+        generic = nullptr;
+        decoded = nullptr;
+        ip = 0;
+        slot_base = 0;
+        slot_count = 0;
+        slot_names = nullptr;
+        self = Value();
+        try_stack.clear();
+        post_action_value = Value();
+        push_post_action_on_return = false;
+    }
+};
+
+// The call stack: frames in one contiguous buffer that only grows. A popped
+// frame is reset in place and reused by the next push, so calls in steady
+// state allocate nothing. As with std::vector, references to frames stay
+// valid until a push has to grow the buffer.
+class FrameStack {
+  public:
+    FrameStack() : frames_(INITIAL_CAPACITY) {}
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    CallFrame& back() { return frames_[size_ - 1]; }
+    const CallFrame& back() const { return frames_[size_ - 1]; }
+    CallFrame& operator[](size_t i) { return frames_[i]; }
+    const CallFrame& operator[](size_t i) const { return frames_[i]; }
+    CallFrame* begin() { return frames_.data(); }
+    CallFrame* end() { return frames_.data() + size_; }
+
+    // A fresh frame that runs `bytecode` from its first instruction.
+    CallFrame& push(const std::vector<Instruction>* bytecode) {
+        if (size_ == frames_.size())
+            frames_.resize(frames_.size() * 2);
+        CallFrame& frame = frames_[size_++];
+        frame.bytecode = bytecode;
+        return frame;
+    }
+    void pop() { frames_[--size_].reset(); }
+
+  private:
+    static constexpr size_t INITIAL_CAPACITY = 64;
+    std::vector<CallFrame> frames_;
+    size_t size_ = 0;
+};
+
+// Global variables and class statics ("Class.field"), stored by slot. A
+// name gets a slot the first time it is seen and keeps it for the life of
+// the VM, so compiled code resolves each name once and then indexes. The
+// name side table serves the REPL, the embedding API and the debugger.
+class GlobalTable {
+  public:
+    // The slot for `name`, assigning a new undefined one if needed.
+    uint32_t slot(const std::string& name);
+    const std::string& name(uint32_t slot) const { return names_[slot]; }
+
+    bool defined(uint32_t slot) const { return flags_[slot] & DEFINED; }
+    bool is_const(uint32_t slot) const { return flags_[slot] & CONST; }
+    // Null when the slot was never assigned.
+    const Value* find(uint32_t slot) const { return defined(slot) ? &values_[slot] : nullptr; }
+    Value& value(uint32_t slot) { return values_[slot]; }
+    void set(uint32_t slot, const Value& value) {
+        values_[slot] = value;
+        flags_[slot] |= DEFINED;
+    }
+    void mark_const(uint32_t slot) { flags_[slot] |= CONST; }
+
+    // Defined globals by name, and replacing them all from such a map.
+    // Slots and const marks are kept, so compiled code stays valid.
+    std::unordered_map<std::string, Value> snapshot() const;
+    void assign(const std::unordered_map<std::string, Value>& values);
+
+  private:
+    friend class JitCode;     // native code is handed the storage directly
+    friend class JitCompiler; // and tests the flags itself
+
+    static constexpr uint8_t DEFINED = 1;
+    static constexpr uint8_t CONST = 2;
+
+    std::vector<Value> values_;
+    std::vector<uint8_t> flags_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> slots_;
 };
 
 class VM {
@@ -201,11 +736,16 @@ class VM {
     void run_incremental(const Program& program, size_t bytecode_offset);
     void init(const Program& program);
 
-    std::unordered_map<std::string, Value> get_globals() const { return globals_; }
-    void set_globals(const std::unordered_map<std::string, Value>& g) { globals_ = g; }
+    std::unordered_map<std::string, Value> get_globals() const { return globals_.snapshot(); }
+    void set_globals(const std::unordered_map<std::string, Value>& g) { globals_.assign(g); }
 
     void set_debug_mode(bool enabled) { debug_mode_ = enabled; }
     void set_sandbox_mode(bool enabled) { sandbox_mode_ = enabled; }
+    // Hot functions and loops are compiled to native code, on platforms with
+    // a JIT. New VMs start from the process-wide default (--jit on the CLI).
+    static void set_jit_default(bool enabled);
+    void set_jit_enabled(bool enabled) { jit_enabled_ = enabled && JitCode::available(); }
+    void set_jit_threshold(uint32_t threshold) { jit_threshold_ = threshold; }
     int get_last_line() const { return last_line_; }
     void set_executed_up_to(size_t offset) { executed_up_to_ = offset; }
     void add_breakpoint(int line) { breakpoints_.insert(line); }
@@ -216,6 +756,7 @@ class VM {
     Value& peek(size_t distance = 0);
 
     bool sandbox_mode() const { return sandbox_mode_; }
+    bool jit_enabled() const { return jit_enabled_; }
 
     void throw_exception(const Value& value);
     void mark_const(const std::string& name);
@@ -237,32 +778,164 @@ class VM {
     size_t stack_capacity_ = STACK_MAX;
     Value* stack_ptr_;
 
-    std::unordered_map<std::string, Value> globals_;
-    std::vector<std::string> globals_by_index_;
-    std::vector<CallFrame> frames_;
+    // Parameters and locals of active frames, allocated LIFO alongside frames_.
+    // Frames address their slots by base offset so the buffer may grow.
+    static constexpr size_t LOCALS_MAX = 65536;
+    std::vector<Value> locals_;
+    size_t locals_top_ = 0;
+
+    GlobalTable globals_;
+    std::vector<uint32_t> global_index_slots_; // slot of each Program::globals index
+    std::unordered_map<const std::vector<Instruction>*, DecodedCode> decoded_;
+    FrameStack frames_;
     std::unordered_map<uint16_t, CompiledClass> classes_;
     std::unordered_map<std::string, uint16_t> class_name_to_id_;
+    std::vector<ClassLink> class_links_; // indexed by class id
     std::unordered_map<std::string, CompiledMethod> global_functions_;
 
     bool debug_mode_ = false;
     bool sandbox_mode_ = false;
+    static bool jit_default_;
+    bool jit_enabled_ = jit_default_;
+    uint32_t jit_threshold_ = 1000;
     std::unordered_set<int> breakpoints_;
     bool step_over_ = false;
     std::vector<std::string> program_args_;
     int exit_code_ = 0;
     std::vector<Operand> constant_pool_;
+    std::vector<Value> constants_; // constant_pool_ as ready-made Values
     int last_line_ = 0;
     size_t executed_up_to_ = 0;
 
     void run_loop();
     void execute_instruction(CallFrame& frame);
+    void dispatch(size_t floor);
+    DecodedCode* decoded_for(CallFrame& frame, const void* const* handlers);
+    bool jit_hot(DecodedCode& body, const CallFrame& frame);
+    void reset_dispatch_cache();
+    void bind_globals(const std::vector<std::string>& names);
+    void load_constants(const std::vector<Operand>& pool);
+    bool static_slot(const Value& class_val, const std::string& field, uint32_t& slot);
+    void link_classes();
+    const ClassLink* class_link(uint16_t class_id) const {
+        return class_id < class_links_.size() && class_links_[class_id].cls ? &class_links_[class_id] : nullptr;
+    }
+    CallFrame& push_frame(const CompiledMethod& method, const std::vector<Value>& args, Value self = Value());
+    CallFrame& push_frame(const CompiledMethod& method, Value* args, size_t arg_count, Value self = Value());
+    void deoptimize(CallFrame& frame, size_t ip);
+    void append_to(Value& target, size_t count);
+    void drop_to(Value* top);
+    void pop_frame();
+    void clear_frames();
     const std::vector<Instruction>* lookup_method(const CompiledClass& cls, const std::string& name,
                                                   const std::string& caller_class);
     void system_call(const std::string& method, int arg_count);
-    Value call_lambda(const std::string& lambda_name, const std::vector<Value>& args);
+
+    // z.* builtins, one per entry of BUILTIN_NAMES. Each pops its arguments
+    // and pushes its result; with too few arguments it does nothing.
+    using BuiltinFn = void (VM::*)(int arg_count);
+    static const BuiltinFn BUILTIN_TABLE[];
+    void builtin_print(int arg_count);
+    void builtin_input(int arg_count);
+    void builtin_throw(int arg_count);
+    void builtin_read_file(int arg_count);
+    void builtin_write_file(int arg_count);
+    void builtin_sqrt(int arg_count);
+    void builtin_sin(int arg_count);
+    void builtin_cos(int arg_count);
+    void builtin_tan(int arg_count);
+    void builtin_abs(int arg_count);
+    void builtin_floor(int arg_count);
+    void builtin_ceil(int arg_count);
+    void builtin_round(int arg_count);
+    void builtin_pow(int arg_count);
+    void builtin_min(int arg_count);
+    void builtin_max(int arg_count);
+    void builtin_log(int arg_count);
+    void builtin_log10(int arg_count);
+    void builtin_len(int arg_count);
+    void builtin_tostr(int arg_count);
+    void builtin_tonum(int arg_count);
+    void builtin_type(int arg_count);
+    void builtin_split(int arg_count);
+    void builtin_join(int arg_count);
+    void builtin_replace(int arg_count);
+    void builtin_trim(int arg_count);
+    void builtin_upper(int arg_count);
+    void builtin_lower(int arg_count);
+    void builtin_substr(int arg_count);
+    void builtin_chr(int arg_count);
+    void builtin_ord(int arg_count);
+    void builtin_starts_with(int arg_count);
+    void builtin_ends_with(int arg_count);
+    void builtin_find(int arg_count);
+    void builtin_count(int arg_count);
+    void builtin_range(int arg_count);
+    void builtin_append(int arg_count);
+    void builtin_pop_back(int arg_count);
+    void builtin_contains(int arg_count);
+    void builtin_keys(int arg_count);
+    void builtin_values(int arg_count);
+    void builtin_builder(int arg_count);
+    void builtin_set(int arg_count);
+    void builtin_add(int arg_count);
+    void builtin_has(int arg_count);
+    void builtin_set_size(int arg_count);
+    void builtin_append_str(int arg_count);
+    void builtin_build(int arg_count);
+    void builtin_reverse(int arg_count);
+    void builtin_sort(int arg_count);
+    void builtin_insert(int arg_count);
+    void builtin_remove(int arg_count);
+    void builtin_append_file(int arg_count);
+    void builtin_exists(int arg_count);
+    void builtin_file_size(int arg_count);
+    void builtin_args(int arg_count);
+    void builtin_exit(int arg_count);
+    void builtin_sleep(int arg_count);
+    void builtin_thread(int arg_count);
+    void builtin_join_all(int arg_count);
+    void builtin_lock(int arg_count);
+    void builtin_acquire(int arg_count);
+    void builtin_release(int arg_count);
+    void builtin_http_get(int arg_count);
+    void builtin_http_post(int arg_count);
+    void builtin_timestamp(int arg_count);
+    void builtin_env(int arg_count);
+    void builtin_json_parse(int arg_count);
+    void builtin_json_stringify(int arg_count);
+    void builtin_exec(int arg_count);
+    void builtin_system(int arg_count);
+    void builtin_assert(int arg_count);
+    void builtin_assert_eq(int arg_count);
+    void builtin_rand(int arg_count);
+    void builtin_randint(int arg_count);
+    void builtin_slice(int arg_count);
+    void builtin_flatten(int arg_count);
+    void builtin_is_null(int arg_count);
+    void builtin_is_empty(int arg_count);
+    void builtin_clamp(int arg_count);
+    void builtin_swap(int arg_count);
+    void builtin_unique(int arg_count);
+    void builtin_zip(int arg_count);
+    void builtin_enumerate(int arg_count);
+    void builtin_sum(int arg_count);
+    void builtin_avg(int arg_count);
+    void builtin_flatten_str(int arg_count);
+    void builtin_map(int arg_count);
+    void builtin_filter(int arg_count);
+    void builtin_reduce(int arg_count);
+    void builtin_dyn(int arg_count);
+    void builtin_lines(int arg_count);
+    void builtin_stream(int arg_count);
+    void join_thread();
+    const CompiledMethod& find_lambda(const std::string& lambda_name);
+    Value call_lambda(const CompiledMethod& fn, Value* args, size_t arg_count);
+    bool next_item(IteratorCell& it, Value& out);
+    void stream_call(const std::string& method_name, Value* args, size_t arg_count);
     Value call_lambda_public(const std::string& lambda_name, const std::vector<Value>& args,
                              const std::unordered_map<std::string, CompiledMethod>& fns);
-    void run_field_init(ObjectPtr obj, const CompiledClass& cls);
+    void run_field_init(ObjectPtr obj, const ClassLink& link);
 
     void check_breakpoints(const Instruction& instr);
     void wait_for_debugger_command();
@@ -278,7 +951,6 @@ class VM {
 
     std::unordered_map<std::string, void*> ffi_library_cache_;
     void ffi_close_all();
-    std::unordered_set<std::string> const_vars_;
     std::string last_unhandled_error_;
     TraceCallback trace_callback_;
     std::string output_buffer_;
@@ -0,0 +1,430 @@
+#include "inliner.h"
+#include "ssa.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace alphabet {
+
+namespace {
+
+const std::string* name_operand(const Instruction& instr) {
+    return std::get_if<std::string>(&instr.operand);
+}
+
+bool is_move(OpCode op) {
+    return op == OpCode::MOVE_R || op == OpCode::MOVE_I;
+}
+
+bool writes_slot(const Instruction& instr, size_t slot) {
+    auto* packed = std::get_if<int64_t>(&instr.operand);
+    if (!packed)
+        return false;
+    switch (instr.op) {
+    case OpCode::STORE_LOCAL:
+    case OpCode::STORE_LOCAL_I:
+        return static_cast<size_t>(*packed) == slot;
+    case OpCode::INC_I:
+    case OpCode::INC_II:
+        return IncrementOperands::unpack(*packed).slot == slot;
+    case OpCode::APPEND_LOCAL:
+        return AppendOperands::unpack(*packed).target == slot;
+    default:
+        if (!is_register_op(instr.op))
+            return false;
+        RegisterOperands regs = RegisterOperands::unpack(*packed);
+        return !regs.push && regs.dst == slot;
+    }
+}
+
+// Renames every slot instr reads or writes through `slots`.
+void remap_slots(Instruction& instr, const std::vector<uint16_t>& slots) {
+    auto* packed = std::get_if<int64_t>(&instr.operand);
+    if (!packed)
+        return;
+    switch (instr.op) {
+    case OpCode::LOAD_LOCAL:
+    case OpCode::STORE_LOCAL:
+    case OpCode::STORE_LOCAL_I:
+    case OpCode::GUARD_INT:
+        *packed = slots[static_cast<size_t>(*packed)];
+        break;
+    case OpCode::INC_I:
+    case OpCode::INC_II: {
+        IncrementOperands inc = IncrementOperands::unpack(*packed);
+        inc.slot = slots[inc.slot];
+        *packed = inc.pack();
+        break;
+    }
+    case OpCode::APPEND_LOCAL: {
+        AppendOperands app = AppendOperands::unpack(*packed);
+        app.target = slots[app.target];
+        *packed = app.pack();
+        break;
+    }
+    default: {
+        if (!is_register_op(instr.op))
+            break;
+        RegisterOperands regs = RegisterOperands::unpack(*packed);
+        if (!regs.push)
+            regs.dst = slots[regs.dst];
+        if (!regs.lhs_const)
+            regs.lhs = slots[regs.lhs];
+        if (!is_move(instr.op) && !regs.rhs_const)
+            regs.rhs = slots[regs.rhs];
+        *packed = regs.pack();
+        break;
+    }
+    }
+}
+
+// Source line in effect at each instruction: its own, or the last one
+// before it.
+std::vector<int> effective_lines(const std::vector<Instruction>& code) {
+    std::vector<int> lines(code.size());
+    int line = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].line > 0)
+            line = code[i].line;
+        lines[i] = line;
+    }
+    return lines;
+}
+
+class Inliner {
+  public:
+    explicit Inliner(Program& program) : program_(program) {
+        assigned_.insert(program.globals.begin(), program.globals.end());
+        auto scan = [this](const std::vector<Instruction>& code) {
+            for (const Instruction& instr : code) {
+                const std::string* name = name_operand(instr);
+                if (name && (instr.op == OpCode::STORE_VAR || instr.op == OpCode::STORE_FIELD))
+                    assigned_.insert(*name);
+            }
+        };
+        auto scan_method = [&](const CompiledMethod& method) {
+            scan(method.bytecode);
+            for (const auto& defaults : method.default_value_bytecodes)
+                scan(defaults);
+        };
+        scan(program.main);
+        scan(program.static_init);
+        for (const auto& [name, func] : program.functions)
+            scan_method(func);
+
+        std::map<std::string, size_t> definers;
+        for (auto& [id, cls] : program.classes) {
+            class_by_name_[cls.name] = &cls;
+            scan(cls.field_init);
+            scan(cls.static_init);
+            for (auto& [mname, method] : cls.methods) {
+                scan_method(method);
+                owner_[&method] = &cls;
+                ++definers[mname];
+            }
+            for (const auto& [mname, method] : cls.static_methods) {
+                scan_method(method);
+                ++definers[mname];
+            }
+        }
+        for (auto& [id, cls] : program.classes) {
+            for (auto& [mname, method] : cls.methods) {
+                if (definers[mname] == 1)
+                    only_method_[mname] = &method;
+            }
+        }
+    }
+
+    void run() {
+        for (auto& [name, func] : program_.functions)
+            process(func, name);
+        for (auto& [id, cls] : program_.classes) {
+            for (auto& [mname, method] : cls.methods)
+                process(method, cls.name + "." + mname);
+        }
+    }
+
+  private:
+    enum class State : uint8_t { Pending, Running, Done };
+
+    struct Site {
+        size_t load = 0;
+        size_t call = 0;
+        const CompiledMethod* callee = nullptr;
+        size_t aliased = 0; // trailing arguments read straight from a caller slot
+    };
+
+    // Inlines into method first, so copies of it carry its own inlined
+    // calls. Returns false for a body that reaches itself through its
+    // calls, which is never inlined.
+    bool process(CompiledMethod& method, const std::string& label) {
+        labels_[&method] = label;
+        State& state = states_[&method];
+        if (state == State::Running)
+            recursive_.insert(&method);
+        if (state != State::Pending)
+            return !recursive_.count(&method);
+        state = State::Running;
+        // Specialized bodies must keep the layout of their generic twin.
+        if (method.specialized.empty())
+            inline_into(method);
+        states_[&method] = State::Done;
+        return !recursive_.count(&method);
+    }
+
+    // The body a call reaches, or null when it may reach another, or none.
+    CompiledMethod* resolve_callee(const std::string& receiver, const std::string& name, const CompiledClass* cls) {
+        if (receiver == "this") {
+            auto it = only_method_.find(name);
+            if (!cls || it == only_method_.end())
+                return nullptr;
+            const CompiledClass* definer = owner_[it->second];
+            if (definer->private_methods.count(name) && definer != cls)
+                return nullptr;
+            for (const CompiledClass* c = cls; c; c = superclass(*c)) {
+                if (c == definer)
+                    return process(*it->second, definer->name + "." + name) ? it->second : nullptr;
+            }
+            return nullptr;
+        }
+        // `f(...)` loads f, which is null unless a global or a field of
+        // `this` has that name, and then calls the global function f.
+        if (receiver != name || assigned_.count(name))
+            return nullptr;
+        auto it = program_.functions.find(name);
+        if (it == program_.functions.end())
+            return nullptr;
+        if (!process(it->second, name))
+            return nullptr;
+        // Functions run without `this`; in a method the copy would see one.
+        if (cls && !runs_without_self(it->second))
+            return nullptr;
+        return &it->second;
+    }
+
+    const CompiledClass* superclass(const CompiledClass& cls) const {
+        auto it = class_by_name_.find(cls.superclass);
+        return cls.superclass.empty() || it == class_by_name_.end() ? nullptr : it->second;
+    }
+
+    // Whether method's body can stand in for a call of it: small, done
+    // inlining into itself, with a plain slot layout and code that returns
+    // with nothing else on the stack.
+    bool fits(const CompiledMethod& method) {
+        auto cached = fits_.find(&method);
+        if (cached != fits_.end())
+            return cached->second;
+        bool ok = method.bytecode.size() <= INLINE_BUDGET && method.param_names.size() <= method.local_names.size();
+        // Parameters fill the first slots; slots the compiler added start
+        // with '$' and are written before they are read, so a copy run
+        // again in a loop never sees an earlier run's values.
+        for (size_t s = 0; ok && s < method.local_names.size(); ++s) {
+            if (s < method.param_names.size())
+                ok = method.local_names[s] == method.param_names[s];
+            else
+                ok = method.local_names[s].rfind('$', 0) == 0;
+        }
+        for (size_t i = 0; ok && i < method.bytecode.size(); ++i) {
+            switch (method.bytecode[i].op) {
+            case OpCode::SETUP_TRY:
+            case OpCode::POP_TRY:
+            case OpCode::LOOP_START:
+            case OpCode::BREAK_JUMP:
+            case OpCode::CONTINUE_JUMP:
+            case OpCode::HALT:
+            case OpCode::GUARD_INT:
+                ok = false;
+                break;
+            default:
+                break;
+            }
+        }
+        SsaBody ssa;
+        if (ok)
+            ok = ssa.build(method.bytecode, method.local_names.size());
+        for (size_t i = 0; ok && i < method.bytecode.size(); ++i) {
+            if (method.bytecode[i].op == OpCode::RET && ssa.blocks()[ssa.block_of(i)].reachable)
+                ok = ssa.stack_depth(i) == 1;
+        }
+        return fits_[&method] = ok;
+    }
+
+    // Whether a function's body behaves the same whatever `this` is: it
+    // never reads `this` or a name a field could have, and never stores
+    // by name, which writes a field when there is a `this`.
+    bool runs_without_self(const CompiledMethod& func) const {
+        for (const Instruction& instr : func.bytecode) {
+            const std::string* name = name_operand(instr);
+            if (instr.op == OpCode::LOAD_SUPER || (instr.op == OpCode::STORE_VAR && name))
+                return false;
+            if (instr.op == OpCode::LOAD_VAR && name && (*name == "this" || assigned_.count(*name)))
+                return false;
+        }
+        return true;
+    }
+
+    void inline_into(CompiledMethod& method) {
+        std::vector<Instruction>& code = method.bytecode;
+        SsaBody ssa;
+        if (!ssa.build(code, method.local_names.size()))
+            return;
+        auto it = owner_.find(&method);
+        const CompiledClass* cls = it == owner_.end() ? nullptr : it->second;
+
+        std::vector<Site> sites;
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto* call = std::get_if<std::pair<std::string, int>>(&code[i].operand);
+            bool is_call = code[i].op == OpCode::CALL || code[i].op == OpCode::TAIL_CALL;
+            if (!is_call || !call || call->second < 0 || !ssa.blocks()[ssa.block_of(i)].reachable)
+                continue;
+            SsaBody::ValueId result = ssa.defined_by(i);
+            if (result == SsaBody::NONE)
+                continue;
+            const SsaBody::Value& callee_value = ssa.value(ssa.value(result).args[0]);
+            if (callee_value.kind != SsaBody::Kind::Opaque || callee_value.op != OpCode::LOAD_VAR)
+                continue;
+            size_t load = callee_value.instr;
+            const std::string* receiver = name_operand(code[load]);
+            if (!receiver)
+                continue;
+            const CompiledMethod* callee = resolve_callee(*receiver, call->first, cls);
+            size_t argc = static_cast<size_t>(call->second);
+            if (!callee || callee == &method || argc != callee->param_names.size() || !fits(*callee))
+                continue;
+
+            Site site;
+            site.load = load;
+            site.call = i;
+            site.callee = callee;
+            // An argument that is a lone LOAD_LOCAL right before the call,
+            // of a parameter the callee never assigns, can be read from the
+            // caller's slot instead of a copy.
+            size_t at = i;
+            while (site.aliased < argc && at - 1 > load && code[at - 1].op == OpCode::LOAD_LOCAL &&
+                   ssa.block_of(at - 1) == ssa.block_of(at) &&
+                   ssa.stack_depth(at - 1) + site.aliased + 1 == ssa.stack_depth(i)) {
+                size_t param = argc - 1 - site.aliased;
+                bool assigned = std::any_of(callee->bytecode.begin(), callee->bytecode.end(),
+                                            [&](const Instruction& instr) { return writes_slot(instr, param); });
+                if (assigned)
+                    break;
+                ++site.aliased;
+                --at;
+            }
+            sites.push_back(site);
+        }
+        if (!sites.empty())
+            splice(method, sites);
+    }
+
+    // Rebuilds the body with each site's CALL replaced by its callee's code.
+    void splice(CompiledMethod& method, const std::vector<Site>& sites) {
+        std::vector<Instruction>& code = method.bytecode;
+        std::vector<int> lines = effective_lines(code);
+        std::unordered_map<const CompiledMethod*, uint16_t> bases;
+        std::vector<bool> drop(code.size(), false);
+        std::vector<const Site*> site_at(code.size(), nullptr);
+        for (const Site& site : sites) {
+            auto base = bases.find(site.callee);
+            if (base == bases.end()) {
+                size_t first = method.local_names.size();
+                if (first + site.callee->local_names.size() > UINT16_MAX)
+                    continue;
+                base = bases.emplace(site.callee, static_cast<uint16_t>(first)).first;
+                for (const std::string& local : site.callee->local_names)
+                    method.local_names.push_back("$" + labels_[site.callee] + "." + local);
+            }
+            site_at[site.call] = &site;
+            drop[site.load] = true;
+            for (size_t k = 1; k <= site.aliased; ++k)
+                drop[site.call - k] = true;
+        }
+
+        std::vector<Instruction> out;
+        std::vector<size_t> new_index(code.size() + 1);
+        std::vector<bool> copied;
+        for (size_t i = 0; i < code.size(); ++i) {
+            new_index[i] = out.size();
+            const Site* site = site_at[i];
+            if (!site) {
+                out.push_back(drop[i] ? Instruction(OpCode::NOP, code[i].line) : std::move(code[i]));
+                copied.push_back(false);
+                continue;
+            }
+            const CompiledMethod& callee = *site->callee;
+            size_t argc = callee.param_names.size();
+            size_t stored = argc - site->aliased;
+            std::vector<uint16_t> slots(callee.local_names.size());
+            for (size_t s = 0; s < slots.size(); ++s)
+                slots[s] = static_cast<uint16_t>(bases[site->callee] + s);
+            for (size_t k = 0; k < site->aliased; ++k)
+                slots[argc - 1 - k] = static_cast<uint16_t>(std::get<int64_t>(code[i - 1 - k].operand));
+
+            for (size_t k = stored; k-- > 0;) {
+                out.emplace_back(OpCode::STORE_LOCAL).operand = static_cast<int64_t>(slots[k]);
+                out.emplace_back(OpCode::POP);
+            }
+            // Callee instruction t lands at body + t, and its returns jump
+            // to body + size, where the caller carries on. A tail call site
+            // is followed by RET, so there the callee's returns and tail
+            // calls stay as they are.
+            bool tail = code[i].op == OpCode::TAIL_CALL;
+            size_t body = out.size();
+            std::vector<int> callee_lines = effective_lines(callee.bytecode);
+            for (size_t t = 0; t < callee.bytecode.size(); ++t) {
+                Instruction instr = callee.bytecode[t];
+                remap_slots(instr, slots);
+                instr.line = callee_lines[t] > 0 ? callee_lines[t] : lines[i];
+                if (instr.op == OpCode::RET && !tail) {
+                    // Cannot raise, and its line would move onto the
+                    // caller's code if the jump is dropped.
+                    instr = Instruction(OpCode::JUMP, Operand(static_cast<int64_t>(body + callee.bytecode.size())));
+                } else if (instr.op == OpCode::TAIL_CALL && !tail) {
+                    // Its RET is now a jump, so the caller's frame must stay.
+                    instr.op = OpCode::CALL;
+                } else if (auto* target = std::get_if<int64_t>(&instr.operand); target && is_jump_op(instr.op)) {
+                    *target += static_cast<int64_t>(body);
+                }
+                out.push_back(std::move(instr));
+            }
+            copied.resize(out.size(), true);
+            // The caller's code after the call reads its line from the line
+            // table by position, which now finds the callee's last line.
+            if (i + 1 < code.size() && code[i + 1].line == 0)
+                code[i + 1].line = lines[i];
+        }
+        new_index[code.size()] = out.size();
+        for (size_t j = 0; j < out.size(); ++j) {
+            auto* target = std::get_if<int64_t>(&out[j].operand);
+            if (copied[j] || !is_jump_op(out[j].op) || !target || *target < 0 ||
+                static_cast<size_t>(*target) > code.size())
+                continue;
+            *target = static_cast<int64_t>(new_index[static_cast<size_t>(*target)]);
+        }
+        code = std::move(out);
+    }
+
+    Program& program_;
+    // Names a global or a field may have: declared globals and every name
+    // stored to by name anywhere.
+    std::unordered_set<std::string> assigned_;
+    std::unordered_map<std::string, const CompiledClass*> class_by_name_;
+    std::unordered_map<const CompiledMethod*, const CompiledClass*> owner_;
+    std::unordered_map<std::string, CompiledMethod*> only_method_;
+    std::unordered_map<const CompiledMethod*, State> states_;
+    std::unordered_map<const CompiledMethod*, bool> fits_;
+    std::unordered_set<const CompiledMethod*> recursive_;
+    std::unordered_map<const CompiledMethod*, std::string> labels_;
+};
+
+} // namespace
+
+void inline_calls(Program& program) {
+    Inliner(program).run();
+}
+
+} // namespace alphabet
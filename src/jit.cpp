@@ -0,0 +1,887 @@
+#include "jit.h"
+#include "vm.h"
+
+#ifdef ALPHABET_JIT
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+#endif
+
+namespace alphabet {
+
+#ifdef ALPHABET_JIT
+
+namespace {
+
+enum Reg : int { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+enum Cond : uint8_t {
+    CC_O = 0x0,
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_A = 0x7,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G = 0xF,
+};
+
+// Just enough of an x86-64 assembler for the templates. Memory operands are
+// always [base + disp32]; SSE operands are xmm0-xmm7.
+class Assembler {
+  public:
+    std::vector<uint8_t> code;
+
+    size_t pos() const { return code.size(); }
+
+    void push(int r) {
+        if (r & 8)
+            byte(0x41);
+        byte(static_cast<uint8_t>(0x50 + (r & 7)));
+    }
+    void pop(int r) {
+        if (r & 8)
+            byte(0x41);
+        byte(static_cast<uint8_t>(0x58 + (r & 7)));
+    }
+    void ret() { byte(0xC3); }
+    void jmp_reg(int r) {
+        rex(false, 0, r);
+        byte(0xFF);
+        modrm_reg(4, r);
+    }
+
+    // mov r64, [base + disp]
+    void load(int dst, int base, int32_t disp) {
+        rex(true, dst, base);
+        byte(0x8B);
+        modrm_mem(dst, base, disp);
+    }
+    // mov [base + disp], r64
+    void store(int base, int32_t disp, int src) {
+        rex(true, src, base);
+        byte(0x89);
+        modrm_mem(src, base, disp);
+    }
+    // mov r32, imm32 (zero-extends)
+    void mov_imm32(int dst, uint32_t imm) {
+        rex(false, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+        dword(imm);
+    }
+    // mov r64, imm64
+    void mov_imm(int dst, uint64_t imm) {
+        rex(true, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+        qword(imm);
+    }
+    // mov byte [base + disp], imm8
+    void store_byte(int base, int32_t disp, uint8_t imm) {
+        rex(false, 0, base);
+        byte(0xC6);
+        modrm_mem(0, base, disp);
+        byte(imm);
+    }
+    // cmp byte [base + disp], imm8
+    void cmp_byte(int base, int32_t disp, uint8_t imm) {
+        rex(false, 0, base);
+        byte(0x80);
+        modrm_mem(7, base, disp);
+        byte(imm);
+    }
+    // add 0x01, sub 0x29, cmp 0x39, test 0x85: op dst, src
+    void alu(uint8_t opcode, int dst, int src) {
+        rex(true, src, dst);
+        byte(opcode);
+        modrm_reg(src, dst);
+    }
+    // add /0, sub /5, cmp /7: op dst, imm32
+    void alu_imm(int ext, int dst, int32_t imm) {
+        rex(true, 0, dst);
+        byte(0x81);
+        modrm_reg(ext, dst);
+        dword(static_cast<uint32_t>(imm));
+    }
+    void imul(int dst, int src) {
+        rex(true, dst, src);
+        byte(0x0F);
+        byte(0xAF);
+        modrm_reg(dst, src);
+    }
+    void lea(int dst, int base, int32_t disp) {
+        rex(true, dst, base);
+        byte(0x8D);
+        modrm_mem(dst, base, disp);
+    }
+    void cqo() {
+        byte(0x48);
+        byte(0x99);
+    }
+    void idiv(int r) {
+        rex(true, 0, r);
+        byte(0xF7);
+        modrm_reg(7, r);
+    }
+    // setcc r8 then movzx r32, r8; only for rax..rbx
+    void set_bool(Cond cc, int r) {
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x90 + cc));
+        modrm_reg(0, r);
+        byte(0x0F);
+        byte(0xB6);
+        modrm_reg(r, r);
+    }
+
+    void movsd_load(int x, int base, int32_t disp) {
+        byte(0xF2);
+        rex(false, x, base);
+        byte(0x0F);
+        byte(0x10);
+        modrm_mem(x, base, disp);
+    }
+    void cvtsi2sd_load(int x, int base, int32_t disp) {
+        byte(0xF2);
+        rex(true, x, base);
+        byte(0x0F);
+        byte(0x2A);
+        modrm_mem(x, base, disp);
+    }
+    // prefix 0xF2: addsd 0x58, mulsd 0x59, subsd 0x5C, divsd 0x5E;
+    // prefix 0x66: ucomisd 0x2E, xorpd 0x57
+    void sse(uint8_t prefix, uint8_t opcode, int dst, int src) {
+        byte(prefix);
+        byte(0x0F);
+        byte(opcode);
+        modrm_reg(dst, src);
+    }
+    void movq_to_gpr(int dst, int x) {
+        byte(0x66);
+        rex(true, x, dst);
+        byte(0x0F);
+        byte(0x7E);
+        modrm_reg(x, dst);
+    }
+    void movq_to_xmm(int x, int src) {
+        byte(0x66);
+        rex(true, x, src);
+        byte(0x0F);
+        byte(0x6E);
+        modrm_reg(x, src);
+    }
+
+    // rel32 jumps. Each returns the position of its displacement for patch().
+    size_t jmp() {
+        byte(0xE9);
+        dword(0);
+        return pos() - 4;
+    }
+    size_t jcc(Cond cc) {
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x80 + cc));
+        dword(0);
+        return pos() - 4;
+    }
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, sizeof(rel));
+    }
+
+  private:
+    void byte(uint8_t b) { code.push_back(b); }
+    void dword(uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void qword(uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void rex(bool wide, int reg, int base) {
+        uint8_t r = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0));
+        if (r != 0x40)
+            byte(r);
+    }
+    void modrm_mem(int reg, int base, int32_t disp) {
+        byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+        if ((base & 7) == 4)
+            byte(0x24); // SIB for r12 as base
+        dword(static_cast<uint32_t>(disp));
+    }
+    void modrm_reg(int reg, int rm) { byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))); }
+};
+
+// Passed to generated code in rdi; field offsets are fixed by the prologue.
+struct JitState {
+    Value* slots;
+    Value* sp;
+    Value* stack_base;
+    Value* stack_limit;
+    Value* globals;        // GlobalTable values, reloaded per run since the
+    uint8_t* global_flags; // table grows between runs
+};
+
+uint64_t double_bits(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+} // namespace
+
+// Emits the templates for one body. Generated code keeps the frame's slots
+// in rbx, the stack pointer in r12, the stack limit in r13, the JitState in
+// r14 and the stack base in r15. Every template checks its operands before
+// writing anything, so a side exit can always re-run the instruction in the
+// interpreter. Values are written raw, which is only safe over inline kinds;
+// templates exit rather than overwrite or copy a heap value.
+class JitCompiler {
+  public:
+    JitCompiler(const std::vector<Instruction>& bytecode, size_t slot_count, const std::vector<Operand>& pool,
+                const std::vector<uint32_t>& global_slots)
+        : bytecode_(bytecode), slot_count_(slot_count), pool_(pool), global_slots_(global_slots) {}
+
+    // Returns the machine code; entries() then holds each instruction's offset.
+    std::vector<uint8_t> assemble();
+    const std::vector<uint32_t>& entries() const { return entry_; }
+    bool has_entry() const {
+        return std::any_of(entry_.begin(), entry_.end(), [](uint32_t e) { return e != JitCode::NO_ENTRY; });
+    }
+
+  private:
+    static_assert(sizeof(Value) == 16, "templates assume 16-byte values");
+    static_assert(offsetof(Value, kind_) == 0, "templates read the kind at offset 0");
+    static_assert(offsetof(Value, i_) == 8, "templates read the payload at offset 8");
+    static constexpr size_t MIN_ENTRY_RUN = 3;
+    static constexpr int32_t PAYLOAD = 8;
+    static constexpr int32_t SLOT = 16;
+    static constexpr uint8_t NULL_KIND = static_cast<uint8_t>(Value::Kind::Null);
+    static constexpr uint8_t INT_KIND = static_cast<uint8_t>(Value::Kind::Integer);
+    static constexpr uint8_t NUMBER_KIND = static_cast<uint8_t>(Value::Kind::Number);
+    static constexpr uint8_t BOOL_KIND = static_cast<uint8_t>(Value::Kind::Bool);
+    static constexpr uint8_t HEAP_KIND = static_cast<uint8_t>(Value::Kind::String); // first heap kind
+
+    // An operand: a value in memory, or a constant known at compile time.
+    struct Src {
+        enum Where { Mem, Int, Double } where = Mem;
+        int base = RBX;
+        int32_t disp = 0;
+        uint64_t bits = 0;
+    };
+    // Where a binary result goes: over the left operand on the stack (and
+    // the right one is popped), pushed, or into a slot.
+    enum class Out { StackPair, Push, Slot };
+
+    const std::vector<Instruction>& bytecode_;
+    size_t slot_count_;
+    const std::vector<Operand>& pool_;
+    const std::vector<uint32_t>& global_slots_;
+    Assembler as_;
+    size_t current_ = 0;
+    std::vector<uint32_t> entry_;
+    std::vector<std::pair<size_t, size_t>> jumps_; // displacement, target instruction
+    std::vector<std::pair<size_t, size_t>> exits_; // displacement, instruction to resume at
+
+    bool emit(const Instruction& instr);
+    bool emit_binary(OpCode op, Src lhs, Src rhs, Out out, int32_t dst_disp, bool allow_double);
+    bool emit_move(const RegisterOperands& regs, bool integer_only);
+    bool emit_global(OpCode op, int64_t index);
+
+    bool slot_src(uint16_t index, bool is_const, Src& src) const;
+    static Src slot(size_t index) {
+        Src s;
+        s.disp = static_cast<int32_t>(index) * SLOT;
+        return s;
+    }
+
+    void exit_if(Cond cc) { exits_.emplace_back(as_.jcc(cc), current_); }
+    void exit_always() { exits_.emplace_back(as_.jmp(), current_); }
+    // Exit unless the stack holds `n` values.
+    void need(int n) {
+        as_.lea(RAX, R15, n * SLOT);
+        as_.alu(0x39, R12, RAX);
+        exit_if(CC_B);
+    }
+    // Exit unless there is room to push over an inline value.
+    void room() {
+        as_.alu(0x39, R12, R13);
+        exit_if(CC_AE);
+        guard_inline(R12, 0);
+    }
+    void guard_inline(int base, int32_t disp) {
+        as_.cmp_byte(base, disp, HEAP_KIND);
+        exit_if(CC_AE);
+    }
+    void guard_kind(int base, int32_t disp, uint8_t kind) {
+        as_.cmp_byte(base, disp, kind);
+        exit_if(CC_NE);
+    }
+    void copy(int dst_base, int32_t dst_disp, int src_base, int32_t src_disp) {
+        as_.load(RAX, src_base, src_disp);
+        as_.load(RCX, src_base, src_disp + PAYLOAD);
+        as_.store(dst_base, dst_disp, RAX);
+        as_.store(dst_base, dst_disp + PAYLOAD, RCX);
+    }
+    // Writes kind and the payload in rax.
+    void write(int base, int32_t disp, uint8_t kind) {
+        as_.store_byte(base, disp, kind);
+        as_.store(base, disp + PAYLOAD, RAX);
+    }
+    void load_int(int reg, const Src& src) {
+        if (src.where == Src::Mem)
+            as_.load(reg, src.base, src.disp + PAYLOAD);
+        else
+            as_.mov_imm(reg, src.bits);
+    }
+    void load_double(int x, const Src& src);
+};
+
+bool JitCompiler::slot_src(uint16_t index, bool is_const, Src& src) const {
+    if (!is_const) {
+        if (index >= slot_count_)
+            return false;
+        src = slot(index);
+        return true;
+    }
+    if (index >= pool_.size())
+        return false;
+    if (auto* i = std::get_if<int64_t>(&pool_[index])) {
+        src.where = Src::Int;
+        src.bits = static_cast<uint64_t>(*i);
+        return true;
+    }
+    if (auto* d = std::get_if<double>(&pool_[index])) {
+        src.where = Src::Double;
+        src.bits = double_bits(*d);
+        return true;
+    }
+    return false;
+}
+
+void JitCompiler::load_double(int x, const Src& src) {
+    if (src.where != Src::Mem) {
+        double d;
+        if (src.where == Src::Int) {
+            d = static_cast<double>(static_cast<int64_t>(src.bits));
+        } else {
+            std::memcpy(&d, &src.bits, sizeof(d));
+        }
+        as_.mov_imm(RAX, double_bits(d));
+        as_.movq_to_xmm(x, RAX);
+        return;
+    }
+    as_.cmp_byte(src.base, src.disp, NUMBER_KIND);
+    size_t is_double = as_.jcc(CC_E);
+    guard_kind(src.base, src.disp, INT_KIND);
+    as_.cvtsi2sd_load(x, src.base, src.disp + PAYLOAD);
+    size_t done = as_.jmp();
+    as_.patch(is_double, as_.pos());
+    as_.movsd_load(x, src.base, src.disp + PAYLOAD);
+    as_.patch(done, as_.pos());
+}
+
+// Integers first, then numbers as doubles, like the interpreter. Overflow,
+// division by zero and other operand kinds exit.
+bool JitCompiler::emit_binary(OpCode op, Src lhs, Src rhs, Out out, int32_t dst_disp, bool allow_double) {
+    bool has_double_const = lhs.where == Src::Double || rhs.where == Src::Double;
+    bool int_path = op != OpCode::DIV && !has_double_const;
+    bool double_path = allow_double && (op == OpCode::ADD || op == OpCode::SUB || op == OpCode::MUL ||
+                                        op == OpCode::DIV || op == OpCode::LT || op == OpCode::LE ||
+                                        op == OpCode::GT || op == OpCode::GE);
+    switch (op) {
+    case OpCode::ADD:
+    case OpCode::SUB:
+    case OpCode::MUL:
+    case OpCode::DIV:
+    case OpCode::PERCENT:
+    case OpCode::EQ:
+    case OpCode::NE:
+    case OpCode::LT:
+    case OpCode::LE:
+    case OpCode::GT:
+    case OpCode::GE:
+        break;
+    default:
+        return false;
+    }
+    if (!int_path && !double_path)
+        return false;
+
+    int out_base = RBX;
+    int32_t out_disp = dst_disp;
+    if (out == Out::StackPair) {
+        need(2);
+        out_base = R12;
+        out_disp = -2 * SLOT;
+    } else if (out == Out::Push) {
+        room();
+        out_base = R12;
+        out_disp = 0;
+    } else {
+        guard_inline(RBX, dst_disp);
+    }
+
+    std::vector<size_t> to_double;
+    size_t done = 0;
+    if (int_path) {
+        for (const Src* s : {&lhs, &rhs}) {
+            if (s->where != Src::Mem)
+                continue;
+            as_.cmp_byte(s->base, s->disp, INT_KIND);
+            if (double_path)
+                to_double.push_back(as_.jcc(CC_NE));
+            else
+                exit_if(CC_NE);
+        }
+        load_int(RAX, lhs);
+        load_int(RCX, rhs);
+        uint8_t kind = INT_KIND;
+        switch (op) {
+        case OpCode::ADD:
+            as_.alu(0x01, RAX, RCX);
+            exit_if(CC_O);
+            break;
+        case OpCode::SUB:
+            as_.alu(0x29, RAX, RCX);
+            exit_if(CC_O);
+            break;
+        case OpCode::MUL:
+            as_.imul(RAX, RCX);
+            exit_if(CC_O);
+            break;
+        case OpCode::PERCENT:
+            // x % 0 raises and INT64_MIN % -1 traps; leave both to the VM.
+            as_.alu(0x85, RCX, RCX);
+            exit_if(CC_E);
+            as_.alu_imm(7, RCX, -1);
+            exit_if(CC_E);
+            as_.cqo();
+            as_.idiv(RCX);
+            as_.alu(0x89, RAX, RDX);
+            break;
+        default: {
+            static const std::pair<OpCode, Cond> CONDS[] = {
+                {OpCode::EQ, CC_E}, {OpCode::NE, CC_NE}, {OpCode::LT, CC_L},
+                {OpCode::LE, CC_LE}, {OpCode::GT, CC_G}, {OpCode::GE, CC_GE},
+            };
+            Cond cc = CC_E;
+            for (const auto& [o, c] : CONDS)
+                if (o == op)
+                    cc = c;
+            as_.alu(0x39, RAX, RCX);
+            as_.set_bool(cc, RAX);
+            kind = BOOL_KIND;
+            break;
+        }
+        }
+        write(out_base, out_disp, kind);
+        if (double_path)
+            done = as_.jmp();
+    }
+
+    if (double_path) {
+        for (size_t at : to_double)
+            as_.patch(at, as_.pos());
+        load_double(0, lhs);
+        load_double(1, rhs);
+        uint8_t kind = NUMBER_KIND;
+        switch (op) {
+        case OpCode::ADD:
+            as_.sse(0xF2, 0x58, 0, 1);
+            break;
+        case OpCode::SUB:
+            as_.sse(0xF2, 0x5C, 0, 1);
+            break;
+        case OpCode::MUL:
+            as_.sse(0xF2, 0x59, 0, 1);
+            break;
+        case OpCode::DIV:
+            as_.sse(0x66, 0x57, 2, 2); // xorpd xmm2, xmm2
+            as_.sse(0x66, 0x2E, 1, 2); // ucomisd xmm1, xmm2
+            exit_if(CC_E);             // zero, or NaN
+            as_.sse(0xF2, 0x5E, 0, 1);
+            break;
+        default:
+            // ucomisd leaves "above" clear for NaN, so NaN compares false.
+            if (op == OpCode::LT || op == OpCode::LE)
+                as_.sse(0x66, 0x2E, 1, 0);
+            else
+                as_.sse(0x66, 0x2E, 0, 1);
+            as_.set_bool((op == OpCode::LT || op == OpCode::GT) ? CC_A : CC_AE, RAX);
+            kind = BOOL_KIND;
+            break;
+        }
+        if (kind == NUMBER_KIND)
+            as_.movq_to_gpr(RAX, 0);
+        write(out_base, out_disp, kind);
+        if (int_path)
+            as_.patch(done, as_.pos());
+    }
+
+    if (out == Out::StackPair) {
+        as_.store_byte(R12, -SLOT, NULL_KIND);
+        as_.alu_imm(5, R12, SLOT);
+    } else if (out == Out::Push) {
+        as_.alu_imm(0, R12, SLOT);
+    }
+    return true;
+}
+
+bool JitCompiler::emit_move(const RegisterOperands& regs, bool integer_only) {
+    Src src;
+    if (!slot_src(regs.lhs, regs.lhs_const, src) || (!regs.push && regs.dst >= slot_count_))
+        return false;
+    if (integer_only && src.where == Src::Double)
+        return false;
+    int out_base = regs.push ? R12 : RBX;
+    int32_t out_disp = regs.push ? 0 : static_cast<int32_t>(regs.dst) * SLOT;
+    if (regs.push)
+        room();
+    else
+        guard_inline(RBX, out_disp);
+    if (src.where == Src::Mem) {
+        if (integer_only)
+            guard_kind(src.base, src.disp, INT_KIND);
+        else
+            guard_inline(src.base, src.disp);
+        copy(out_base, out_disp, src.base, src.disp);
+    } else {
+        as_.mov_imm(RAX, src.bits);
+        write(out_base, out_disp, src.where == Src::Int ? INT_KIND : NUMBER_KIND);
+    }
+    if (regs.push)
+        as_.alu_imm(0, R12, SLOT);
+    return true;
+}
+
+// LOAD_VAR and STORE_VAR by global index. The table's storage is loaded
+// from the JitState into rdx and rsi. Undefined globals on load and const
+// ones on store exit, as do heap values either way.
+bool JitCompiler::emit_global(OpCode op, int64_t index) {
+    if (index < 0 || static_cast<size_t>(index) >= global_slots_.size())
+        return false;
+    uint32_t slot = global_slots_[static_cast<size_t>(index)];
+    if (slot > static_cast<uint32_t>(INT32_MAX / SLOT))
+        return false;
+    int32_t disp = static_cast<int32_t>(slot) * SLOT;
+    int32_t flag = static_cast<int32_t>(slot);
+    if (op == OpCode::LOAD_VAR) {
+        room();
+    } else {
+        need(1);
+        guard_inline(R12, -SLOT);
+    }
+    as_.load(RDX, R14, offsetof(JitState, globals));
+    as_.load(RSI, R14, offsetof(JitState, global_flags));
+    guard_inline(RDX, disp);
+    if (op == OpCode::LOAD_VAR) {
+        as_.cmp_byte(RSI, flag, 0);
+        exit_if(CC_E);
+        copy(R12, 0, RDX, disp);
+        as_.alu_imm(0, R12, SLOT);
+        return true;
+    }
+    as_.cmp_byte(RSI, flag, GlobalTable::CONST);
+    exit_if(CC_AE);
+    copy(RDX, disp, R12, -SLOT);
+    as_.store_byte(RSI, flag, GlobalTable::DEFINED);
+    return true;
+}
+
+bool JitCompiler::emit(const Instruction& instr) {
+    const auto* int_operand = std::get_if<int64_t>(&instr.operand);
+    auto local = [&](int64_t index) { return index >= 0 && static_cast<size_t>(index) < slot_count_; };
+
+    switch (instr.op) {
+    case OpCode::NOP:
+    case OpCode::LOOP_START:
+        return true;
+
+    case OpCode::JUMP:
+    case OpCode::BREAK_JUMP:
+    case OpCode::CONTINUE_JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::JUMP_IF_TRUE: {
+        if (!int_operand)
+            return false;
+        size_t target = (*int_operand < 0 || static_cast<size_t>(*int_operand) > bytecode_.size())
+                            ? bytecode_.size()
+                            : static_cast<size_t>(*int_operand);
+        if (instr.op != OpCode::JUMP_IF_FALSE && instr.op != OpCode::JUMP_IF_TRUE) {
+            jumps_.emplace_back(as_.jmp(), target);
+            return true;
+        }
+        // rcx = falsy(top) for integers, bools and null; other kinds exit.
+        need(1);
+        as_.cmp_byte(R12, -SLOT, INT_KIND);
+        size_t not_int = as_.jcc(CC_NE);
+        as_.load(RAX, R12, -SLOT + PAYLOAD);
+        as_.alu(0x85, RAX, RAX);
+        as_.set_bool(CC_E, RCX);
+        size_t have_int = as_.jmp();
+        as_.patch(not_int, as_.pos());
+        as_.cmp_byte(R12, -SLOT, BOOL_KIND);
+        size_t not_bool = as_.jcc(CC_NE);
+        as_.cmp_byte(R12, -SLOT + PAYLOAD, 0);
+        as_.set_bool(CC_E, RCX);
+        size_t have_bool = as_.jmp();
+        as_.patch(not_bool, as_.pos());
+        guard_kind(R12, -SLOT, NULL_KIND);
+        as_.mov_imm32(RCX, 1);
+        as_.patch(have_int, as_.pos());
+        as_.patch(have_bool, as_.pos());
+        as_.store_byte(R12, -SLOT, NULL_KIND);
+        as_.alu_imm(5, R12, SLOT);
+        as_.alu(0x85, RCX, RCX);
+        jumps_.emplace_back(as_.jcc(instr.op == OpCode::JUMP_IF_FALSE ? CC_NE : CC_E), target);
+        return true;
+    }
+
+    case OpCode::PUSH_CONST: {
+        uint8_t kind;
+        uint64_t bits = 0;
+        if (int_operand) {
+            kind = INT_KIND;
+            bits = static_cast<uint64_t>(*int_operand);
+        } else if (auto* d = std::get_if<double>(&instr.operand)) {
+            kind = NUMBER_KIND;
+            bits = double_bits(*d);
+        } else if (std::holds_alternative<std::monostate>(instr.operand) ||
+                   std::holds_alternative<std::nullptr_t>(instr.operand)) {
+            kind = NULL_KIND;
+        } else {
+            return false;
+        }
+        room();
+        as_.mov_imm(RAX, bits);
+        write(R12, 0, kind);
+        as_.alu_imm(0, R12, SLOT);
+        return true;
+    }
+
+    case OpCode::LOAD_LOCAL:
+        if (!int_operand || !local(*int_operand))
+            return false;
+        room();
+        guard_inline(RBX, static_cast<int32_t>(*int_operand) * SLOT);
+        copy(R12, 0, RBX, static_cast<int32_t>(*int_operand) * SLOT);
+        as_.alu_imm(0, R12, SLOT);
+        return true;
+
+    case OpCode::STORE_LOCAL:
+    case OpCode::STORE_LOCAL_I:
+        if (!int_operand || !local(*int_operand))
+            return false;
+        need(1);
+        if (instr.op == OpCode::STORE_LOCAL_I)
+            guard_kind(R12, -SLOT, INT_KIND);
+        else
+            guard_inline(R12, -SLOT);
+        guard_inline(RBX, static_cast<int32_t>(*int_operand) * SLOT);
+        copy(RBX, static_cast<int32_t>(*int_operand) * SLOT, R12, -SLOT);
+        return true;
+
+    case OpCode::LOAD_VAR:
+    case OpCode::STORE_VAR:
+        // Names are late-bound lookups or fields of `this`; only indices run here.
+        return int_operand && emit_global(instr.op, *int_operand);
+
+    case OpCode::POP:
+        need(1);
+        guard_inline(R12, -SLOT);
+        as_.store_byte(R12, -SLOT, NULL_KIND);
+        as_.alu_imm(5, R12, SLOT);
+        return true;
+
+    case OpCode::DUP:
+        need(1);
+        room();
+        guard_inline(R12, -SLOT);
+        copy(R12, 0, R12, -SLOT);
+        as_.alu_imm(0, R12, SLOT);
+        return true;
+
+    case OpCode::ADD:
+    case OpCode::SUB:
+    case OpCode::MUL:
+    case OpCode::DIV:
+    case OpCode::PERCENT:
+    case OpCode::EQ:
+    case OpCode::NE:
+    case OpCode::LT:
+    case OpCode::LE:
+    case OpCode::GT:
+    case OpCode::GE: {
+        Src lhs;
+        lhs.base = R12;
+        lhs.disp = -2 * SLOT;
+        Src rhs;
+        rhs.base = R12;
+        rhs.disp = -SLOT;
+        return emit_binary(instr.op, lhs, rhs, Out::StackPair, 0, true);
+    }
+
+    case OpCode::INC_I:
+    case OpCode::INC_II: {
+        if (!int_operand)
+            return false;
+        IncrementOperands inc = IncrementOperands::unpack(*int_operand);
+        if (!local(inc.slot))
+            return false;
+        int32_t disp = static_cast<int32_t>(inc.slot) * SLOT;
+        guard_kind(RBX, disp, INT_KIND);
+        as_.load(RAX, RBX, disp + PAYLOAD);
+        as_.alu_imm(0, RAX, inc.delta);
+        exit_if(CC_O);
+        as_.store(RBX, disp + PAYLOAD, RAX);
+        return true;
+    }
+
+    case OpCode::GUARD_INT:
+        if (!int_operand || !local(*int_operand))
+            return false;
+        guard_kind(RBX, static_cast<int32_t>(*int_operand) * SLOT, INT_KIND);
+        return true;
+
+    default:
+        break;
+    }
+
+    if (!is_register_op(instr.op) || !int_operand)
+        return false;
+    RegisterOperands regs = RegisterOperands::unpack(*int_operand);
+    if (instr.op == OpCode::MOVE_R || instr.op == OpCode::MOVE_I)
+        return emit_move(regs, instr.op == OpCode::MOVE_I);
+    Src lhs;
+    Src rhs;
+    if (!slot_src(regs.lhs, regs.lhs_const, lhs) || !slot_src(regs.rhs, regs.rhs_const, rhs) ||
+        (!regs.push && regs.dst >= slot_count_))
+        return false;
+    // The _II forms' operands are proven integers; anything else deoptimizes.
+    bool proven = instr.op >= OpCode::ADD_II && instr.op <= OpCode::LE_II;
+    return emit_binary(register_base_op(instr.op), lhs, rhs, regs.push ? Out::Push : Out::Slot,
+                       static_cast<int32_t>(regs.dst) * SLOT, !proven);
+}
+
+std::vector<uint8_t> JitCompiler::assemble() {
+    // Prologue: save callee-saved registers, load the state, jump to the
+    // entry instruction passed in rsi.
+    for (int r : {RBX, R12, R13, R14, R15})
+        as_.push(r);
+    as_.alu(0x89, R14, RDI);
+    as_.load(RBX, RDI, offsetof(JitState, slots));
+    as_.load(R12, RDI, offsetof(JitState, sp));
+    as_.load(R15, RDI, offsetof(JitState, stack_base));
+    as_.load(R13, RDI, offsetof(JitState, stack_limit));
+    as_.jmp_reg(RSI);
+
+    std::vector<size_t> label(bytecode_.size() + 1);
+    entry_.assign(bytecode_.size(), JitCode::NO_ENTRY);
+    for (current_ = 0; current_ < bytecode_.size(); ++current_) {
+        label[current_] = as_.pos();
+        const Instruction& instr = bytecode_[current_];
+        if (emit(instr)) {
+            entry_[current_] = static_cast<uint32_t>(label[current_]);
+        } else {
+            as_.code.resize(label[current_]);
+            exits_.erase(std::remove_if(exits_.begin(), exits_.end(),
+                                        [&](const auto& e) { return e.first >= label[current_]; }),
+                         exits_.end());
+            exit_always();
+        }
+    }
+    label[bytecode_.size()] = as_.pos();
+    exit_always();
+
+    // Entering native code costs about as much as a few dispatches, so only
+    // offer entries that run several templates before their first exit.
+    size_t run = 0;
+    for (size_t i = bytecode_.size(); i-- > 0;) {
+        OpCode op = bytecode_[i].op;
+        if (entry_[i] == JitCode::NO_ENTRY)
+            run = 0;
+        else if (op != OpCode::NOP && op != OpCode::LOOP_START)
+            ++run;
+        if (run < MIN_ENTRY_RUN)
+            entry_[i] = JitCode::NO_ENTRY;
+    }
+
+    for (const auto& [at, target] : jumps_)
+        as_.patch(at, label[target]);
+
+    // One stub per exit point loads its instruction index; all share the
+    // epilogue, which stores the stack pointer back and returns it in rax.
+    std::vector<size_t> stubs(bytecode_.size() + 1, 0);
+    std::vector<std::pair<size_t, size_t>> stub_jumps;
+    for (const auto& [at, ip] : exits_) {
+        if (!stubs[ip]) {
+            stubs[ip] = as_.pos();
+            as_.mov_imm32(RAX, static_cast<uint32_t>(ip));
+            stub_jumps.emplace_back(as_.jmp(), 0);
+        }
+        as_.patch(at, stubs[ip]);
+    }
+    size_t epilogue = as_.pos();
+    as_.store(R14, offsetof(JitState, sp), R12);
+    for (int r : {R15, R14, R13, R12, RBX})
+        as_.pop(r);
+    as_.ret();
+    for (const auto& jump : stub_jumps)
+        as_.patch(jump.first, epilogue);
+    return std::move(as_.code);
+}
+
+JitCode::~JitCode() {
+    if (memory_)
+        munmap(memory_, size_);
+}
+
+std::unique_ptr<JitCode> JitCode::compile(const std::vector<Instruction>& bytecode, size_t slot_count,
+                                          const std::vector<Operand>& constant_pool,
+                                          const std::vector<uint32_t>& global_slots) {
+    JitCompiler compiler(bytecode, slot_count, constant_pool, global_slots);
+    std::vector<uint8_t> machine_code = compiler.assemble();
+    if (!compiler.has_entry())
+        return nullptr;
+    void* memory = mmap(nullptr, machine_code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    std::memcpy(memory, machine_code.data(), machine_code.size());
+    if (mprotect(memory, machine_code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, machine_code.size());
+        return nullptr;
+    }
+    std::unique_ptr<JitCode> code(new JitCode());
+    code->memory_ = static_cast<uint8_t*>(memory);
+    code->size_ = machine_code.size();
+    code->entry_ = compiler.entries();
+    return code;
+}
+
+size_t JitCode::run(size_t ip, Value* slots, Value*& sp, Value* stack_base, Value* stack_limit,
+                    GlobalTable& globals) const {
+    JitState state{slots, sp, stack_base, stack_limit, globals.values_.data(), globals.flags_.data()};
+    auto native = reinterpret_cast<size_t (*)(JitState*, const void*)>(memory_);
+    size_t next = native(&state, memory_ + entry_[ip]);
+    sp = state.sp;
+    return next;
+}
+
+#else
+
+JitCode::~JitCode() = default;
+
+std::unique_ptr<JitCode> JitCode::compile(const std::vector<Instruction>&, size_t, const std::vector<Operand>&,
+                                          const std::vector<uint32_t>&) {
+    return nullptr;
+}
+
+size_t JitCode::run(size_t ip, Value*, Value*&, Value*, Value*, GlobalTable&) const {
+    return ip;
+}
+
+#endif
+
+} // namespace alphabet
@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -129,6 +130,9 @@ void print_help() {
     std::cout << "  --lsp             Start Language Server Protocol server\n";
     std::cout << "  --debug           Run in debug mode (breakpoints)\n";
     std::cout << "  --sandbox         Sandbox mode: block FFI and file access\n";
+    std::cout << "  -O0, -O1, -O2     Bytecode optimization level (default -O2)\n";
+    std::cout << "  --jit=on|off      Compile hot code to native (default on, x86-64 Linux only)\n";
+    std::cout << "  --gc-stats        Print cycle collector statistics after the run\n";
     std::cout << "  --dump-bytecode   Print compiled bytecode and exit\n\n";
     std::cout << "Subcommands:\n";
     std::cout << "  alphabet update   Self-update to latest version (alias: upgrade)\n";
@@ -155,6 +159,14 @@ void print_help() {
     std::cout << "  alphabet --debug program.abc  Debug with breakpoints\n";
 }
 
+void print_gc_stats() {
+    alphabet::CycleCollector::Stats stats = alphabet::CycleCollector::stats();
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2) << "gc: " << stats.collections << " collections, " << stats.freed
+         << " containers freed from cycles, " << stats.tracked << " live, " << stats.pause_ms << " ms paused\n";
+    std::cerr << line.str();
+}
+
 void run_source(const std::string& source, bool debug_mode = false, const std::string& source_dir = "",
                 bool sandbox_mode = false) {
     try {
@@ -179,6 +191,7 @@ void run_source(const std::string& source, bool debug_mode = false, const std::s
         }
 
         alphabet::Compiler compiler;
+        compiler.set_strict_mode(lexer.is_strict());
         if (!source_dir.empty()) {
             compiler.set_source_dir(source_dir);
         }
@@ -256,34 +269,10 @@ bool is_command(const std::string& line) {
 
 } // namespace repl
 
-static std::string format_operand(const alphabet::Operand& op) {
-    return std::visit(
-        [](const auto& v) -> std::string {
-            using T = std::decay_t<decltype(v)>;
-            if constexpr (std::is_same_v<T, std::monostate>)
-                return "";
-            else if constexpr (std::is_same_v<T, int64_t>)
-                return std::to_string(v);
-            else if constexpr (std::is_same_v<T, double>) {
-                std::string s = std::to_string(v);
-                if (s.find('.') != std::string::npos && s.find_last_not_of('0') == s.find('.'))
-                    s.erase(s.find('.'));
-                return s;
-            } else if constexpr (std::is_same_v<T, std::string>)
-                return "\"" + v + "\"";
-            else if constexpr (std::is_same_v<T, std::nullptr_t>)
-                return "null";
-            else if constexpr (std::is_same_v<T, std::pair<std::string, int>>)
-                return v.first + "@" + std::to_string(v.second);
-            return "";
-        },
-        op);
-}
-
 static std::string format_instruction(const alphabet::Instruction& instr, size_t index) {
     std::string result = std::to_string(index) + ": ";
     result += alphabet::opcode_to_string(instr.op);
-    std::string operand = format_operand(instr.operand);
+    std::string operand = alphabet::Compiler::format_operand(instr);
     if (!operand.empty())
         result += " " + operand;
     return result;
@@ -628,7 +617,7 @@ void start_repl() {
             std::cout << "  List:       swap, unique, flatten, flatten_str, zip, enumerate, sum, avg\n";
             std::cout << "  Set:        set, add, has, set_size\n";
             std::cout << "  Map:        keys, values\n";
-            std::cout << "  Functional: map, filter, reduce, range\n";
+            std::cout << "  Functional: map, filter, reduce, stream, range\n";
             std::cout << "  Type:       is_null, is_empty, clamp\n";
             std::cout << "  JSON:       json_parse, json_stringify\n";
             std::cout << "  Network:    http_get, http_post\n";
@@ -877,6 +866,7 @@ void start_repl() {
                     }
 
                     alphabet::Compiler compiler;
+                    compiler.set_strict_mode(lexer.is_strict());
                     alphabet::Program program = compiler.compile(statements);
 
                     if (trace_mode) {
@@ -1352,6 +1342,7 @@ int main(int argc, char* argv[]) {
     bool debug_mode = false;
     bool sandbox_mode = false;
     bool dump_bytecode = false;
+    bool gc_stats = false;
     std::string output_file;
     std::string input_file;
 
@@ -1398,6 +1389,21 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
+        if (arg == "--gc-stats") {
+            gc_stats = true;
+            continue;
+        }
+
+        if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            alphabet::Compiler::set_default_opt_level(arg[2] - '0');
+            continue;
+        }
+
+        if (arg == "--jit=on" || arg == "--jit=off") {
+            alphabet::VM::set_jit_default(arg == "--jit=on");
+            continue;
+        }
+
         if (arg == "-o" || arg == "--output") {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -1634,6 +1640,7 @@ int main(int argc, char* argv[]) {
                     {"o", "o(val)", "Print val to stdout with newline. Alias: z.o()"},
                     {"i", "i()", "Read a line from stdin. Returns string or number if numeric."},
                     {"f", "f(path)", "Read file contents to string. Blocks '..' traversal."},
+                    {"lines", "lines(path)", "Iterate a file line by line without reading it whole."},
                     {"fw", "fw(path, content)", "Write string to file. Overwrites existing."},
                     {"fa", "fa(path, content)", "Append string to file."},
                     {"exists", "exists(path)", "Check if file exists. Returns 1.0 or 0.0."},
@@ -1737,6 +1744,8 @@ int main(int argc, char* argv[]) {
                               "2)\n}\no(fib(20))\n"},
                 {"loop_sum", "#alphabet<en>\n5 total = 0\nl (5 i = 0 : i < 100000 : i = i + 1) {\n  total = total + "
                              "i\n}\no(total)\n"},
+                {"local_loop", "#alphabet<en>\nm 5 sum_to(5 limit) {\n  5 total = 0\n  l (5 i = 0 : i < limit : i = "
+                               "i + 1) {\n    total = total + i\n  }\n  r total\n}\no(sum_to(100000))\n"},
                 {"string_concat", "#alphabet<en>\n5 sb = builder()\nl (5 i = 0 : i < 1000 : i = i + 1) {\n  "
                                   "append_str(sb, \"hello\")\n}\no(len(build(sb)))\n"},
                 {"list_ops", "#alphabet<en>\n5 lst = []\nl (5 i = 0 : i < 1000 : i = i + 1) {\n  append(lst, "
@@ -1956,6 +1965,7 @@ int main(int argc, char* argv[]) {
 
                     if (!parser.had_errors()) {
                         alphabet::Compiler compiler;
+                        compiler.set_strict_mode(lexer.is_strict());
                         auto program = compiler.compile(stmts);
                         alphabet::VM vm(program);
                         vm.run();
@@ -2187,6 +2197,7 @@ int main(int argc, char* argv[]) {
             }
 
             alphabet::Compiler compiler;
+            compiler.set_strict_mode(lexer.is_strict());
 
             size_t last_sl = input_file.find_last_of("/\\");
             if (last_sl != std::string::npos) {
@@ -2264,6 +2275,7 @@ int main(int argc, char* argv[]) {
             }
 
             alphabet::Compiler compiler;
+            compiler.set_strict_mode(lexer.is_strict());
             size_t last_sl = input_file.find_last_of("/\\");
             if (last_sl != std::string::npos) {
                 compiler.set_source_dir(input_file.substr(0, last_sl));
@@ -2277,6 +2289,9 @@ int main(int argc, char* argv[]) {
                 source_dir = input_file.substr(0, last_slash);
             }
             run_source(source, debug_mode, source_dir, sandbox_mode);
+            if (gc_stats) {
+                print_gc_stats();
+            }
         }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -0,0 +1,432 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace alphabet {
+
+namespace {
+
+// Passes stop once a round changes nothing; this bounds pathological bodies.
+constexpr int MAX_ROUNDS = 8;
+
+bool is_unconditional_jump(OpCode op) {
+    return op == OpCode::JUMP || op == OpCode::BREAK_JUMP || op == OpCode::CONTINUE_JUMP;
+}
+
+// Control never falls through to the next instruction.
+bool ends_flow(OpCode op) {
+    return is_unconditional_jump(op) || op == OpCode::RET || op == OpCode::THROW || op == OpCode::HALT;
+}
+
+bool is_branch(OpCode op) {
+    return op == OpCode::JUMP_IF_FALSE || op == OpCode::JUMP_IF_TRUE;
+}
+
+bool is_arithmetic(OpCode op) {
+    return op == OpCode::ADD || op == OpCode::SUB || op == OpCode::MUL || op == OpCode::DIV || op == OpCode::PERCENT;
+}
+
+bool is_comparison(OpCode op) {
+    return op == OpCode::EQ || op == OpCode::NE || op == OpCode::GT || op == OpCode::GE || op == OpCode::LT ||
+           op == OpCode::LE;
+}
+
+// The target of a jump, or null for other instructions and for targets
+// outside the body, which are left alone.
+const int64_t* jump_target(const Instruction& instr, size_t size) {
+    auto* target = std::get_if<int64_t>(&instr.operand);
+    if (!is_jump_op(instr.op) || !target || *target < 0 || static_cast<size_t>(*target) > size)
+        return nullptr;
+    return target;
+}
+
+int64_t* jump_target(Instruction& instr, size_t size) {
+    return const_cast<int64_t*>(jump_target(static_cast<const Instruction&>(instr), size));
+}
+
+bool is_null(const Operand& v) {
+    return std::holds_alternative<std::monostate>(v) || std::holds_alternative<std::nullptr_t>(v);
+}
+
+bool as_double(const Operand& v, double& d) {
+    if (auto* i = std::get_if<int64_t>(&v)) {
+        d = static_cast<double>(*i);
+    } else if (auto* x = std::get_if<double>(&v)) {
+        d = *x;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Evaluates `a op b` for two PUSH_CONST operands the way the VM's binary_op
+// would. Returns false when the VM would raise, or when the result would
+// need formatting that only the VM does (strings joined with doubles).
+bool fold_constant(OpCode op, const Operand& a, const Operand& b, Operand& out) {
+    if (is_null(a) || is_null(b)) {
+        out = nullptr;
+        return true;
+    }
+    auto* ai = std::get_if<int64_t>(&a);
+    auto* bi = std::get_if<int64_t>(&b);
+    if (ai && bi) {
+        int64_t r = 0;
+        bool ok = (op == OpCode::ADD && checked_add(*ai, *bi, r)) || (op == OpCode::SUB && checked_sub(*ai, *bi, r)) ||
+                  (op == OpCode::MUL && checked_mul(*ai, *bi, r));
+        if (op == OpCode::PERCENT && *bi != 0) {
+            r = *bi == -1 ? 0 : *ai % *bi;
+            ok = true;
+        }
+        if (ok) {
+            out = r;
+            return true;
+        }
+    }
+    if (op == OpCode::ADD) {
+        auto* as = std::get_if<std::string>(&a);
+        auto* bs = std::get_if<std::string>(&b);
+        if (as && bs) {
+            out = *as + *bs;
+            return true;
+        }
+        if (as && bi) {
+            out = *as + std::to_string(*bi);
+            return true;
+        }
+        if (ai && bs) {
+            out = std::to_string(*ai) + *bs;
+            return true;
+        }
+    }
+    double x = 0, y = 0;
+    if (!as_double(a, x) || !as_double(b, y))
+        return false;
+    switch (op) {
+    case OpCode::ADD:
+        out = x + y;
+        return true;
+    case OpCode::SUB:
+        out = x - y;
+        return true;
+    case OpCode::MUL:
+        out = x * y;
+        return true;
+    case OpCode::DIV:
+        if (y == 0.0)
+            return false;
+        out = x / y;
+        return true;
+    case OpCode::PERCENT:
+        out = std::fmod(x, y);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether a branch would take a PUSH_CONST operand as true.
+bool constant_truthy(const Operand& v, bool& truthy) {
+    if (is_null(v)) {
+        truthy = false;
+    } else if (auto* i = std::get_if<int64_t>(&v)) {
+        truthy = *i != 0;
+    } else if (auto* d = std::get_if<double>(&v)) {
+        truthy = !(*d == 0);
+    } else if (auto* s = std::get_if<std::string>(&v)) {
+        truthy = !s->empty();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Whether a branch would take `a op b` as true, for a comparison of two
+// PUSH_CONST operands. Comparisons yield booleans, which have no operand
+// form, so they only fold into the branch that tests them.
+bool fold_condition(OpCode op, const Operand& a, const Operand& b, bool& truthy) {
+    auto* ai = std::get_if<int64_t>(&a);
+    auto* bi = std::get_if<int64_t>(&b);
+    double x = 0, y = 0;
+    bool numeric = as_double(a, x) && as_double(b, y);
+    if (op == OpCode::EQ || op == OpCode::NE) {
+        bool equal;
+        if (ai && bi) {
+            equal = *ai == *bi;
+        } else if (numeric) {
+            equal = x == y;
+        } else if (is_null(a) || is_null(b)) {
+            equal = is_null(a) && is_null(b);
+        } else if (std::holds_alternative<std::string>(a) && std::holds_alternative<std::string>(b)) {
+            equal = std::get<std::string>(a) == std::get<std::string>(b);
+        } else if ((std::holds_alternative<std::string>(a) && as_double(b, y)) ||
+                   (as_double(a, x) && std::holds_alternative<std::string>(b))) {
+            equal = false; // values of different kinds
+        } else {
+            return false;
+        }
+        truthy = equal == (op == OpCode::EQ);
+        return true;
+    }
+    if (ai && bi) {
+        truthy = (op == OpCode::GT && *ai > *bi) || (op == OpCode::GE && *ai >= *bi) ||
+                 (op == OpCode::LT && *ai < *bi) || (op == OpCode::LE && *ai <= *bi);
+    } else if (numeric) {
+        truthy = (op == OpCode::GT && x > y) || (op == OpCode::GE && x >= y) || (op == OpCode::LT && x < y) ||
+                 (op == OpCode::LE && x <= y);
+    } else if (is_null(a) || is_null(b)) {
+        truthy = false; // the comparison yields null
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Folds arithmetic on constants, including chains such as 1 + 2 + 3, and
+// branches whose condition is a constant, a comparison of constants or a
+// NOT. A decided branch becomes a JUMP or disappears; the code it skips is
+// left to remove_unreachable.
+bool fold_constants(std::vector<Instruction>& code) {
+    ControlFlowGraph cfg(code);
+    std::vector<bool> drop(code.size(), false);
+    std::vector<size_t> kept; // instructions of the current block still kept
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (cfg.is_leader(i))
+            kept.clear();
+        Instruction& instr = code[i];
+        auto pushes_const = [&](size_t back) {
+            return kept.size() > back && code[kept[kept.size() - 1 - back]].op == OpCode::PUSH_CONST;
+        };
+        auto operand = [&](size_t back) -> Operand& { return code[kept[kept.size() - 1 - back]].operand; };
+        auto drop_kept = [&](size_t count) {
+            for (; count > 0; --count) {
+                drop[kept.back()] = true;
+                kept.pop_back();
+            }
+        };
+
+        if (is_arithmetic(instr.op) && pushes_const(0) && pushes_const(1)) {
+            Operand folded;
+            if (fold_constant(instr.op, operand(1), operand(0), folded)) {
+                operand(1) = std::move(folded);
+                drop_kept(1);
+                drop[i] = true;
+                continue;
+            }
+        } else if (is_branch(instr.op) && !kept.empty()) {
+            bool truthy = false;
+            size_t condition = 0; // instructions computing the condition
+            if (pushes_const(0) && constant_truthy(operand(0), truthy)) {
+                condition = 1;
+            } else if (kept.size() >= 3 && is_comparison(code[kept.back()].op) && pushes_const(1) &&
+                       pushes_const(2) && fold_condition(code[kept.back()].op, operand(2), operand(1), truthy)) {
+                condition = 3;
+            } else if (code[kept.back()].op == OpCode::NOT) {
+                drop_kept(1);
+                instr.op = instr.op == OpCode::JUMP_IF_FALSE ? OpCode::JUMP_IF_TRUE : OpCode::JUMP_IF_FALSE;
+                kept.push_back(i);
+                continue;
+            }
+            if (condition > 0) {
+                drop_kept(condition);
+                if (truthy == (instr.op == OpCode::JUMP_IF_TRUE))
+                    instr.op = OpCode::JUMP;
+                else
+                    drop[i] = true;
+                continue;
+            }
+        }
+        kept.push_back(i);
+    }
+    return drop_instructions(code, drop);
+}
+
+// Drops every block the entry cannot reach: code after a RET, JUMP, THROW
+// or HALT that no jump lands on, and branches decided by fold_constants.
+bool remove_unreachable(std::vector<Instruction>& code) {
+    ControlFlowGraph cfg(code);
+    std::vector<bool> reachable = cfg.reachable();
+    std::vector<bool> drop(code.size(), false);
+    for (size_t b = 0; b < cfg.blocks().size(); ++b) {
+        if (reachable[b])
+            continue;
+        const ControlFlowGraph::Block& block = cfg.blocks()[b];
+        for (size_t i = block.begin; i < block.end; ++i)
+            drop[i] = true;
+    }
+    return drop_instructions(code, drop);
+}
+
+// Points a jump that lands on an unconditional jump (past any NOPs) at that
+// jump's own target, following chains.
+bool thread_jumps(std::vector<Instruction>& code) {
+    size_t size = code.size();
+    bool changed = false;
+    for (auto& instr : code) {
+        if (!is_unconditional_jump(instr.op) && !is_branch(instr.op))
+            continue;
+        int64_t* target = jump_target(instr, size);
+        if (!target)
+            continue;
+        size_t to = static_cast<size_t>(*target);
+        for (size_t hops = 0; hops < size; ++hops) {
+            size_t at = to;
+            while (at < size && code[at].op == OpCode::NOP)
+                ++at;
+            const int64_t* next = at < size && is_unconditional_jump(code[at].op) ? jump_target(code[at], size) : nullptr;
+            if (!next || static_cast<size_t>(*next) == at) {
+                to = at;
+                break;
+            }
+            to = static_cast<size_t>(*next);
+        }
+        if (to != static_cast<size_t>(*target)) {
+            *target = static_cast<int64_t>(to);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Drops NOPs, jumps to the next instruction kept, and LOOP_STARTs no back
+// edge reaches any more. A LOOP_START that still heads a loop stays: it is
+// where the cycle collector and the JIT look in once per iteration.
+bool remove_nops(std::vector<Instruction>& code) {
+    size_t size = code.size();
+    std::vector<bool> back_edge(size, false);
+    for (size_t i = 0; i < size; ++i) {
+        const int64_t* target = code[i].op == OpCode::LOOP_START ? nullptr : jump_target(code[i], size);
+        if (target && static_cast<size_t>(*target) <= i)
+            back_edge[*target] = true;
+    }
+    std::vector<bool> drop(size, false);
+    for (size_t i = 0; i < size; ++i) {
+        OpCode op = code[i].op;
+        drop[i] = op == OpCode::NOP || (op == OpCode::LOOP_START && !back_edge[i]);
+    }
+    for (size_t i = 0; i < size; ++i) {
+        OpCode op = code[i].op;
+        const int64_t* target = jump_target(code[i], size);
+        if (!target || (!is_unconditional_jump(op) && !is_branch(op)) || static_cast<size_t>(*target) <= i)
+            continue;
+        size_t at = i + 1;
+        while (at < static_cast<size_t>(*target) && drop[at])
+            ++at;
+        if (at != static_cast<size_t>(*target))
+            continue;
+        if (is_branch(op)) {
+            code[i].op = OpCode::POP; // the condition is still evaluated and popped
+            code[i].operand = std::monostate{};
+        } else {
+            drop[i] = true;
+        }
+    }
+    bool changed = std::find(drop.begin(), drop.end(), true) != drop.end();
+    drop_instructions(code, drop);
+    return changed;
+}
+
+} // namespace
+
+bool drop_instructions(std::vector<Instruction>& code, const std::vector<bool>& drop) {
+    size_t size = code.size();
+    std::vector<size_t> new_index(size + 1);
+    size_t out = 0;
+    int pending_line = 0;
+    for (size_t i = 0; i < size; ++i) {
+        new_index[i] = out;
+        if (drop[i]) {
+            if (code[i].line > 0)
+                pending_line = code[i].line;
+            continue;
+        }
+        if (code[i].line == 0)
+            code[i].line = pending_line;
+        pending_line = 0;
+        if (out != i)
+            code[out] = std::move(code[i]);
+        ++out;
+    }
+    new_index[size] = out;
+    if (out == size)
+        return false;
+    code.resize(out);
+    for (auto& instr : code) {
+        if (int64_t* target = jump_target(instr, size))
+            *target = static_cast<int64_t>(new_index[*target]);
+    }
+    return true;
+}
+
+ControlFlowGraph::ControlFlowGraph(const std::vector<Instruction>& code) {
+    size_t size = code.size();
+    leader_.assign(size + 1, false);
+    leader_[0] = true;
+    for (size_t i = 0; i < size; ++i) {
+        OpCode op = code[i].op;
+        if (const int64_t* target = jump_target(code[i], size))
+            leader_[*target] = true;
+        if (ends_flow(op) || is_branch(op))
+            leader_[i + 1] = true;
+    }
+
+    block_of_.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (leader_[i]) {
+            Block block;
+            block.begin = i;
+            blocks_.push_back(block);
+        }
+        blocks_.back().end = i + 1;
+        block_of_[i] = blocks_.size() - 1;
+    }
+
+    auto block_at = [&](size_t i) { return i < size ? block_of_[i] : EXIT; };
+    for (Block& block : blocks_) {
+        for (size_t i = block.begin; i < block.end; ++i) {
+            // LOOP_START names its own index, not a place to go.
+            const int64_t* target = code[i].op == OpCode::LOOP_START ? nullptr : jump_target(code[i], size);
+            if (target)
+                block.successors.push_back(block_at(static_cast<size_t>(*target)));
+            else if (is_jump_op(code[i].op) && code[i].op != OpCode::LOOP_START)
+                block.successors.push_back(EXIT); // target outside the body
+        }
+        if (!ends_flow(code[block.end - 1].op))
+            block.successors.push_back(block_at(block.end));
+    }
+}
+
+std::vector<bool> ControlFlowGraph::reachable() const {
+    std::vector<bool> seen(blocks_.size(), false);
+    if (blocks_.empty())
+        return seen;
+    std::vector<size_t> pending{0};
+    seen[0] = true;
+    while (!pending.empty()) {
+        size_t b = pending.back();
+        pending.pop_back();
+        for (size_t next : blocks_[b].successors) {
+            if (next != EXIT && !seen[next]) {
+                seen[next] = true;
+                pending.push_back(next);
+            }
+        }
+    }
+    return seen;
+}
+
+void optimize_body(std::vector<Instruction>& code, int level) {
+    if (level <= 0 || code.empty())
+        return;
+    for (int round = 0; round < MAX_ROUNDS; ++round) {
+        bool changed = fold_constants(code);
+        changed = remove_unreachable(code) || changed;
+        if (level >= 2)
+            changed = thread_jumps(code) || changed;
+        changed = remove_nops(code) || changed;
+        if (!changed || level < 2)
+            break;
+    }
+}
+
+} // namespace alphabet
@@ -1,4 +1,5 @@
 #include "parser.h"
+#include <charconv>
 #include <sstream>
 #include <unordered_map>
 
@@ -712,7 +713,7 @@ StmtPtr Parser::loop_statement(const std::string& label) {
             Token zero(TokenType::NUMBER, std::string_view("0"), 0, item_name.line);
             Token one(TokenType::NUMBER, std::string_view("1"), 1, item_name.line);
 
-            auto fe_decl = std::make_shared<VarStmt>(list_type, fe_token, std::move(collection), std::nullopt);
+            auto fe_decl = std::make_shared<VarStmt>(list_type, fe_token, collection, std::nullopt);
             auto idx_decl = std::make_shared<VarStmt>(int_type, idx_token,
                                                       std::make_shared<Literal>(static_cast<int64_t>(0)), std::nullopt);
 
@@ -747,7 +748,8 @@ StmtPtr Parser::loop_statement(const std::string& label) {
             outer_stmts.push_back(fe_decl);
             outer_stmts.push_back(idx_decl);
             outer_stmts.push_back(loop);
-            return std::make_shared<Block>(std::move(outer_stmts));
+            return std::make_shared<ForEachStmt>(std::move(outer_stmts), item_name, std::move(collection),
+                                                 std::move(body), label);
         }
     }
 
@@ -1188,9 +1190,18 @@ ExprPtr Parser::primary() {
     if (match({TokenType::NUMBER, TokenType::STRING})) {
         Token tok = previous();
         if (tok.type == TokenType::NUMBER) {
-            bool is_integer = tok.lexeme.find('.') == std::string_view::npos;
-            if (is_integer) {
-                return std::make_shared<Literal>(static_cast<int64_t>(tok.literal));
+            // Integer lexemes are parsed exactly rather than through the
+            // token's double; ones too large for int64_t stay doubles.
+            // Keyword literals such as true carry their value only in the token.
+            if (tok.lexeme.find('.') == std::string_view::npos) {
+                int64_t value = 0;
+                auto [end, ec] = std::from_chars(tok.lexeme.data(), tok.lexeme.data() + tok.lexeme.size(), value);
+                if (ec == std::errc() && end == tok.lexeme.data() + tok.lexeme.size()) {
+                    return std::make_shared<Literal>(value);
+                }
+                if (ec != std::errc::result_out_of_range) {
+                    return std::make_shared<Literal>(static_cast<int64_t>(tok.literal));
+                }
             }
             return std::make_shared<Literal>(tok.literal);
         } else {
@@ -0,0 +1,1143 @@
+#include "ssa.h"
+#include "optimizer.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace alphabet {
+
+namespace {
+
+// Bodies whose slot table would pass this many entries are left alone.
+constexpr size_t MAX_SLOT_STATES = size_t(1) << 22;
+
+bool is_pure_op(OpCode op) {
+    switch (op) {
+    case OpCode::ADD:
+    case OpCode::SUB:
+    case OpCode::MUL:
+    case OpCode::DIV:
+    case OpCode::PERCENT:
+    case OpCode::GT:
+    case OpCode::GE:
+    case OpCode::LT:
+    case OpCode::LE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_stack_binary(OpCode op) {
+    return is_pure_op(op) || op == OpCode::EQ || op == OpCode::NE;
+}
+
+// Register form of a stack binary opcode.
+OpCode register_form(OpCode op) {
+    switch (op) {
+    case OpCode::ADD:
+        return OpCode::ADD_R;
+    case OpCode::SUB:
+        return OpCode::SUB_R;
+    case OpCode::MUL:
+        return OpCode::MUL_R;
+    case OpCode::DIV:
+        return OpCode::DIV_R;
+    case OpCode::PERCENT:
+        return OpCode::PERCENT_R;
+    case OpCode::EQ:
+        return OpCode::EQ_R;
+    case OpCode::NE:
+        return OpCode::NE_R;
+    case OpCode::GT:
+        return OpCode::GT_R;
+    case OpCode::GE:
+        return OpCode::GE_R;
+    case OpCode::LT:
+        return OpCode::LT_R;
+    case OpCode::LE:
+        return OpCode::LE_R;
+    default:
+        return OpCode::NOP;
+    }
+}
+
+bool is_move(OpCode op) {
+    return op == OpCode::MOVE_R || op == OpCode::MOVE_I;
+}
+
+uint32_t len_id() {
+    static const uint32_t id = static_cast<uint32_t>(builtin_id("len"));
+    return id;
+}
+
+bool is_len_call(const Instruction& instr) {
+    auto* packed = std::get_if<int64_t>(&instr.operand);
+    if (instr.op != OpCode::CALL_BUILTIN || !packed)
+        return false;
+    BuiltinCall call = BuiltinCall::unpack(*packed);
+    return call.id == len_id() && call.arg_count == 1;
+}
+
+// Builtins that neither change their arguments nor run user code, so a loop
+// calling them leaves every list and map as it was.
+bool leaves_containers(uint32_t id) {
+    static const std::vector<bool> table = [] {
+        static const char* const names[] = {
+            "len",   "sqrt",     "sin",     "cos",         "tan",       "abs",     "floor",  "ceil",  "round",
+            "pow",   "min",      "max",     "log",         "log10",     "tostr",   "tonum",  "type",  "split",
+            "join",  "replace",  "trim",    "upper",       "lower",     "substr",  "chr",    "ord",   "starts_with",
+            "ends_with", "find", "count",   "range",       "contains",  "keys",    "values", "slice", "is_null",
+            "is_empty", "clamp", "unique",  "zip",         "enumerate", "sum",     "avg",    "flatten",
+            "flatten_str", "rand", "randint", "timestamp", "lines", "stream",
+        };
+        std::vector<bool> t(BUILTIN_COUNT, false);
+        for (const char* name : names)
+            t[static_cast<size_t>(builtin_id(name))] = true;
+        return t;
+    }();
+    return id < table.size() && table[id];
+}
+
+// Cannot raise, and changes nothing a caller could see once the frame is
+// unwound by an error: bodies with try handlers are not lifted, so local
+// slots die with the frame.
+bool is_quiet(const Instruction& instr) {
+    switch (instr.op) {
+    case OpCode::LOAD_LOCAL:
+    case OpCode::STORE_LOCAL:
+    case OpCode::PUSH_CONST:
+    case OpCode::PUSH_CONST_POOL:
+    case OpCode::LOAD_VAR:
+    case OpCode::LOAD_FIELD:
+    case OpCode::LOAD_INDEX:
+    case OpCode::DUP:
+    case OpCode::POP:
+    case OpCode::NOT:
+    case OpCode::NOP:
+    case OpCode::EQ:
+    case OpCode::NE:
+    case OpCode::EQ_R:
+    case OpCode::NE_R:
+    case OpCode::MOVE_R:
+        return true;
+    default:
+        return is_len_call(instr);
+    }
+}
+
+// Touches nothing but the value stack, and gives the same result when run
+// twice in a row, so a loop test can be evaluated once more before it.
+bool is_stack_only(const Instruction& instr) {
+    switch (instr.op) {
+    case OpCode::LOAD_LOCAL:
+    case OpCode::PUSH_CONST:
+    case OpCode::PUSH_CONST_POOL:
+    case OpCode::LOAD_VAR:
+    case OpCode::LOAD_FIELD:
+    case OpCode::LOAD_INDEX:
+    case OpCode::DUP:
+    case OpCode::POP:
+    case OpCode::NOT:
+        return true;
+    default:
+        if (is_stack_binary(instr.op) || is_len_call(instr))
+            return true;
+        if (is_register_op(instr.op) && !is_move(instr.op)) {
+            auto* packed = std::get_if<int64_t>(&instr.operand);
+            return packed && RegisterOperands::unpack(*packed).push;
+        }
+        return false;
+    }
+}
+
+// Identifies equal literals, so that every use of one constant is one value.
+std::string constant_key(const Operand& operand) {
+    std::string key(1, static_cast<char>('0' + operand.index()));
+    if (auto* i = std::get_if<int64_t>(&operand)) {
+        key += std::to_string(*i);
+    } else if (auto* d = std::get_if<double>(&operand)) {
+        char bits[sizeof(double)];
+        std::memcpy(bits, d, sizeof(double));
+        key.append(bits, sizeof(double));
+    } else if (auto* s = std::get_if<std::string>(&operand)) {
+        key += *s;
+    }
+    return key;
+}
+
+} // namespace
+
+SsaBody::ValueId SsaBody::add(Value value) {
+    values_.push_back(std::move(value));
+    replaced_.push_back(static_cast<ValueId>(values_.size() - 1));
+    return static_cast<ValueId>(values_.size() - 1);
+}
+
+SsaBody::ValueId SsaBody::resolve(ValueId id) const {
+    if (id == NONE)
+        return NONE;
+    ValueId root = id;
+    while (replaced_[root] != root)
+        root = replaced_[root];
+    while (replaced_[id] != root) {
+        ValueId next = replaced_[id];
+        replaced_[id] = root;
+        id = next;
+    }
+    return root;
+}
+
+bool SsaBody::dominates(size_t a, size_t b) const {
+    while (b != NO_BLOCK && rpo_index_[b] > rpo_index_[a])
+        b = blocks_[b].idom;
+    return b == a;
+}
+
+bool SsaBody::build(const std::vector<Instruction>& code, size_t slot_count) {
+    *this = SsaBody();
+    size_t size = code.size();
+    if (size == 0 || slot_count * size > MAX_SLOT_STATES)
+        return false;
+    for (const Instruction& instr : code) {
+        if (instr.op == OpCode::SETUP_TRY || instr.op == OpCode::POP_TRY)
+            return false;
+    }
+
+    ControlFlowGraph cfg(code);
+    std::vector<bool> reachable = cfg.reachable();
+    block_of_.resize(size);
+    for (size_t b = 0; b < cfg.blocks().size(); ++b) {
+        const ControlFlowGraph::Block& from = cfg.blocks()[b];
+        Block block;
+        block.begin = from.begin;
+        block.end = from.end;
+        block.reachable = reachable[b];
+        for (size_t next : from.successors) {
+            if (next != ControlFlowGraph::EXIT)
+                block.successors.push_back(next);
+        }
+        for (size_t i = block.begin; i < block.end; ++i)
+            block_of_[i] = b;
+        blocks_.push_back(std::move(block));
+    }
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        if (!blocks_[b].reachable)
+            continue;
+        for (size_t next : blocks_[b].successors)
+            blocks_[next].predecessors.push_back(b);
+    }
+
+    // Reverse postorder, then dominators by the iterative method of Cooper,
+    // Harvey and Kennedy.
+    std::vector<bool> visited(blocks_.size(), false);
+    std::vector<std::pair<size_t, size_t>> walk{{0, 0}};
+    visited[0] = true;
+    while (!walk.empty()) {
+        auto& [b, next] = walk.back();
+        if (next < blocks_[b].successors.size()) {
+            size_t succ = blocks_[b].successors[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                walk.emplace_back(succ, 0);
+            }
+        } else {
+            order_.push_back(b);
+            walk.pop_back();
+        }
+    }
+    std::reverse(order_.begin(), order_.end());
+    rpo_index_.assign(blocks_.size(), SIZE_MAX);
+    for (size_t k = 0; k < order_.size(); ++k)
+        rpo_index_[order_[k]] = k;
+
+    auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (rpo_index_[a] > rpo_index_[b])
+                a = blocks_[a].idom;
+            while (rpo_index_[b] > rpo_index_[a])
+                b = blocks_[b].idom;
+        }
+        return a;
+    };
+    blocks_[0].idom = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b : order_) {
+            if (b == 0)
+                continue;
+            size_t idom = NO_BLOCK;
+            for (size_t pred : blocks_[b].predecessors) {
+                if (blocks_[pred].idom == NO_BLOCK)
+                    continue;
+                idom = idom == NO_BLOCK ? pred : intersect(pred, idom);
+            }
+            if (idom != blocks_[b].idom) {
+                blocks_[b].idom = idom;
+                changed = true;
+            }
+        }
+    }
+    blocks_[0].idom = NO_BLOCK;
+
+    // Values, block by block. A block with one predecessor continues its
+    // state; any other gets a phi per slot, filled in once every
+    // predecessor is done.
+    slot_count_ = slot_count;
+    defined_.assign(size, NONE);
+    slot_states_.assign(size * slot_count, NONE);
+    stack_depths_.assign(size, 0);
+    block_entry_.assign(blocks_.size(), {});
+    std::vector<std::vector<ValueId>> exit_slots(blocks_.size());
+    std::vector<std::vector<ValueId>> exit_stack(blocks_.size());
+    std::vector<size_t> entry_depth(blocks_.size(), 0);
+    std::vector<bool> done(blocks_.size(), false);
+    std::map<std::string, ValueId> literals;
+    std::map<int64_t, ValueId> pool_constants;
+
+    std::vector<ValueId> initial(slot_count);
+    for (size_t s = 0; s < slot_count; ++s) {
+        Value value;
+        value.kind = Kind::Entry;
+        value.slot = static_cast<uint32_t>(s);
+        initial[s] = add(std::move(value));
+    }
+    auto literal = [&](const Operand& operand) {
+        std::string key = constant_key(operand);
+        auto it = literals.find(key);
+        if (it != literals.end())
+            return it->second;
+        Value value;
+        value.kind = Kind::Const;
+        value.constant = operand;
+        return literals[key] = add(std::move(value));
+    };
+    auto pooled = [&](int64_t index) {
+        auto it = pool_constants.find(index);
+        if (it != pool_constants.end())
+            return it->second;
+        Value value;
+        value.kind = Kind::Const;
+        value.pool_index = index;
+        return pool_constants[index] = add(std::move(value));
+    };
+
+    auto fail = [this] {
+        *this = SsaBody();
+        return false;
+    };
+
+    for (size_t b : order_) {
+        const Block& block = blocks_[b];
+        size_t preds = block.predecessors.size() + (b == 0 ? 1 : 0);
+        std::vector<ValueId> slots;
+        std::vector<ValueId> stack;
+        if (preds == 1) {
+            if (b == 0) {
+                slots = initial;
+            } else {
+                size_t pred = block.predecessors[0];
+                if (!done[pred])
+                    return fail();
+                slots = exit_slots[pred];
+                stack = exit_stack[pred];
+            }
+        } else {
+            for (size_t s = 0; s < slot_count; ++s) {
+                Value phi;
+                phi.kind = Kind::Phi;
+                phi.block = b;
+                phi.slot = static_cast<uint32_t>(s);
+                slots.push_back(add(std::move(phi)));
+            }
+            size_t depth = 0;
+            for (size_t pred : block.predecessors) {
+                if (done[pred]) {
+                    depth = exit_stack[pred].size();
+                    break;
+                }
+            }
+            for (size_t k = 0; k < depth; ++k) {
+                Value merged;
+                merged.block = b;
+                merged.instr = block.begin;
+                stack.push_back(add(std::move(merged)));
+            }
+        }
+        entry_depth[b] = stack.size();
+        block_entry_[b] = slots;
+
+        for (size_t i = block.begin; i < block.end; ++i) {
+            const Instruction& instr = code[i];
+            std::copy(slots.begin(), slots.end(), slot_states_.begin() + static_cast<std::ptrdiff_t>(i * slot_count));
+            stack_depths_[i] = stack.size();
+            auto* operand = std::get_if<int64_t>(&instr.operand);
+            std::vector<ValueId> inputs;
+            auto take = [&](size_t count) {
+                if (stack.size() < count)
+                    return false;
+                inputs.assign(stack.end() - static_cast<std::ptrdiff_t>(count), stack.end());
+                stack.resize(stack.size() - count);
+                return true;
+            };
+            auto define = [&](Kind kind, OpCode op) {
+                ValueId id = add(Value{});
+                Value& value = values_[id];
+                value.kind = kind;
+                value.op = op;
+                value.args = std::move(inputs);
+                value.block = b;
+                value.instr = i;
+                return defined_[i] = id;
+            };
+            auto push_opaque = [&](size_t pops) {
+                if (!take(pops))
+                    return false;
+                stack.push_back(define(Kind::Opaque, instr.op));
+                return true;
+            };
+            auto slot_ok = [&](int64_t slot) { return slot >= 0 && static_cast<size_t>(slot) < slot_count; };
+
+            bool ok = true;
+            switch (instr.op) {
+            case OpCode::PUSH_CONST:
+                stack.push_back(defined_[i] = literal(instr.operand));
+                break;
+            case OpCode::PUSH_CONST_POOL:
+                if (!operand)
+                    return fail();
+                stack.push_back(defined_[i] = pooled(*operand));
+                break;
+            case OpCode::LOAD_LOCAL:
+                if (!operand || !slot_ok(*operand))
+                    return fail();
+                stack.push_back(defined_[i] = slots[*operand]);
+                break;
+            case OpCode::STORE_LOCAL:
+            case OpCode::STORE_LOCAL_I:
+                if (!operand || !slot_ok(*operand) || stack.empty())
+                    return fail();
+                slots[*operand] = stack.back();
+                break;
+            case OpCode::LOAD_VAR:
+            case OpCode::LOAD_SUPER:
+                ok = push_opaque(0);
+                break;
+            case OpCode::STORE_VAR:
+                ok = !stack.empty();
+                break;
+            case OpCode::DUP:
+                ok = !stack.empty();
+                if (ok)
+                    stack.push_back(stack.back());
+                break;
+            case OpCode::POP:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+            case OpCode::RET:
+            case OpCode::THROW:
+            case OpCode::MARK_CONST:
+                ok = take(1);
+                break;
+            case OpCode::JUMP:
+            case OpCode::BREAK_JUMP:
+            case OpCode::CONTINUE_JUMP:
+            case OpCode::LOOP_START:
+            case OpCode::NOP:
+            case OpCode::HALT:
+            case OpCode::GUARD_INT:
+                break;
+            case OpCode::NOT:
+            case OpCode::LOAD_FIELD:
+            case OpCode::GET_STATIC:
+                ok = push_opaque(1);
+                break;
+            case OpCode::STORE_FIELD:
+            case OpCode::SET_STATIC:
+            case OpCode::LOAD_INDEX:
+            case OpCode::LOAD_INDEX_I:
+            case OpCode::PRINT:
+            case OpCode::EQ:
+            case OpCode::NE:
+                ok = push_opaque(2);
+                break;
+            case OpCode::STORE_INDEX:
+                ok = push_opaque(3);
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV:
+            case OpCode::PERCENT:
+            case OpCode::GT:
+            case OpCode::GE:
+            case OpCode::LT:
+            case OpCode::LE:
+                ok = take(2);
+                if (ok)
+                    stack.push_back(define(Kind::Pure, instr.op));
+                break;
+            case OpCode::BUILD_LIST:
+                ok = operand && *operand >= 0 && push_opaque(static_cast<size_t>(*operand));
+                break;
+            case OpCode::BUILD_MAP:
+                ok = operand && *operand >= 0 && push_opaque(2 * static_cast<size_t>(*operand));
+                break;
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL:
+            case OpCode::NEW: {
+                auto* call = std::get_if<std::pair<std::string, int>>(&instr.operand);
+                size_t argc = call && call->second > 0 ? static_cast<size_t>(call->second) : 0;
+                if (instr.op != OpCode::NEW)
+                    ok = call && push_opaque(argc + 1);
+                else
+                    ok = push_opaque(argc);
+                break;
+            }
+            case OpCode::CALL_BUILTIN: {
+                // Builtins given no arguments push nothing.
+                if (!operand || BuiltinCall::unpack(*operand).arg_count == 0)
+                    return fail();
+                ok = take(BuiltinCall::unpack(*operand).arg_count);
+                if (ok)
+                    stack.push_back(define(is_len_call(instr) ? Kind::Pure : Kind::Opaque, instr.op));
+                break;
+            }
+            case OpCode::GET_ITER: {
+                // The range forms take their bounds, the others a value.
+                int64_t source = operand ? *operand : -1;
+                ok = source >= 0 && push_opaque(source >= 1 && source <= 3 ? static_cast<size_t>(source) : 1);
+                break;
+            }
+            case OpCode::FOR_ITER:
+                ok = push_opaque(1);
+                if (ok)
+                    stack.push_back(define(Kind::Opaque, instr.op));
+                break;
+            case OpCode::APPEND_LOCAL:
+            case OpCode::APPEND_VAR: {
+                if (!operand)
+                    return fail();
+                AppendOperands app = AppendOperands::unpack(*operand);
+                ok = take(app.count);
+                if (ok && instr.op == OpCode::APPEND_LOCAL) {
+                    if (!slot_ok(app.target))
+                        return fail();
+                    slots[app.target] = define(Kind::Opaque, instr.op);
+                }
+                break;
+            }
+            case OpCode::INC_I:
+            case OpCode::INC_II: {
+                if (!operand)
+                    return fail();
+                uint16_t slot = IncrementOperands::unpack(*operand).slot;
+                if (!slot_ok(slot))
+                    return fail();
+                inputs.push_back(slots[slot]);
+                slots[slot] = define(Kind::Opaque, instr.op);
+                break;
+            }
+            default: {
+                if (!is_register_op(instr.op) || !operand)
+                    return fail();
+                RegisterOperands regs = RegisterOperands::unpack(*operand);
+                auto source = [&](uint16_t index, bool is_const) {
+                    return is_const ? pooled(index) : (slot_ok(index) ? slots[index] : NONE);
+                };
+                ValueId lhs = source(regs.lhs, regs.lhs_const);
+                ValueId rhs = is_move(instr.op) ? lhs : source(regs.rhs, regs.rhs_const);
+                if (lhs == NONE || rhs == NONE || (!regs.push && !slot_ok(regs.dst)))
+                    return fail();
+                ValueId result;
+                if (is_move(instr.op)) {
+                    result = defined_[i] = lhs;
+                } else {
+                    OpCode base = register_base_op(instr.op);
+                    inputs = {lhs, rhs};
+                    result = define(is_pure_op(base) ? Kind::Pure : Kind::Opaque, base);
+                }
+                if (regs.push)
+                    stack.push_back(result);
+                else
+                    slots[regs.dst] = result;
+                break;
+            }
+            }
+            if (!ok)
+                return fail();
+        }
+        exit_slots[b] = std::move(slots);
+        exit_stack[b] = std::move(stack);
+        done[b] = true;
+    }
+
+    // Every way into a block must agree on the stack depth.
+    for (size_t b : order_) {
+        if (b == 0 && entry_depth[b] != 0)
+            return fail();
+        for (size_t pred : blocks_[b].predecessors) {
+            if (exit_stack[pred].size() != entry_depth[b])
+                return fail();
+        }
+        for (size_t s = 0; s < slot_count; ++s) {
+            Value& phi = values_[block_entry_[b][s]];
+            if (phi.kind != Kind::Phi || phi.block != b)
+                continue;
+            for (size_t pred : blocks_[b].predecessors)
+                phi.args.push_back(exit_slots[pred][s]);
+            if (b == 0)
+                phi.args.push_back(initial[s]);
+        }
+    }
+
+    // A phi whose inputs are one value, or itself, is that value.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (ValueId id = 0; id < values_.size(); ++id) {
+            if (values_[id].kind != Kind::Phi || resolve(id) != id)
+                continue;
+            ValueId same = NONE;
+            bool trivial = true;
+            for (ValueId arg : values_[id].args) {
+                ValueId r = resolve(arg);
+                if (r == id || r == same)
+                    continue;
+                if (same != NONE) {
+                    trivial = false;
+                    break;
+                }
+                same = r;
+            }
+            if (trivial && same != NONE) {
+                replaced_[id] = same;
+                changed = true;
+            }
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// The passes edit a copy of the body held per original instruction, so
+// every SSA fact keeps referring to the code it was built from, and lay
+// the result out once at the end.
+class SsaOptimizer {
+  public:
+    SsaOptimizer(CompiledMethod& method, const SsaBody& ssa)
+        : method_(method), code_(method.bytecode), ssa_(ssa), out_(code_.size()), before_(code_.size()),
+          touched_(code_.size(), false), unit_begin_(code_.size(), SIZE_MAX) {
+        for (size_t i = 0; i < code_.size(); ++i)
+            out_[i] = {code_[i]};
+        find_units();
+        find_loops();
+    }
+
+    void hoist_invariants() {
+        for (Loop& loop : loops_)
+            hoist(loop);
+    }
+
+    void reuse_slots() {
+        for (size_t b : ssa_.order()) {
+            const SsaBody::Block& block = ssa_.blocks()[b];
+            for (size_t i = block.begin; i < block.end; ++i)
+                reuse_slot(i);
+        }
+    }
+
+    bool changed() const { return changed_; }
+
+    std::vector<Instruction> lower();
+
+  private:
+    struct Loop {
+        size_t header = 0; // block
+        size_t start = 0;  // its LOOP_START
+        std::vector<bool> blocks;
+        std::map<std::pair<OpCode, std::vector<SsaBody::ValueId>>, std::pair<uint16_t, size_t>> temps;
+    };
+
+    using Key = std::pair<OpCode, std::vector<SsaBody::ValueId>>;
+
+    bool in_loop(const Loop& loop, size_t instr) const { return loop.blocks[ssa_.block_of(instr)]; }
+
+    // The pure value instruction i leaves, and the operands it was computed
+    // from, or false for anything else.
+    bool pure_key(size_t i, Key& key) const {
+        SsaBody::ValueId id = ssa_.defined_by(i);
+        if (id == SsaBody::NONE || ssa_.resolve(id) != id)
+            return false;
+        const SsaBody::Value& value = ssa_.value(id);
+        if (value.kind != SsaBody::Kind::Pure || value.instr != i)
+            return false;
+        key.first = value.op;
+        key.second.clear();
+        for (SsaBody::ValueId arg : value.args)
+            key.second.push_back(ssa_.resolve(arg));
+        return true;
+    }
+
+    // Instructions [unit_begin_[i], i] compute one value and nothing else: a
+    // load or a literal, a register op, or a stack op or z.len over such
+    // units, all in one block.
+    void find_units() {
+        auto pushing = [&](size_t end) { return end != SIZE_MAX && unit_begin_[end] != SIZE_MAX && pushes(end); };
+        for (size_t i = 0; i < code_.size(); ++i) {
+            const Instruction& instr = code_[i];
+            size_t begin = SIZE_MAX;
+            if (instr.op == OpCode::LOAD_LOCAL || instr.op == OpCode::PUSH_CONST ||
+                instr.op == OpCode::PUSH_CONST_POOL || (is_register_op(instr.op) && !is_move(instr.op))) {
+                begin = i;
+            } else if (is_pure_op(instr.op) && i >= 2 && pushing(i - 1) && unit_begin_[i - 1] > 0 &&
+                       pushing(unit_begin_[i - 1] - 1)) {
+                begin = unit_begin_[unit_begin_[i - 1] - 1];
+            } else if (is_len_call(instr) && i >= 1 && pushing(i - 1)) {
+                begin = unit_begin_[i - 1];
+            }
+            if (begin == SIZE_MAX)
+                continue;
+            bool joined = false;
+            for (size_t j = begin + 1; j <= i && !joined; ++j)
+                joined = ssa_.blocks()[ssa_.block_of(j)].begin == j;
+            if (!joined)
+                unit_begin_[i] = begin;
+        }
+    }
+
+    // A register op writing a slot leaves nothing on the stack.
+    bool pushes(size_t i) const {
+        if (!is_register_op(code_[i].op))
+            return true;
+        return RegisterOperands::unpack(std::get<int64_t>(code_[i].operand)).push;
+    }
+
+    // Natural loops headed by a LOOP_START: the blocks that reach a back
+    // edge to it without passing through it.
+    void find_loops() {
+        const auto& blocks = ssa_.blocks();
+        for (size_t h : ssa_.order()) {
+            if (code_[blocks[h].begin].op != OpCode::LOOP_START)
+                continue;
+            Loop loop;
+            loop.header = h;
+            loop.start = blocks[h].begin;
+            loop.blocks.assign(blocks.size(), false);
+            loop.blocks[h] = true;
+            std::vector<size_t> pending;
+            bool back_edge = false;
+            for (size_t pred : blocks[h].predecessors) {
+                if (!ssa_.dominates(h, pred))
+                    continue;
+                back_edge = true;
+                if (!loop.blocks[pred]) {
+                    loop.blocks[pred] = true;
+                    pending.push_back(pred);
+                }
+            }
+            if (!back_edge)
+                continue;
+            while (!pending.empty()) {
+                size_t b = pending.back();
+                pending.pop_back();
+                for (size_t pred : blocks[b].predecessors) {
+                    if (!loop.blocks[pred]) {
+                        loop.blocks[pred] = true;
+                        pending.push_back(pred);
+                    }
+                }
+            }
+            loops_.push_back(std::move(loop));
+        }
+        loop_at_.assign(code_.size(), SIZE_MAX);
+        for (size_t k = 0; k < loops_.size(); ++k)
+            loop_at_[loops_[k].start] = k;
+    }
+
+    // Whether a loop may change a list or map, or run code that could.
+    bool may_change_containers(const Loop& loop) const {
+        for (size_t b = 0; b < loop.blocks.size(); ++b) {
+            if (!loop.blocks[b])
+                continue;
+            const SsaBody::Block& block = ssa_.blocks()[b];
+            for (size_t i = block.begin; i < block.end; ++i) {
+                switch (code_[i].op) {
+                case OpCode::CALL:
+                case OpCode::TAIL_CALL:
+                case OpCode::NEW:
+                case OpCode::FOR_ITER: // a stream's stages run lambdas
+                case OpCode::STORE_INDEX:
+                case OpCode::STORE_FIELD:
+                case OpCode::APPEND_LOCAL:
+                case OpCode::APPEND_VAR:
+                    return true;
+                case OpCode::CALL_BUILTIN:
+                    if (!leaves_containers(BuiltinCall::unpack(std::get<int64_t>(code_[i].operand)).id))
+                        return true;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    uint16_t new_temp() {
+        size_t slot = method_.local_names.size();
+        if (slot >= UINT16_MAX)
+            return UINT16_MAX;
+        method_.local_names.push_back("$t" + std::to_string(temps_++));
+        return static_cast<uint16_t>(slot);
+    }
+
+    // A slot that holds `value` in front of the loop: a slot the loop leaves
+    // alone, or a temporary already computed there.
+    bool holder(const Loop& loop, SsaBody::ValueId value, uint16_t preferred, uint16_t& slot) const {
+        value = ssa_.resolve(value);
+        size_t block = ssa_.value(value).block;
+        if (block != SsaBody::NO_BLOCK && loop.blocks[block])
+            return false;
+        const std::vector<SsaBody::ValueId>& entry = ssa_.entry_slots(loop.header);
+        if (preferred < entry.size() && ssa_.resolve(entry[preferred]) == value) {
+            slot = preferred;
+            return true;
+        }
+        for (size_t s = 0; s < entry.size(); ++s) {
+            if (ssa_.resolve(entry[s]) == value) {
+                slot = static_cast<uint16_t>(s);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Copies unit [begin, i] for the front of the loop, reading each slot
+    // from a holder there. Fails when some operand is computed in the loop.
+    bool copy_unit(const Loop& loop, size_t begin, size_t i, std::vector<Instruction>& copy) const {
+        for (size_t j = begin; j <= i; ++j) {
+            for (const Instruction& instr : out_[j]) {
+                Instruction moved = instr;
+                auto* operand = std::get_if<int64_t>(&moved.operand);
+                if (instr.op == OpCode::LOAD_LOCAL && *operand >= static_cast<int64_t>(ssa_.slot_count())) {
+                    // A temporary computed earlier in this front.
+                } else if (instr.op == OpCode::LOAD_LOCAL) {
+                    uint16_t slot;
+                    if (!holder(loop, ssa_.defined_by(j), static_cast<uint16_t>(*operand), slot))
+                        return false;
+                    *operand = slot;
+                } else if (is_register_op(instr.op)) {
+                    RegisterOperands regs = RegisterOperands::unpack(*operand);
+                    const SsaBody::ValueId* slots = ssa_.slots_before(j);
+                    if (!regs.lhs_const && !holder(loop, slots[regs.lhs], regs.lhs, regs.lhs))
+                        return false;
+                    if (!regs.rhs_const && !holder(loop, slots[regs.rhs], regs.rhs, regs.rhs))
+                        return false;
+                    *operand = regs.pack();
+                } else if (instr.op != OpCode::PUSH_CONST && instr.op != OpCode::PUSH_CONST_POOL &&
+                           !is_pure_op(instr.op) && !is_len_call(instr)) {
+                    return false;
+                }
+                copy.push_back(std::move(moved));
+            }
+        }
+        return true;
+    }
+
+    // Unit [begin, i] now reads `slot` instead of computing its value.
+    void replace_unit(size_t begin, size_t i, uint16_t slot) {
+        int line = 0;
+        for (size_t j = begin; j <= i && line == 0; ++j)
+            line = code_[j].line;
+        for (size_t j = begin; j < i; ++j) {
+            out_[j].clear();
+            touched_[j] = true;
+        }
+        const Instruction& instr = code_[i];
+        RegisterOperands regs;
+        if (is_register_op(instr.op))
+            regs = RegisterOperands::unpack(std::get<int64_t>(instr.operand));
+        if (is_register_op(instr.op) && !regs.push) {
+            RegisterOperands move;
+            move.dst = regs.dst;
+            move.lhs = slot;
+            out_[i] = {Instruction(OpCode::MOVE_R, Operand(move.pack()), line)};
+        } else {
+            out_[i] = {Instruction(OpCode::LOAD_LOCAL, Operand(static_cast<int64_t>(slot)), line)};
+        }
+        touched_[i] = true;
+        changed_ = true;
+    }
+
+    bool reads_length(size_t begin, size_t i) const {
+        for (size_t j = begin; j <= i; ++j) {
+            if (is_len_call(code_[j]))
+                return true;
+        }
+        return false;
+    }
+
+    bool untouched(size_t begin, size_t i) const {
+        for (size_t j = begin; j <= i; ++j) {
+            if (touched_[j])
+                return false;
+        }
+        return true;
+    }
+
+    // Whether `test` starts from an empty stack and leaves just the
+    // condition, so a copy of it can run in front of the loop.
+    static bool computes_test(const std::vector<Instruction>& test) {
+        size_t depth = 0;
+        for (const Instruction& instr : test) {
+            size_t pops = 0;
+            size_t pushes = 1;
+            if (instr.op == OpCode::POP) {
+                pops = 1;
+                pushes = 0;
+            } else if (instr.op == OpCode::DUP || instr.op == OpCode::NOT || instr.op == OpCode::LOAD_FIELD ||
+                       is_len_call(instr)) {
+                pops = 1;
+                pushes = instr.op == OpCode::DUP ? 2 : 1;
+            } else if (instr.op == OpCode::LOAD_INDEX || is_stack_binary(instr.op)) {
+                pops = 2;
+            }
+            if (depth < pops)
+                return false;
+            depth = depth - pops + pushes;
+        }
+        return depth == 1;
+    }
+
+    // Moves units out of `loop` that compute the same value on every
+    // iteration. They run in front of LOOP_START, so only once the loop is
+    // entered, and no earlier than they did: in the loop test, after
+    // nothing that can raise; or at the start of the body, after a copy of
+    // the test that exits just as the loop would.
+    void hoist(Loop& loop) {
+        const SsaBody::Block& header = ssa_.blocks()[loop.header];
+        bool containers_change = may_change_containers(loop);
+        std::vector<Instruction> front;
+        hoist_block(loop, header.begin + 1, header.end, containers_change, front);
+
+        // The body entry, guarded by the test.
+        size_t exit = SIZE_MAX;
+        const Instruction& branch = code_[header.end - 1];
+        auto* target = std::get_if<int64_t>(&branch.operand);
+        bool guarded = (branch.op == OpCode::JUMP_IF_FALSE || branch.op == OpCode::JUMP_IF_TRUE) && target &&
+                       static_cast<size_t>(*target) <= code_.size() &&
+                       (static_cast<size_t>(*target) == code_.size() || !in_loop(loop, *target)) &&
+                       header.end < code_.size() && in_loop(loop, header.end) &&
+                       ssa_.blocks()[ssa_.block_of(header.end)].predecessors.size() == 1;
+        std::vector<Instruction> test;
+        for (size_t i = header.begin + 1; guarded && i + 1 < header.end; ++i) {
+            for (const Instruction& instr : out_[i]) {
+                if (!is_stack_only(instr))
+                    guarded = false;
+                test.push_back(instr);
+            }
+        }
+        if (guarded && computes_test(test)) {
+            exit = static_cast<size_t>(*target);
+            std::vector<Instruction> body_front;
+            const SsaBody::Block& body = ssa_.blocks()[ssa_.block_of(header.end)];
+            hoist_block(loop, body.begin, body.end, containers_change, body_front);
+            if (!body_front.empty()) {
+                front.insert(front.end(), test.begin(), test.end());
+                front.emplace_back(branch.op, Operand(static_cast<int64_t>(exit)), branch.line);
+                front.insert(front.end(), body_front.begin(), body_front.end());
+            }
+        }
+
+        // Later units in the loop recomputing a hoisted value read it too.
+        if (!loop.temps.empty()) {
+            for (size_t b = 0; b < loop.blocks.size(); ++b) {
+                if (!loop.blocks[b])
+                    continue;
+                const SsaBody::Block& block = ssa_.blocks()[b];
+                for (size_t i = block.begin; i < block.end; ++i) {
+                    Key key;
+                    if (unit_begin_[i] == SIZE_MAX || !untouched(unit_begin_[i], i) || !pure_key(i, key))
+                        continue;
+                    auto it = loop.temps.find(key);
+                    if (it == loop.temps.end())
+                        continue;
+                    size_t from = it->second.second;
+                    size_t from_block = ssa_.block_of(from);
+                    if (from_block == b ? from < i : ssa_.dominates(from_block, b))
+                        replace_unit(unit_begin_[i], i, it->second.first);
+                }
+            }
+        }
+        before_[loop.start] = std::move(front);
+    }
+
+    void hoist_block(Loop& loop, size_t begin, size_t end, bool containers_change, std::vector<Instruction>& front) {
+        std::vector<bool> safe(end - begin + 1, false); // safe[j - begin]: nothing before j can raise
+        safe[0] = true;
+        for (size_t i = begin; i < end; ++i) {
+            size_t unit = unit_begin_[i];
+            Key key;
+            bool hoisted = false;
+            if (unit != SIZE_MAX && unit >= begin && safe[unit - begin] && !touched_[i] && pure_key(i, key) &&
+                !(containers_change && reads_length(unit, i))) {
+                auto known = loop.temps.find(key);
+                std::vector<Instruction> copy;
+                if (known != loop.temps.end()) {
+                    replace_unit(unit, i, known->second.first);
+                    hoisted = true;
+                } else if (copy_unit(loop, unit, i, copy)) {
+                    uint16_t temp = new_temp();
+                    if (temp != UINT16_MAX) {
+                        Instruction& last = copy.back();
+                        if (is_register_op(last.op)) {
+                            RegisterOperands regs = RegisterOperands::unpack(std::get<int64_t>(last.operand));
+                            regs.push = false;
+                            regs.dst = temp;
+                            last.operand = regs.pack();
+                        } else {
+                            copy.emplace_back(OpCode::STORE_LOCAL, Operand(static_cast<int64_t>(temp)));
+                            copy.emplace_back(OpCode::POP);
+                        }
+                        front.insert(front.end(), copy.begin(), copy.end());
+                        loop.temps[key] = {temp, i};
+                        replace_unit(unit, i, temp);
+                        hoisted = true;
+                    }
+                }
+            }
+            if (hoisted)
+                safe[i + 1 - begin] = safe[unit - begin];
+            else
+                safe[i + 1 - begin] = safe[i - begin] && is_quiet(code_[i]);
+        }
+    }
+
+    // A unit recomputing a pure value that some slot still holds reads the
+    // slot. z.len is left alone: the list may have changed since.
+    void reuse_slot(size_t i) {
+        size_t unit = unit_begin_[i];
+        Key key;
+        if (unit == SIZE_MAX || !untouched(unit, i) || !pure_key(i, key) || key.first == OpCode::CALL_BUILTIN)
+            return;
+        const SsaBody::ValueId* slots = ssa_.slots_before(unit);
+        for (size_t s = 0; s < ssa_.slot_count(); ++s) {
+            SsaBody::ValueId held = ssa_.resolve(slots[s]);
+            if (held == SsaBody::NONE || held == ssa_.resolve(ssa_.defined_by(i)))
+                continue;
+            const SsaBody::Value& value = ssa_.value(held);
+            if (value.kind != SsaBody::Kind::Pure || value.instr == SIZE_MAX)
+                continue;
+            Key other;
+            if (pure_key(value.instr, other) && other == key) {
+                replace_unit(unit, i, static_cast<uint16_t>(s));
+                return;
+            }
+        }
+    }
+
+    CompiledMethod& method_;
+    const std::vector<Instruction>& code_;
+    const SsaBody& ssa_;
+    std::vector<std::vector<Instruction>> out_;
+    std::vector<std::vector<Instruction>> before_; // loop fronts, by LOOP_START
+    std::vector<bool> touched_;
+    std::vector<size_t> unit_begin_;
+    std::vector<Loop> loops_;
+    std::vector<size_t> loop_at_;
+    size_t temps_ = 0;
+    bool changed_ = false;
+};
+
+std::vector<Instruction> SsaOptimizer::lower() {
+    size_t size = code_.size();
+    std::vector<Instruction> result;
+    std::vector<size_t> front_at(size + 1), own_at(size + 1);
+    struct Origin {
+        size_t instr;
+        bool front; // part of the loop front placed before instr
+    };
+    std::vector<Origin> origin;
+    for (size_t i = 0; i < size; ++i) {
+        front_at[i] = result.size();
+        for (Instruction& instr : before_[i]) {
+            result.push_back(std::move(instr));
+            origin.push_back({i, true});
+        }
+        own_at[i] = result.size();
+        for (Instruction& instr : out_[i]) {
+            result.push_back(std::move(instr));
+            origin.push_back({i, false});
+        }
+    }
+    front_at[size] = own_at[size] = result.size();
+
+    // Entering a loop runs its front; back edges skip it. The front itself
+    // sits inside every enclosing loop.
+    for (size_t k = 0; k < result.size(); ++k) {
+        Instruction& instr = result[k];
+        auto* target = std::get_if<int64_t>(&instr.operand);
+        if (!is_jump_op(instr.op) || !target || *target < 0 || static_cast<size_t>(*target) > size)
+            continue;
+        size_t to = static_cast<size_t>(*target);
+        if (instr.op == OpCode::LOOP_START) {
+            *target = static_cast<int64_t>(own_at[to]);
+            continue;
+        }
+        if (to == size || loop_at_[to] == SIZE_MAX || before_[to].empty()) {
+            *target = static_cast<int64_t>(own_at[to]);
+            continue;
+        }
+        const Loop& loop = loops_[loop_at_[to]];
+        bool inside = origin[k].front ? (origin[k].instr != to && in_loop(loop, origin[k].instr))
+                                      : in_loop(loop, origin[k].instr);
+        *target = static_cast<int64_t>(inside ? own_at[to] : front_at[to]);
+    }
+    return result;
+}
+
+// Folds `LOAD_LOCAL a; LOAD_LOCAL b; op` into the register form of op, so
+// a read of a hoisted temporary costs no more than the operand it replaced.
+void fuse_loads(std::vector<Instruction>& code) {
+    ControlFlowGraph cfg(code);
+    std::vector<bool> drop(code.size(), false);
+    bool fused = false;
+    for (size_t i = 2; i < code.size(); ++i) {
+        OpCode form = register_form(code[i].op);
+        if (form == OpCode::NOP || code[i - 1].op != OpCode::LOAD_LOCAL || code[i - 2].op != OpCode::LOAD_LOCAL ||
+            drop[i - 2] || cfg.is_leader(i - 1) || cfg.is_leader(i))
+            continue;
+        RegisterOperands regs;
+        regs.lhs = static_cast<uint16_t>(std::get<int64_t>(code[i - 2].operand));
+        regs.rhs = static_cast<uint16_t>(std::get<int64_t>(code[i - 1].operand));
+        regs.push = true;
+        int line = code[i - 2].line ? code[i - 2].line : (code[i - 1].line ? code[i - 1].line : code[i].line);
+        code[i] = Instruction(form, Operand(regs.pack()), line);
+        code[i - 2].line = 0;
+        code[i - 1].line = 0;
+        drop[i - 2] = drop[i - 1] = true;
+        fused = true;
+    }
+    if (fused)
+        drop_instructions(code, drop);
+}
+
+} // namespace
+
+void optimize_ssa(CompiledMethod& method) {
+    SsaBody ssa;
+    if (!ssa.build(method.bytecode, method.local_names.size()))
+        return;
+    SsaOptimizer optimizer(method, ssa);
+    optimizer.hoist_invariants();
+    optimizer.reuse_slots();
+    if (!optimizer.changed())
+        return;
+    method.bytecode = optimizer.lower();
+    fuse_loads(method.bytecode);
+}
+
+} // namespace alphabet
@@ -13,57 +13,58 @@
 namespace alphabet {
 
 std::string value_to_string(const Value& value) {
-    return std::visit(
-        [](const auto& v) -> std::string {
-            using T = std::decay_t<decltype(v)>;
-            if constexpr (std::is_same_v<T, std::monostate>) {
-                return "null";
-            } else if constexpr (std::is_same_v<T, bool>) {
-                return v ? "true" : "false";
-            } else if constexpr (std::is_same_v<T, int64_t>) {
-                return std::to_string(v);
-            } else if constexpr (std::is_same_v<T, double>) {
-                std::ostringstream oss;
-                if (v == std::floor(v)) {
-                    oss << static_cast<int64_t>(v);
-                } else {
-                    oss << v;
-                }
-                return oss.str();
-            } else if constexpr (std::is_same_v<T, std::string>) {
-                return v;
-            } else if constexpr (std::is_same_v<T, std::shared_ptr<Value::List>>) {
-                if (!v)
-                    return "[]";
-                std::ostringstream oss;
-                oss << "[";
-                for (size_t i = 0; i < v->size(); ++i) {
-                    if (i > 0)
-                        oss << ", ";
-                    oss << value_to_string((*v)[i]);
-                }
-                oss << "]";
-                return oss.str();
-            } else if constexpr (std::is_same_v<T, std::shared_ptr<Value::Map>>) {
-                if (!v)
-                    return "{}";
-                std::ostringstream oss;
-                oss << "{";
-                bool first = true;
-                for (const auto& [k, val] : *v) {
-                    if (!first)
-                        oss << ", ";
-                    oss << k << ": " << value_to_string(val);
-                    first = false;
-                }
-                oss << "}";
-                return oss.str();
-            } else if constexpr (std::is_same_v<T, ObjectPtr>) {
-                return v ? "Object#" + std::to_string(v->class_id) : "null";
-            }
-            return "unknown";
-        },
-        value.data);
+    switch (value.kind()) {
+    case Value::Kind::Null:
+        return "null";
+    case Value::Kind::Bool:
+        return value.as_bool() ? "true" : "false";
+    case Value::Kind::Integer:
+        return std::to_string(value.as_integer());
+    case Value::Kind::Number: {
+        double v = value.as_number();
+        std::ostringstream oss;
+        // Integral doubles print without a fraction, as far as int64_t reaches
+        // (integer overflow falls back to doubles just past it).
+        if (v == std::floor(v) && std::fabs(v) < 9223372036854775808.0) {
+            oss << static_cast<int64_t>(v);
+        } else {
+            oss << v;
+        }
+        return oss.str();
+    }
+    case Value::Kind::String:
+        return value.as_string();
+    case Value::Kind::List: {
+        const auto& list = value.as_list();
+        std::ostringstream oss;
+        oss << "[";
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (i > 0)
+                oss << ", ";
+            oss << value_to_string(list[i]);
+        }
+        oss << "]";
+        return oss.str();
+    }
+    case Value::Kind::Map: {
+        std::ostringstream oss;
+        oss << "{";
+        bool first = true;
+        for (const auto& [k, val] : value.as_map()) {
+            if (!first)
+                oss << ", ";
+            oss << k << ": " << value_to_string(val);
+            first = false;
+        }
+        oss << "}";
+        return oss.str();
+    }
+    case Value::Kind::Object:
+        return "Object#" + std::to_string(value.as_object()->class_id);
+    case Value::Kind::Iterator:
+        return "<iterator>";
+    }
+    return "unknown";
 }
 
 static std::string value_type_name(const Value& value) {
@@ -71,8 +72,7 @@ static std::string value_type_name(const Value& value) {
         return "null";
     if (value.is_bool())
         return "bool";
-    if (value.is_integer())
-        return "integer";
+    // Integers are a representation of numbers, not a separate type.
     if (value.is_number())
         return "number";
     if (value.is_string())
@@ -83,9 +83,311 @@ static std::string value_type_name(const Value& value) {
         return "map";
     if (value.is_object())
         return "object";
+    if (value.is_iterator())
+        return "iterator";
     return "unknown";
 }
 
+IteratorPtr IteratorCell::over(IterSource source, const Value& value) {
+    if (source == IterSource::Value && value.is_iterator())
+        return IteratorPtr(value.as_iterator());
+    IteratorPtr it = make_ref<IteratorCell>();
+    if (source == IterSource::Keys || source == IterSource::Values) {
+        if (value.is_map()) {
+            it->source = source == IterSource::Keys ? Source::Keys : Source::Values;
+            it->items = value;
+        }
+    } else if (value.is_list()) {
+        it->source = Source::List;
+        it->items = value;
+    } else if (value.is_map()) {
+        it->source = Source::Keys;
+        it->items = value;
+    } else if (value.is_string()) {
+        it->source = Source::String;
+        it->items = value;
+    }
+    return it;
+}
+
+// The numbers z.range(start, stop, step) would list, integers when all
+// three are.
+IteratorPtr IteratorCell::range(double start, double stop, double step) {
+    IteratorPtr it = make_ref<IteratorCell>();
+    it->source = Source::Range;
+    it->next = start;
+    it->stop = stop;
+    it->step = step == 0 ? 1 : step;
+    auto whole = [](double v) { return v == std::floor(v) && std::fabs(v) < 9007199254740992.0; };
+    it->integral = whole(start) && whole(stop) && whole(it->step);
+    return it;
+}
+
+bool IteratorCell::advance(Value& out) {
+    switch (source) {
+    case Source::Empty:
+        return false;
+    case Source::Range: {
+        if (step > 0 ? next >= stop : next <= stop)
+            return false;
+        out = integral ? Value(static_cast<int64_t>(next)) : Value(next);
+        next += step;
+        return true;
+    }
+    case Source::List: {
+        const Value::List& list = items.as_list();
+        if (pos >= list.size())
+            return false;
+        out = list[pos++];
+        return true;
+    }
+    case Source::Keys:
+    case Source::Values: {
+        const Value::Map& map = items.as_map();
+        auto entry = map.begin();
+        if (started) {
+            entry = map.find(key);
+            if (entry != map.end())
+                ++entry;
+        }
+        if (entry == map.end()) {
+            source = Source::Empty;
+            return false;
+        }
+        key = entry->first;
+        started = true;
+        out = source == Source::Keys ? Value(entry->first) : entry->second;
+        return true;
+    }
+    case Source::String: {
+        const std::string& str = items.as_string();
+        if (pos >= str.size())
+            return false;
+        // One code point: a lead byte and its continuation bytes.
+        size_t end = pos + 1;
+        while (end < str.size() && (static_cast<unsigned char>(str[end]) & 0xC0) == 0x80)
+            ++end;
+        out = Value(str.substr(pos, end - pos));
+        pos = end;
+        return true;
+    }
+    case Source::Lines: {
+        std::string line;
+        if (!std::getline(*file, line)) {
+            file.reset();
+            source = Source::Empty;
+            return false;
+        }
+        out = Value(std::move(line));
+        return true;
+    }
+    }
+    return false;
+}
+
+namespace {
+std::mutex& shape_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+} // namespace
+
+const Shape* Shape::root(uint16_t class_id) {
+    // Intentionally never freed: objects may outlive any one VM.
+    static auto* roots = new std::unordered_map<uint16_t, std::unique_ptr<Shape>>();
+    std::lock_guard<std::mutex> lock(shape_mutex());
+    auto& shape = (*roots)[class_id];
+    if (!shape)
+        shape.reset(new Shape(class_id));
+    return shape.get();
+}
+
+const Shape* Shape::with_field(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(shape_mutex());
+    auto& next = transitions_[name];
+    if (!next) {
+        next.reset(new Shape(class_id_));
+        next->names_ = names_;
+        next->names_.push_back(name);
+        next->slots_ = slots_;
+        next->slots_[name] = static_cast<uint32_t>(names_.size());
+    }
+    return next.get();
+}
+
+void AlphabetObject::set_field(const std::string& name, Value value) {
+    int slot = shape->find(name);
+    if (slot >= 0) {
+        slots[slot] = std::move(value);
+        return;
+    }
+    shape = shape->with_field(name);
+    slots.push_back(std::move(value));
+}
+
+// Pool constants load like PUSH_CONST operands.
+static Value constant_value(const Operand& operand) {
+    if (auto* d = std::get_if<double>(&operand)) {
+        return Value(*d);
+    } else if (auto* s = std::get_if<std::string>(&operand)) {
+        return Value(*s);
+    } else if (auto* i = std::get_if<int64_t>(&operand)) {
+        return Value(*i);
+    }
+    return Value(nullptr);
+}
+
+// Shared by the stack and register forms of the binary operators.
+static Value binary_op(OpCode op, const Value& a, const Value& b) {
+    switch (op) {
+    case OpCode::ADD: {
+        int64_t r;
+        if (a.is_integer() && b.is_integer() && checked_add(a.as_integer(), b.as_integer(), r)) {
+            return Value(r);
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() + b.as_number());
+        } else if (a.is_string() && b.is_string()) {
+            return Value(a.as_string() + b.as_string());
+        } else if (a.is_string() && (b.is_number() || b.is_bool())) {
+            return Value(a.as_string() + value_to_string(b));
+        } else if ((a.is_number() || a.is_bool()) && b.is_string()) {
+            return Value(value_to_string(a) + b.as_string());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot add " + value_type_name(a) + " and " + value_type_name(b));
+        }
+    }
+
+    case OpCode::SUB: {
+        int64_t r;
+        if (a.is_integer() && b.is_integer() && checked_sub(a.as_integer(), b.as_integer(), r)) {
+            return Value(r);
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() - b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot subtract " + value_type_name(b) + " from " + value_type_name(a) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::MUL: {
+        int64_t r;
+        if (a.is_integer() && b.is_integer() && checked_mul(a.as_integer(), b.as_integer(), r)) {
+            return Value(r);
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() * b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot multiply " + value_type_name(a) + " and " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::DIV: {
+        if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            if (b.as_number() != 0) {
+                return Value(a.as_number() / b.as_number());
+            } else {
+                throw RuntimeError("Division by zero");
+            }
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot divide " + value_type_name(a) + " by " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::PERCENT: {
+        // C++ % truncates like fmod; x % -1 is 0 but INT64_MIN % -1 traps.
+        if (a.is_integer() && b.is_integer() && b.as_integer() != 0) {
+            return Value(b.as_integer() == -1 ? int64_t(0) : a.as_integer() % b.as_integer());
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(std::fmod(a.as_number(), b.as_number()));
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot modulo " + value_type_name(a) + " by " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::EQ: {
+        return Value(a == b);
+    }
+
+    case OpCode::GT: {
+        if (a.is_integer() && b.is_integer()) {
+            return Value(a.as_integer() > b.as_integer());
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() > b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " > " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::LT: {
+        if (a.is_integer() && b.is_integer()) {
+            return Value(a.as_integer() < b.as_integer());
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() < b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " < " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::NE: {
+        return Value(a != b);
+    }
+
+    case OpCode::GE: {
+        if (a.is_integer() && b.is_integer()) {
+            return Value(a.as_integer() >= b.as_integer());
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() >= b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " >= " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    case OpCode::LE: {
+        if (a.is_integer() && b.is_integer()) {
+            return Value(a.as_integer() <= b.as_integer());
+        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
+            return Value(a.as_number() <= b.as_number());
+        } else if (a.is_null() || b.is_null()) {
+            return Value(nullptr);
+        } else {
+            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " <= " + value_type_name(b) +
+                               " (both must be numbers)");
+        }
+    }
+
+    default:
+        break;
+    }
+    return Value(nullptr);
+}
+
+bool VM::jit_default_ = JitCode::available();
+
+void VM::set_jit_default(bool enabled) {
+    jit_default_ = enabled && JitCode::available();
+}
+
 VM::VM() : stack_(std::make_unique<Value[]>(STACK_MAX)), stack_ptr_(stack_.get()) {}
 
 VM::~VM() {
@@ -107,40 +409,114 @@ void VM::ffi_close_all() {
     ffi_library_cache_.clear();
 }
 
-Value VM::call_lambda(const std::string& lambda_name, const std::vector<Value>& args) {
-    auto it = global_functions_.find(lambda_name);
-    if (it == global_functions_.end()) {
-        throw RuntimeError("Lambda not found: " + lambda_name);
+void VM::builtin_dyn(int arg_count) {
+    if (arg_count < 2)
+        return;
+    std::vector<Value> args(static_cast<size_t>(arg_count));
+    for (int i = arg_count - 1; i >= 0; --i) {
+        args[i] = pop();
     }
 
-    const auto& func = it->second;
-    size_t saved_stack = stack_ptr_ - stack_.get();
-    size_t saved_frames = frames_.size();
-
-    for (const auto& arg : args) {
-        push(arg);
+    if (sandbox_mode_) {
+        throw RuntimeError("FFI: z.dyn blocked in sandbox mode");
     }
-
-    CallFrame frame(&func.bytecode);
-    frame.locals["this"] = Value(nullptr);
-    for (size_t i = 0; i < func.param_names.size() && i < args.size(); ++i) {
-        frame.locals[func.param_names[i]] = args[i];
+    if (!args[0].is_string() || !args[1].is_string()) {
+        throw RuntimeError("z.dyn requires string library path and function name");
     }
+    std::string lib_path = args[0].as_string();
+    std::string func_name_str = args[1].as_string();
 
-    for (const auto& [name, val] : globals_) {
-        if (frame.locals.find(name) == frame.locals.end()) {
-            frame.locals[name] = val;
+    void* handle = nullptr;
+    auto cache_it = ffi_library_cache_.find(lib_path);
+    if (cache_it != ffi_library_cache_.end()) {
+        handle = cache_it->second;
+    } else {
+#ifdef _WIN32
+        handle = reinterpret_cast<void*>(LoadLibraryA(lib_path.c_str()));
+#else
+        handle = dlopen(lib_path.c_str(), RTLD_NOW);
+#endif
+        if (!handle) {
+            std::string err_msg = "FFI: Cannot load library " + lib_path;
+#ifndef _WIN32
+            err_msg += ": ";
+            err_msg += dlerror();
+#endif
+            throw RuntimeError(err_msg);
         }
+        ffi_library_cache_[lib_path] = handle;
+    }
+
+#ifdef _WIN32
+    FARPROC raw_func = GetProcAddress(reinterpret_cast<HMODULE>(handle), func_name_str.c_str());
+#else
+    void* raw_func = dlsym(handle, func_name_str.c_str());
+#endif
+    if (!raw_func) {
+        throw RuntimeError("FFI: Function '" + func_name_str + "' not found in library " +
+                           lib_path);
+    }
+
+    int ffi_arg_count = static_cast<int>(args.size()) - 2;
+    int64_t result = 0;
+    if (ffi_arg_count == 0) {
+        typedef int64_t (*Func0)();
+        result = reinterpret_cast<Func0>(raw_func)();
+    } else if (ffi_arg_count == 1) {
+        typedef int64_t (*Func1)(int64_t);
+        int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
+        result = reinterpret_cast<Func1>(raw_func)(a0);
+    } else if (ffi_arg_count == 2) {
+        typedef int64_t (*Func2)(int64_t, int64_t);
+        int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
+        int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
+        result = reinterpret_cast<Func2>(raw_func)(a0, a1);
+    } else if (ffi_arg_count == 3) {
+        typedef int64_t (*Func3)(int64_t, int64_t, int64_t);
+        int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
+        int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
+        int64_t a2 = args[4].is_number() ? static_cast<int64_t>(args[4].as_number()) : 0;
+        result = reinterpret_cast<Func3>(raw_func)(a0, a1, a2);
+    } else if (ffi_arg_count == 4) {
+        typedef int64_t (*Func4)(int64_t, int64_t, int64_t, int64_t);
+        int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
+        int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
+        int64_t a2 = args[4].is_number() ? static_cast<int64_t>(args[4].as_number()) : 0;
+        int64_t a3 = args[5].is_number() ? static_cast<int64_t>(args[5].as_number()) : 0;
+        result = reinterpret_cast<Func4>(raw_func)(a0, a1, a2, a3);
+    } else {
+        throw RuntimeError("FFI: z.dyn supports up to 4 arguments");
+    }
+
+    push(Value(static_cast<double>(result)));
+}
+
+const CompiledMethod& VM::find_lambda(const std::string& lambda_name) {
+    auto it = global_functions_.find(lambda_name);
+    if (it == global_functions_.end()) {
+        throw RuntimeError("Lambda not found: " + lambda_name);
     }
+    return it->second;
+}
+
+// Runs `fn` to its return, moving the arguments out of args[0..arg_count).
+// Successive calls reuse the same frame and local slots.
+Value VM::call_lambda(const CompiledMethod& fn, Value* args, size_t arg_count) {
+    size_t saved_stack = stack_ptr_ - stack_.get();
+    size_t saved_frames = frames_.size();
 
-    frames_.push_back(frame);
+    push_frame(fn, args, arg_count);
 
     while (!frames_.empty() && frames_.size() > saved_frames) {
         auto& current_frame = frames_.back();
         if (current_frame.ip >= current_frame.bytecode->size()) {
             break;
         }
-        execute_instruction(current_frame);
+        if (debug_mode_ || trace_callback_) {
+            execute_instruction(current_frame);
+        } else {
+            dispatch(saved_frames);
+        }
     }
 
     Value result(nullptr);
@@ -152,6 +528,77 @@ Value VM::call_lambda(const std::string& lambda_name, const std::vector<Value>&
     return result;
 }
 
+static bool is_truthy(const Value& v) {
+    return !v.is_null() && !(v.is_number() && v.as_number() == 0) && !(v.is_integer() && v.as_integer() == 0) &&
+           !(v.is_bool() && !v.as_bool()) && !(v.is_string() && v.as_string().empty());
+}
+
+// Pulls the next element of `it` through its stream stages, so a chain of
+// map and filter calls runs in one pass without intermediate lists.
+bool VM::next_item(IteratorCell& it, Value& out) {
+    while (it.advance(out)) {
+        bool kept = true;
+        // By index: a stage's lambda may add stages to this stream.
+        for (size_t k = 0; k < it.stages.size(); ++k) {
+            IteratorCell::Stage stage = it.stages[k];
+            Value arg = out;
+            Value result = call_lambda(*stage.fn, &arg, 1);
+            if (!stage.filter) {
+                out = std::move(result);
+            } else if (!is_truthy(result)) {
+                kept = false;
+                break;
+            }
+        }
+        if (kept)
+            return true;
+    }
+    out = Value();
+    return false;
+}
+
+// Methods of a stream, an iterator made by z.stream. `map` and `filter` add
+// a stage and return the same stream; `reduce(fn, init)` and `list()`
+// drain it. The receiver is at args[-1].
+void VM::stream_call(const std::string& method_name, Value* args, size_t arg_count) {
+    Value stream = args[-1];
+    IteratorCell& it = *stream.as_iterator();
+    std::vector<Value> params(std::make_move_iterator(args), std::make_move_iterator(args + arg_count));
+    drop_to(args - 1);
+
+    auto lambda_arg = [&]() -> const CompiledMethod& {
+        if (params.empty() || !params[0].is_string()) {
+            throw RuntimeError("Type error: stream " + method_name + " expects a function");
+        }
+        return find_lambda(params[0].as_string());
+    };
+
+    if (method_name == "map" || method_name == "filter") {
+        it.stages.push_back({&lambda_arg(), method_name == "filter"});
+        push(stream);
+    } else if (method_name == "reduce") {
+        const CompiledMethod& fn = lambda_arg();
+        Value acc = params.size() > 1 ? params[1] : Value();
+        Value pair[2];
+        Value item;
+        while (next_item(it, item)) {
+            pair[0] = std::move(acc);
+            pair[1] = std::move(item);
+            acc = call_lambda(fn, pair, 2);
+        }
+        push(acc);
+    } else if (method_name == "list") {
+        std::vector<Value> result;
+        Value item;
+        while (next_item(it, item)) {
+            result.push_back(std::move(item));
+        }
+        push(Value(std::move(result)));
+    } else {
+        push(Value(nullptr));
+    }
+}
+
 Value VM::call_lambda_public(const std::string& lambda_name, const std::vector<Value>& args,
                              const std::unordered_map<std::string, CompiledMethod>& fns) {
     auto it = fns.find(lambda_name);
@@ -163,30 +610,18 @@ Value VM::call_lambda_public(const std::string& lambda_name, const std::vector<V
     size_t saved_stack = stack_ptr_ - stack_.get();
     size_t saved_frames = frames_.size();
 
-    for (const auto& arg : args) {
-        push(arg);
-    }
-
-    CallFrame frame(&func.bytecode);
-    frame.locals["this"] = Value(nullptr);
-    for (size_t i = 0; i < func.param_names.size() && i < args.size(); ++i) {
-        frame.locals[func.param_names[i]] = args[i];
-    }
-
-    for (const auto& [name, val] : globals_) {
-        if (frame.locals.find(name) == frame.locals.end()) {
-            frame.locals[name] = val;
-        }
-    }
-
-    frames_.push_back(frame);
+    push_frame(func, args);
 
     while (!frames_.empty() && frames_.size() > saved_frames) {
         auto& current_frame = frames_.back();
         if (current_frame.ip >= current_frame.bytecode->size()) {
             break;
         }
-        execute_instruction(current_frame);
+        if (debug_mode_ || trace_callback_) {
+            execute_instruction(current_frame);
+        } else {
+            dispatch(saved_frames);
+        }
     }
 
     Value result(nullptr);
@@ -198,29 +633,83 @@ Value VM::call_lambda_public(const std::string& lambda_name, const std::vector<V
     return result;
 }
 
+uint32_t GlobalTable::slot(const std::string& name) {
+    auto [it, added] = slots_.try_emplace(name, static_cast<uint32_t>(names_.size()));
+    if (added) {
+        values_.emplace_back();
+        flags_.push_back(0);
+        names_.push_back(name);
+    }
+    return it->second;
+}
+
+std::unordered_map<std::string, Value> GlobalTable::snapshot() const {
+    std::unordered_map<std::string, Value> result;
+    for (uint32_t i = 0; i < names_.size(); ++i) {
+        if (defined(i))
+            result.emplace(names_[i], values_[i]);
+    }
+    return result;
+}
+
+void GlobalTable::assign(const std::unordered_map<std::string, Value>& values) {
+    for (uint32_t i = 0; i < names_.size(); ++i) {
+        values_[i] = Value();
+        flags_[i] &= ~DEFINED;
+    }
+    for (const auto& [name, value] : values)
+        set(slot(name), value);
+}
+
+// Maps the program's global indices to slots, so LOAD_VAR and STORE_VAR
+// with an index operand never look up a name.
+void VM::bind_globals(const std::vector<std::string>& names) {
+    global_index_slots_.clear();
+    for (const auto& name : names)
+        global_index_slots_.push_back(globals_.slot(name));
+}
+
+// Pool constants are turned into Values once per program; copying one
+// afterwards shares its string.
+void VM::load_constants(const std::vector<Operand>& pool) {
+    constant_pool_ = pool;
+    constants_.clear();
+    constants_.reserve(pool.size());
+    for (const Operand& operand : pool)
+        constants_.push_back(constant_value(operand));
+}
+
+// Static fields live in the global table as "Class.field".
+bool VM::static_slot(const Value& class_val, const std::string& field, uint32_t& slot) {
+    if (!class_val.is_number())
+        return false;
+    auto cls_it = classes_.find(static_cast<uint16_t>(class_val.as_number()));
+    if (cls_it == classes_.end())
+        return false;
+    slot = globals_.slot(cls_it->second.name + "." + field);
+    return true;
+}
+
 VM::VM(const Program& program) : stack_(std::make_unique<Value[]>(STACK_MAX)), stack_ptr_(stack_.get()) {
     init(program);
 }
 
 void VM::init(const Program& program) {
     classes_ = program.classes;
-    globals_by_index_ = program.globals;
+    bind_globals(program.globals);
     global_functions_ = program.functions;
-    constant_pool_ = program.constant_pool;
+    load_constants(program.constant_pool);
     stack_ptr_ = stack_.get();
-
-    class_name_to_id_.clear();
-    for (const auto& [id, cls] : classes_) {
-        class_name_to_id_[cls.name] = id;
-    }
+    reset_dispatch_cache();
+    link_classes();
 
     if (!program.static_init.empty()) {
-        frames_.emplace_back(&program.static_init);
+        frames_.push(&program.static_init);
         run_loop();
     }
 
     if (!program.main.empty()) {
-        frames_.emplace_back(&program.main);
+        frames_.push(&program.main);
     }
 }
 
@@ -230,42 +719,141 @@ void VM::run() {
 
 void VM::run_from(const Program& program, size_t bytecode_offset) {
     classes_ = program.classes;
-    globals_by_index_ = program.globals;
+    bind_globals(program.globals);
     global_functions_ = program.functions;
+    link_classes();
 
-    class_name_to_id_.clear();
-    for (const auto& [id, cls] : classes_) {
-        class_name_to_id_[cls.name] = id;
-    }
-
-    frames_.clear();
+    clear_frames();
+    reset_dispatch_cache();
     if (!program.main.empty() && bytecode_offset < program.main.size()) {
-        CallFrame frame(&program.main);
-        frame.ip = bytecode_offset;
-        frames_.push_back(frame);
+        frames_.push(&program.main).ip = bytecode_offset;
         run_loop();
     }
 }
 
 void VM::run_incremental(const Program& program, size_t bytecode_offset) {
     classes_ = program.classes;
-    globals_by_index_ = program.globals;
+    bind_globals(program.globals);
     global_functions_ = program.functions;
-    constant_pool_ = program.constant_pool;
-
-    class_name_to_id_.clear();
-    for (const auto& [id, cls] : classes_) {
-        class_name_to_id_[cls.name] = id;
-    }
+    load_constants(program.constant_pool);
+    reset_dispatch_cache();
+    link_classes();
 
     if (!program.main.empty() && bytecode_offset < program.main.size()) {
-        CallFrame frame(&program.main);
-        frame.ip = bytecode_offset;
-        frames_.push_back(frame);
+        frames_.push(&program.main).ip = bytecode_offset;
         run_loop();
     }
 }
 
+CallFrame& VM::push_frame(const CompiledMethod& method, const std::vector<Value>& args, Value self) {
+    CallFrame& frame = push_frame(method, nullptr, 0, std::move(self));
+    for (size_t i = 0; i < args.size() && i < method.param_names.size() && i < frame.slot_count; ++i) {
+        locals_[frame.slot_base + i] = args[i];
+    }
+    return frame;
+}
+
+// Binds arguments by moving them out of args[0..arg_count).
+CallFrame& VM::push_frame(const CompiledMethod& method, Value* args, size_t arg_count, Value self) {
+    check_call_depth();
+    size_t count = method.local_names.size();
+    if (locals_top_ + count > LOCALS_MAX) {
+        throw RuntimeError("Stack overflow: too many live locals");
+    }
+    if (locals_top_ + count > locals_.size()) {
+        locals_.resize(std::max(locals_.size() * 2, std::max<size_t>(locals_top_ + count, 256)));
+    }
+
+    CallFrame& frame = frames_.push(&method.bytecode);
+    if (!method.specialized.empty()) {
+        frame.bytecode = &method.specialized;
+        frame.generic = &method.bytecode;
+    }
+    frame.slot_base = locals_top_;
+    frame.slot_count = count;
+    frame.slot_names = &method.local_names;
+    frame.self = std::move(self);
+    for (size_t i = 0; i < arg_count && i < method.param_names.size() && i < count; ++i) {
+        locals_[frame.slot_base + i] = std::move(args[i]);
+    }
+    locals_top_ += count;
+    return frame;
+}
+
+void VM::pop_frame() {
+    CallFrame& frame = frames_.back();
+    // Reset slots so the next frame starts from null and dead values are released.
+    for (size_t i = 0; i < frame.slot_count; ++i) {
+        locals_[frame.slot_base + i] = Value();
+    }
+    locals_top_ -= frame.slot_count;
+    frames_.pop();
+}
+
+// Moves a frame running specialized code onto its generic twin, resuming at
+// `ip` so the instruction whose assumption failed runs again generically.
+void VM::deoptimize(CallFrame& frame, size_t ip) {
+    if (!frame.generic) {
+        throw RuntimeError("Specialized instruction outside specialized code");
+    }
+    frame.bytecode = frame.generic;
+    frame.generic = nullptr;
+    frame.decoded = nullptr;
+    frame.ip = ip;
+}
+
+// The top of the stack is the target's earlier value and `count` pieces.
+// While the target still holds that same string, dropping the stack's copy
+// may leave it the only owner, and then the pieces are appended to its
+// buffer instead of copying the whole string once per `+`.
+void VM::append_to(Value& target, size_t count) {
+    if (static_cast<size_t>(stack_ptr_ - stack_.get()) < count + 1) {
+        throw RuntimeError("Stack underflow");
+    }
+    Value* pieces = stack_ptr_ - count;
+    Value& loaded = pieces[-1];
+    bool appendable = loaded.is_string() && loaded.cell() == target.cell();
+    for (size_t i = 0; i < count && appendable; ++i) {
+        appendable = pieces[i].is_string() || pieces[i].is_number() || pieces[i].is_bool();
+    }
+    std::string* buffer = nullptr;
+    if (appendable) {
+        loaded = Value();
+        buffer = target.sole_string();
+        if (!buffer)
+            loaded = target;
+    }
+    if (buffer) {
+        for (size_t i = 0; i < count; ++i) {
+            if (pieces[i].is_string())
+                buffer->append(pieces[i].as_string());
+            else
+                buffer->append(value_to_string(pieces[i]));
+        }
+    } else {
+        Value result = loaded;
+        for (size_t i = 0; i < count; ++i) {
+            result = binary_op(OpCode::ADD, result, pieces[i]);
+        }
+        target = std::move(result);
+    }
+    for (size_t i = 0; i <= count; ++i) {
+        pop();
+    }
+}
+
+void VM::clear_frames() {
+    while (!frames_.empty()) {
+        pop_frame();
+    }
+}
+
+// Pops down to `top`, releasing whatever is left above it.
+void VM::drop_to(Value* top) {
+    while (stack_ptr_ > top)
+        *--stack_ptr_ = Value();
+}
+
 void VM::push(const Value& value) {
     if (stack_ptr_ - stack_.get() >= static_cast<ptrdiff_t>(STACK_MAX)) {
         throw RuntimeError("Stack overflow");
@@ -277,7 +865,7 @@ Value VM::pop() {
     if (stack_ptr_ == stack_.get()) {
         throw RuntimeError("Stack underflow");
     }
-    return *--stack_ptr_;
+    return std::move(*--stack_ptr_);
 }
 
 Value& VM::peek(size_t distance) {
@@ -295,7 +883,7 @@ void VM::run_loop() {
 
         if (frame.ip >= frame.bytecode->size()) {
             push(Value(nullptr));
-            frames_.pop_back();
+            pop_frame();
             if (frames_.size() < start_frame_count) {
                 break;
             }
@@ -303,7 +891,11 @@ void VM::run_loop() {
         }
 
         try {
-            execute_instruction(frame);
+            if (debug_mode_ || trace_callback_) {
+                execute_instruction(frame);
+            } else {
+                dispatch(0);
+            }
         } catch (const RuntimeError& e) {
             throw_exception(Value(std::string(e.what())));
         }
@@ -334,7 +926,7 @@ void VM::execute_instruction(CallFrame& frame) {
         } else if (auto* s = std::get_if<std::string>(&instr.operand)) {
             push(Value(*s));
         } else if (auto* i = std::get_if<int64_t>(&instr.operand)) {
-            push(Value(static_cast<double>(*i)));
+            push(Value(*i));
         } else if (std::holds_alternative<std::monostate>(instr.operand) ||
                    std::holds_alternative<std::nullptr_t>(instr.operand)) {
             push(Value(nullptr));
@@ -344,19 +936,8 @@ void VM::execute_instruction(CallFrame& frame) {
 
     case OpCode::PUSH_CONST_POOL: {
         auto* idx = std::get_if<int64_t>(&instr.operand);
-        if (idx && static_cast<size_t>(*idx) < constant_pool_.size()) {
-            const Operand& val = constant_pool_[*idx];
-            if (auto* d = std::get_if<double>(&val)) {
-                push(Value(*d));
-            } else if (auto* s = std::get_if<std::string>(&val)) {
-                push(Value(*s));
-            } else if (auto* i = std::get_if<int64_t>(&val)) {
-                push(Value(static_cast<double>(*i)));
-            } else if (std::holds_alternative<std::nullptr_t>(val)) {
-                push(Value(nullptr));
-            } else {
-                push(Value(nullptr));
-            }
+        if (idx && static_cast<size_t>(*idx) < constants_.size()) {
+            push(constants_[*idx]);
         } else {
             push(Value(nullptr));
         }
@@ -364,11 +945,7 @@ void VM::execute_instruction(CallFrame& frame) {
     }
 
     case OpCode::LOAD_SUPER: {
-        Value this_val;
-        auto local_it = frame.locals.find("this");
-        if (local_it != frame.locals.end()) {
-            this_val = local_it->second;
-        }
+        const Value& this_val = frame.self;
         if (this_val.is_object()) {
             ObjectPtr obj = this_val.as_object();
             auto class_it = classes_.find(obj->class_id);
@@ -391,40 +968,28 @@ void VM::execute_instruction(CallFrame& frame) {
         std::visit(
             [this, &frame](const auto& op) {
                 using T = std::decay_t<decltype(op)>;
-                if constexpr (std::is_same_v<T, int64_t>) {
-                    if (static_cast<size_t>(op) < globals_by_index_.size()) {
-                        const std::string& name = globals_by_index_[op];
-                        auto local_it = frame.locals.find(name);
-                        if (local_it != frame.locals.end()) {
-                            push(local_it->second);
-                            return;
-                        }
-                        auto it = globals_.find(name);
-                        if (it != globals_.end()) {
-                            push(it->second);
+                if constexpr (std::is_same_v<T, int64_t>) {
+                    if (static_cast<size_t>(op) < global_index_slots_.size()) {
+                        if (const Value* global = globals_.find(global_index_slots_[op])) {
+                            push(*global);
                             return;
                         }
                     }
                     push(Value(nullptr));
                 } else if constexpr (std::is_same_v<T, std::string>) {
-                    auto local_it = frame.locals.find(op);
-                    if (local_it != frame.locals.end()) {
-                        push(local_it->second);
+                    if (op == "this") {
+                        push(frame.self);
                         return;
                     }
-                    auto it = globals_.find(op);
-                    if (it != globals_.end()) {
-                        push(it->second);
+                    if (const Value* global = globals_.find(globals_.slot(op))) {
+                        push(*global);
                         return;
                     }
 
-                    auto this_it = frame.locals.find("this");
-                    if (this_it != frame.locals.end() && this_it->second.is_object()) {
-                        ObjectPtr obj = this_it->second.as_object();
-                        auto field_it = obj->fields.find(op);
-                        if (field_it != obj->fields.end()) {
-                            auto field_ptr = field_it->second;
-                            push(*field_ptr);
+                    if (frame.self.is_object()) {
+                        ObjectPtr obj = frame.self.as_object();
+                        if (const Value* field = obj->get_field(op)) {
+                            push(*field);
                             return;
                         }
                     }
@@ -441,33 +1006,22 @@ void VM::execute_instruction(CallFrame& frame) {
             [this, &val, &frame](const auto& op) {
                 using T = std::decay_t<decltype(op)>;
                 if constexpr (std::is_same_v<T, int64_t>) {
-                    if (static_cast<size_t>(op) < globals_by_index_.size()) {
-                        const std::string& name = globals_by_index_[op];
-                        if (const_vars_.count(name)) {
-                            throw RuntimeError("Cannot reassign const variable '" + name + "'");
-                        }
-                        auto local_it = frame.locals.find(name);
-                        if (local_it != frame.locals.end()) {
-                            local_it->second = val;
-                        } else {
-                            globals_[name] = val;
+                    if (static_cast<size_t>(op) < global_index_slots_.size()) {
+                        uint32_t slot = global_index_slots_[op];
+                        if (globals_.is_const(slot)) {
+                            throw RuntimeError("Cannot reassign const variable '" + globals_.name(slot) + "'");
                         }
+                        globals_.set(slot, val);
                     }
                 } else if constexpr (std::is_same_v<T, std::string>) {
-                    if (const_vars_.count(op)) {
+                    uint32_t slot = globals_.slot(op);
+                    if (globals_.is_const(slot)) {
                         throw RuntimeError("Cannot reassign const variable '" + std::string(op) + "'");
                     }
-                    auto local_it = frame.locals.find(op);
-                    if (local_it != frame.locals.end()) {
-                        local_it->second = val;
+                    if (frame.self.is_object()) {
+                        frame.self.as_object()->set_field(op, val);
                     } else {
-                        auto this_it = frame.locals.find("this");
-                        if (this_it != frame.locals.end() && this_it->second.is_object()) {
-                            ObjectPtr obj = this_it->second.as_object();
-                            obj->fields[op] = std::make_shared<Value>(val);
-                        } else {
-                            globals_[op] = val;
-                        }
+                        globals_.set(slot, val);
                     }
                 }
             },
@@ -475,186 +1029,201 @@ void VM::execute_instruction(CallFrame& frame) {
         break;
     }
 
-    case OpCode::POP:
-        pop();
-        break;
-
-    case OpCode::DUP:
-        push(peek());
-        break;
-
-    case OpCode::LOOP_START:
-
-        break;
-
-    case OpCode::BREAK_JUMP:
-    case OpCode::CONTINUE_JUMP: {
-        if (auto* target = std::get_if<int64_t>(&instr.operand)) {
-            frame.ip = static_cast<size_t>(*target);
+    case OpCode::LOAD_LOCAL: {
+        size_t slot = static_cast<size_t>(std::get<int64_t>(instr.operand));
+        if (slot >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(slot));
         }
+        push(locals_[frame.slot_base + slot]);
         break;
     }
 
-    case OpCode::ADD: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() + b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() + b.as_number()));
-        } else if (a.is_string() && b.is_string()) {
-            push(Value(a.as_string() + b.as_string()));
-        } else if (a.is_string() && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_string() + value_to_string(b)));
-        } else if ((a.is_number() || a.is_bool()) && b.is_string()) {
-            push(Value(value_to_string(a) + b.as_string()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot add " + value_type_name(a) + " and " + value_type_name(b));
+    case OpCode::STORE_LOCAL: {
+        size_t slot = static_cast<size_t>(std::get<int64_t>(instr.operand));
+        if (slot >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(slot));
         }
+        locals_[frame.slot_base + slot] = peek();
         break;
     }
 
-    case OpCode::SUB: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() - b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() - b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
+    case OpCode::ADD_R:
+    case OpCode::SUB_R:
+    case OpCode::MUL_R:
+    case OpCode::DIV_R:
+    case OpCode::PERCENT_R:
+    case OpCode::EQ_R:
+    case OpCode::NE_R:
+    case OpCode::GT_R:
+    case OpCode::GE_R:
+    case OpCode::LT_R:
+    case OpCode::LE_R:
+    case OpCode::ADD_I:
+    case OpCode::SUB_I:
+    case OpCode::LT_I:
+    case OpCode::LE_I:
+    case OpCode::ADD_II:
+    case OpCode::SUB_II:
+    case OpCode::MUL_II:
+    case OpCode::PERCENT_II:
+    case OpCode::EQ_II:
+    case OpCode::NE_II:
+    case OpCode::GT_II:
+    case OpCode::GE_II:
+    case OpCode::LT_II:
+    case OpCode::LE_II:
+    case OpCode::MOVE_I:
+    case OpCode::MOVE_R: {
+        RegisterOperands regs = RegisterOperands::unpack(std::get<int64_t>(instr.operand));
+        auto read = [&](uint16_t index, bool is_const) -> Value {
+            if (is_const) {
+                if (index >= constants_.size()) {
+                    throw RuntimeError("Invalid constant index " + std::to_string(index));
+                }
+                return constants_[index];
+            }
+            if (index >= frame.slot_count) {
+                throw RuntimeError("Invalid local slot " + std::to_string(index));
+            }
+            return locals_[frame.slot_base + index];
+        };
+        // The specialized forms check here what the threaded handlers assume:
+        // integer sources, and an integer result for arithmetic and MOVE_I.
+        bool is_move = instr.op == OpCode::MOVE_R || instr.op == OpCode::MOVE_I;
+        bool proven_sources = instr.op >= OpCode::ADD_II && instr.op <= OpCode::LE_II;
+        bool proven_result = instr.op == OpCode::MOVE_I || (instr.op >= OpCode::ADD_II && instr.op <= OpCode::PERCENT_II);
+        if (instr.op == OpCode::ADD_R && !regs.push && !regs.lhs_const && regs.lhs == regs.dst &&
+            regs.dst < frame.slot_count) {
+            // `s = s + piece` on a string only this slot holds grows it in place.
+            Value piece = read(regs.rhs, regs.rhs_const);
+            std::string* buffer = locals_[frame.slot_base + regs.dst].sole_string();
+            if (buffer && (piece.is_string() || piece.is_number() || piece.is_bool())) {
+                buffer->append(piece.is_string() ? piece.as_string() : value_to_string(piece));
+                break;
+            }
+        }
+        Value lhs = read(regs.lhs, regs.lhs_const);
+        Value rhs = is_move ? Value() : read(regs.rhs, regs.rhs_const);
+        if (proven_sources && (!lhs.is_integer() || !rhs.is_integer())) {
+            deoptimize(frame, current_offset);
+            break;
+        }
+        Value result = is_move ? std::move(lhs) : binary_op(register_base_op(instr.op), lhs, rhs);
+        if (proven_result && !result.is_integer()) {
+            deoptimize(frame, current_offset);
+            break;
+        }
+        if (regs.push) {
+            push(std::move(result));
         } else {
-            throw RuntimeError("Type error: cannot subtract " + value_type_name(b) + " from " + value_type_name(a) +
-                               " (both must be numbers)");
+            if (regs.dst >= frame.slot_count) {
+                throw RuntimeError("Invalid local slot " + std::to_string(regs.dst));
+            }
+            locals_[frame.slot_base + regs.dst] = std::move(result);
         }
         break;
     }
 
-    case OpCode::MUL: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() * b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() * b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot multiply " + value_type_name(a) + " and " + value_type_name(b) +
-                               " (both must be numbers)");
+    case OpCode::APPEND_LOCAL: {
+        AppendOperands app = AppendOperands::unpack(std::get<int64_t>(instr.operand));
+        if (app.target >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(app.target));
         }
+        append_to(locals_[frame.slot_base + app.target], app.count);
         break;
     }
 
-    case OpCode::DIV: {
-        Value b = pop();
-        Value a = pop();
-        if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            if (b.as_number() != 0) {
-                push(Value(a.as_number() / b.as_number()));
-            } else {
-                throw RuntimeError("Division by zero");
-            }
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot divide " + value_type_name(a) + " by " + value_type_name(b) +
-                               " (both must be numbers)");
+    case OpCode::APPEND_VAR: {
+        AppendOperands app = AppendOperands::unpack(std::get<int64_t>(instr.operand));
+        if (app.target >= global_index_slots_.size()) {
+            throw RuntimeError("Invalid global index " + std::to_string(app.target));
         }
+        uint32_t slot = global_index_slots_[app.target];
+        if (globals_.is_const(slot)) {
+            throw RuntimeError("Cannot reassign const variable '" + globals_.name(slot) + "'");
+        }
+        if (!globals_.defined(slot))
+            globals_.set(slot, Value());
+        append_to(globals_.value(slot), app.count);
         break;
     }
 
-    case OpCode::PERCENT: {
-        Value b = pop();
-        Value a = pop();
-        if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(std::fmod(a.as_number(), b.as_number())));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot modulo " + value_type_name(a) + " by " + value_type_name(b) +
-                               " (both must be numbers)");
+    case OpCode::INC_II: {
+        IncrementOperands inc = IncrementOperands::unpack(std::get<int64_t>(instr.operand));
+        if (inc.slot >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(inc.slot));
         }
+        Value& target = locals_[frame.slot_base + inc.slot];
+        int64_t r;
+        if (!target.is_integer() || !checked_add(target.as_integer(), inc.delta, r)) {
+            deoptimize(frame, current_offset);
+            break;
+        }
+        target = Value(r);
         break;
     }
 
-    case OpCode::EQ: {
-        Value b = pop();
-        Value a = pop();
-        push(Value(a == b));
+    case OpCode::GUARD_INT:
+    case OpCode::STORE_LOCAL_I: {
+        size_t slot = static_cast<size_t>(std::get<int64_t>(instr.operand));
+        if (slot >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(slot));
+        }
+        const Value& value = instr.op == OpCode::GUARD_INT ? locals_[frame.slot_base + slot] : peek();
+        if (!value.is_integer()) {
+            deoptimize(frame, current_offset);
+            break;
+        }
+        if (instr.op == OpCode::STORE_LOCAL_I)
+            locals_[frame.slot_base + slot] = value;
         break;
     }
 
-    case OpCode::GT: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() > b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() > b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " > " + value_type_name(b) +
-                               " (both must be numbers)");
+    case OpCode::INC_I: {
+        IncrementOperands inc = IncrementOperands::unpack(std::get<int64_t>(instr.operand));
+        if (inc.slot >= frame.slot_count) {
+            throw RuntimeError("Invalid local slot " + std::to_string(inc.slot));
         }
+        Value& target = locals_[frame.slot_base + inc.slot];
+        target = binary_op(OpCode::ADD, target, Value(static_cast<int64_t>(inc.delta)));
         break;
     }
 
-    case OpCode::LT: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() < b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() < b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " < " + value_type_name(b) +
-                               " (both must be numbers)");
-        }
+    case OpCode::POP:
+        pop();
         break;
-    }
 
-    case OpCode::NE: {
-        Value b = pop();
-        Value a = pop();
-        push(Value(a != b));
+    case OpCode::DUP:
+        push(peek());
         break;
-    }
 
-    case OpCode::GE: {
-        Value b = pop();
-        Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() >= b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() >= b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " >= " + value_type_name(b) +
-                               " (both must be numbers)");
+    case OpCode::LOOP_START:
+        if (CycleCollector::due())
+            CycleCollector::collect();
+        break;
+
+    case OpCode::BREAK_JUMP:
+    case OpCode::CONTINUE_JUMP: {
+        if (auto* target = std::get_if<int64_t>(&instr.operand)) {
+            frame.ip = static_cast<size_t>(*target);
         }
         break;
     }
 
+    case OpCode::ADD:
+    case OpCode::SUB:
+    case OpCode::MUL:
+    case OpCode::DIV:
+    case OpCode::PERCENT:
+    case OpCode::EQ:
+    case OpCode::GT:
+    case OpCode::LT:
+    case OpCode::NE:
+    case OpCode::GE:
     case OpCode::LE: {
         Value b = pop();
         Value a = pop();
-        if (a.is_integer() && b.is_integer()) {
-            push(Value(a.as_integer() <= b.as_integer()));
-        } else if ((a.is_number() || a.is_bool()) && (b.is_number() || b.is_bool())) {
-            push(Value(a.as_number() <= b.as_number()));
-        } else if (a.is_null() || b.is_null()) {
-            push(Value(nullptr));
-        } else {
-            throw RuntimeError("Type error: cannot compare " + value_type_name(a) + " <= " + value_type_name(b) +
-                               " (both must be numbers)");
-        }
+        push(binary_op(instr.op, a, b));
         break;
     }
 
@@ -702,113 +1271,49 @@ void VM::execute_instruction(CallFrame& frame) {
 
     case OpCode::RET: {
         Value ret_val = pop();
-        CallFrame finished_frame = frames_.back();
-        frames_.pop_back();
+        if (frame.push_post_action_on_return) {
+            ret_val = frame.post_action_value;
+        }
+        pop_frame();
         if (!frames_.empty()) {
-            if (finished_frame.push_post_action_on_return) {
-                push(finished_frame.post_action_value);
-            } else {
-                push(ret_val);
-            }
+            push(ret_val);
         }
         break;
     }
 
-    case OpCode::CALL: {
+    case OpCode::CALL:
+    case OpCode::TAIL_CALL: {
         std::visit(
-            [this, &frame](const auto& op) {
+            [this, &frame, &instr](const auto& op) {
                 using T = std::decay_t<decltype(op)>;
                 if constexpr (std::is_same_v<T, std::pair<std::string, int>>) {
                     const auto& [method_name, arg_count] = op;
 
-                    std::vector<Value> args;
-                    for (int i = 0; i < arg_count; ++i) {
-                        args.push_back(pop());
+                    // The arguments stay where they were pushed. A callee frame
+                    // moves them straight into its slots, and builtins read
+                    // them in place once the callee below them is removed.
+                    size_t argc = arg_count > 0 ? static_cast<size_t>(arg_count) : 0;
+                    if (static_cast<size_t>(stack_ptr_ - stack_.get()) < argc + 1) {
+                        throw RuntimeError("Stack underflow");
                     }
-                    std::reverse(args.begin(), args.end());
-
-                    Value callee = pop();
-
+                    Value* args = stack_ptr_ - argc;
+                    Value callee = std::move(args[-1]);
+                    auto enter = [&](const CompiledMethod& method, Value self) {
+                        // The arguments are on the value stack, so the frame
+                        // can go before the callee's is set up in its place.
+                        if (instr.op == OpCode::TAIL_CALL && frame.reusable())
+                            pop_frame();
+                        push_frame(method, args, argc, std::move(self));
+                        drop_to(args - 1);
+                    };
+                    auto to_builtin = [&] {
+                        std::move(args, args + argc, args - 1);
+                        --stack_ptr_;
+                    };
+
+                    // z.* calls the compiler could not resolve to a builtin.
                     if (callee.is_string() && callee.as_string() == "SYSTEM_Z") {
-                        if (method_name == "dyn" && args.size() >= 2) {
-                            if (sandbox_mode_) {
-                                throw RuntimeError("FFI: z.dyn blocked in sandbox mode");
-                            }
-                            if (!args[0].is_string() || !args[1].is_string()) {
-                                throw RuntimeError("z.dyn requires string library path and function name");
-                            }
-                            std::string lib_path = args[0].as_string();
-                            std::string func_name_str = args[1].as_string();
-
-                            void* handle = nullptr;
-                            auto cache_it = ffi_library_cache_.find(lib_path);
-                            if (cache_it != ffi_library_cache_.end()) {
-                                handle = cache_it->second;
-                            } else {
-#ifdef _WIN32
-                                handle = reinterpret_cast<void*>(LoadLibraryA(lib_path.c_str()));
-#else
-                                handle = dlopen(lib_path.c_str(), RTLD_NOW);
-#endif
-                                if (!handle) {
-                                    std::string err_msg = "FFI: Cannot load library " + lib_path;
-#ifndef _WIN32
-                                    err_msg += ": ";
-                                    err_msg += dlerror();
-#endif
-                                    throw RuntimeError(err_msg);
-                                }
-                                ffi_library_cache_[lib_path] = handle;
-                            }
-
-#ifdef _WIN32
-                            FARPROC raw_func = GetProcAddress(reinterpret_cast<HMODULE>(handle), func_name_str.c_str());
-#else
-                            void* raw_func = dlsym(handle, func_name_str.c_str());
-#endif
-                            if (!raw_func) {
-                                throw RuntimeError("FFI: Function '" + func_name_str + "' not found in library " +
-                                                   lib_path);
-                            }
-
-                            int ffi_arg_count = static_cast<int>(args.size()) - 2;
-                            int64_t result = 0;
-                            if (ffi_arg_count == 0) {
-                                typedef int64_t (*Func0)();
-                                result = reinterpret_cast<Func0>(raw_func)();
-                            } else if (ffi_arg_count == 1) {
-                                typedef int64_t (*Func1)(int64_t);
-                                int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
-                                result = reinterpret_cast<Func1>(raw_func)(a0);
-                            } else if (ffi_arg_count == 2) {
-                                typedef int64_t (*Func2)(int64_t, int64_t);
-                                int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
-                                int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
-                                result = reinterpret_cast<Func2>(raw_func)(a0, a1);
-                            } else if (ffi_arg_count == 3) {
-                                typedef int64_t (*Func3)(int64_t, int64_t, int64_t);
-                                int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
-                                int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
-                                int64_t a2 = args[4].is_number() ? static_cast<int64_t>(args[4].as_number()) : 0;
-                                result = reinterpret_cast<Func3>(raw_func)(a0, a1, a2);
-                            } else if (ffi_arg_count == 4) {
-                                typedef int64_t (*Func4)(int64_t, int64_t, int64_t, int64_t);
-                                int64_t a0 = args[2].is_number() ? static_cast<int64_t>(args[2].as_number()) : 0;
-                                int64_t a1 = args[3].is_number() ? static_cast<int64_t>(args[3].as_number()) : 0;
-                                int64_t a2 = args[4].is_number() ? static_cast<int64_t>(args[4].as_number()) : 0;
-                                int64_t a3 = args[5].is_number() ? static_cast<int64_t>(args[5].as_number()) : 0;
-                                result = reinterpret_cast<Func4>(raw_func)(a0, a1, a2, a3);
-                            } else {
-                                throw RuntimeError("FFI: z.dyn supports up to 4 arguments");
-                            }
-
-                            push(Value(static_cast<double>(result)));
-                            return;
-                        }
-
-                        for (auto& arg : args) {
-                            push(arg);
-                        }
+                        to_builtin();
                         system_call(method_name, arg_count);
                         return;
                     }
@@ -816,13 +1321,7 @@ void VM::execute_instruction(CallFrame& frame) {
                     if (callee.is_string()) {
                         auto func_it = global_functions_.find(callee.as_string());
                         if (func_it != global_functions_.end()) {
-                            const CompiledMethod& method_info = func_it->second;
-                            check_call_depth();
-                            CallFrame new_frame(&method_info.bytecode);
-                            for (size_t i = 0; i < args.size() && i < method_info.param_names.size(); ++i) {
-                                new_frame.locals[method_info.param_names[i]] = args[i];
-                            }
-                            frames_.push_back(std::move(new_frame));
+                            enter(func_it->second, Value());
                             return;
                         }
                     }
@@ -830,13 +1329,7 @@ void VM::execute_instruction(CallFrame& frame) {
                     if (callee.is_null()) {
                         auto func_it = global_functions_.find(method_name);
                         if (func_it != global_functions_.end()) {
-                            const CompiledMethod& method_info = func_it->second;
-                            check_call_depth();
-                            CallFrame new_frame(&method_info.bytecode);
-                            for (size_t i = 0; i < args.size() && i < method_info.param_names.size(); ++i) {
-                                new_frame.locals[method_info.param_names[i]] = args[i];
-                            }
-                            frames_.push_back(std::move(new_frame));
+                            enter(func_it->second, Value());
                             return;
                         }
 
@@ -922,9 +1415,7 @@ void VM::execute_instruction(CallFrame& frame) {
                                                                                       "assert",
                                                                                       "assert_eq"};
                         if (BUILTIN_NAMES.count(method_name)) {
-                            for (auto& arg : args) {
-                                push(arg);
-                            }
+                            to_builtin();
                             system_call(method_name, arg_count);
                             return;
                         }
@@ -933,50 +1424,23 @@ void VM::execute_instruction(CallFrame& frame) {
                     if (callee.is_object()) {
                         ObjectPtr obj = callee.as_object();
 
-                        auto class_it = classes_.find(obj->class_id);
-                        if (class_it == classes_.end()) {
+                        const ClassLink* link = class_link(obj->class_id);
+                        if (!link) {
                             throw RuntimeError("Unknown class ID: " + std::to_string(obj->class_id));
                         }
 
-                        const CompiledClass& cls = class_it->second;
-
-                        const CompiledClass* current_cls = &cls;
-                        auto method_it = current_cls->methods.end();
-                        while (current_cls) {
-                            method_it = current_cls->methods.find(method_name);
-                            if (method_it != current_cls->methods.end())
-                                break;
-                            if (!current_cls->superclass.empty()) {
-                                auto sid = class_name_to_id_.find(current_cls->superclass);
-                                if (sid != class_name_to_id_.end()) {
-                                    auto sci = classes_.find(sid->second);
-                                    if (sci != classes_.end()) {
-                                        current_cls = &sci->second;
-                                        continue;
-                                    }
-                                }
-                            }
-                            current_cls = nullptr;
-                        }
-
-                        if (!current_cls || method_it == current_cls->methods.end()) {
+                        auto method_it = link->vtable.find(method_name);
+                        if (method_it == link->vtable.end()) {
                             if (method_name == "init") {
+                                drop_to(args - 1);
                                 push(callee);
                                 return;
                             }
-                            throw RuntimeError("Method '" + method_name + "' not found in class '" + cls.name + "'");
-                        }
-
-                        const CompiledMethod& method_info = method_it->second;
-                        check_call_depth();
-                        CallFrame new_frame(&method_info.bytecode);
-                        new_frame.locals["this"] = callee;
-
-                        for (size_t i = 0; i < args.size() && i < method_info.param_names.size(); ++i) {
-                            new_frame.locals[method_info.param_names[i]] = args[i];
+                            throw RuntimeError("Method '" + method_name + "' not found in class '" + link->cls->name +
+                                               "'");
                         }
 
-                        frames_.push_back(std::move(new_frame));
+                        enter(*method_it->second, callee);
                         return;
                     }
 
@@ -990,42 +1454,32 @@ void VM::execute_instruction(CallFrame& frame) {
                                 const CompiledClass& cls = class_it->second;
 
                                 if (method_name == "super") {
-                                    Value this_val;
-                                    auto local_it = frame.locals.find("this");
-                                    if (local_it != frame.locals.end()) {
-                                        this_val = local_it->second;
-                                    }
                                     auto method_it = cls.methods.find(cls.name);
                                     if (method_it == cls.methods.end())
                                         method_it = cls.methods.find("init");
                                     if (method_it != cls.methods.end()) {
-                                        const CompiledMethod& method_info = method_it->second;
-                                        check_call_depth();
-                                        CallFrame new_frame(&method_info.bytecode);
-                                        new_frame.locals["this"] = this_val;
-                                        for (size_t i = 0; i < args.size() && i < method_info.param_names.size(); ++i) {
-                                            new_frame.locals[method_info.param_names[i]] = args[i];
-                                        }
-                                        frames_.push_back(std::move(new_frame));
+                                        Value this_val = frame.self;
+                                        enter(method_it->second, this_val);
                                         return;
                                     }
                                 }
 
                                 auto method_it = cls.static_methods.find(method_name);
                                 if (method_it != cls.static_methods.end()) {
-                                    const CompiledMethod& method_info = method_it->second;
-                                    check_call_depth();
-                                    CallFrame new_frame(&method_info.bytecode);
-                                    for (size_t i = 0; i < args.size() && i < method_info.param_names.size(); ++i) {
-                                        new_frame.locals[method_info.param_names[i]] = args[i];
-                                    }
-                                    frames_.push_back(std::move(new_frame));
+                                    enter(method_it->second, Value());
                                     return;
                                 }
                             }
                         }
                     }
 
+                    if (callee.is_iterator()) {
+                        args[-1] = std::move(callee);
+                        stream_call(method_name, args, argc);
+                        return;
+                    }
+
+                    drop_to(args - 1);
                     push(Value(nullptr));
                 }
             },
@@ -1033,6 +1487,44 @@ void VM::execute_instruction(CallFrame& frame) {
         break;
     }
 
+    case OpCode::GET_ITER: {
+        auto source = static_cast<IterSource>(std::get<int64_t>(instr.operand));
+        if (source >= IterSource::Range1 && source <= IterSource::Range3) {
+            // Arguments as z.range reads them.
+            double bounds[3] = {0, 0, 1};
+            int count = static_cast<int>(source);
+            for (int k = count; k-- > 0;) {
+                Value v = pop();
+                double fallback = count == 3 && k == 2 ? 1 : 0;
+                bounds[count == 1 ? 1 : k] = v.is_number() ? v.as_number() : fallback;
+            }
+            push(Value(IteratorCell::range(bounds[0], bounds[1], bounds[2])));
+        } else {
+            Value value = pop();
+            push(Value(IteratorCell::over(source, value)));
+        }
+        break;
+    }
+
+    case OpCode::FOR_ITER: {
+        Value iter = pop();
+        Value item;
+        IteratorCell* it = iter.as_iterator();
+        bool more = it && next_item(*it, item);
+        push(item);
+        push(Value(more));
+        break;
+    }
+
+    case OpCode::CALL_BUILTIN: {
+        BuiltinCall call = BuiltinCall::unpack(std::get<int64_t>(instr.operand));
+        if (call.id >= BUILTIN_COUNT) {
+            throw RuntimeError("Unknown builtin id: " + std::to_string(call.id));
+        }
+        (this->*BUILTIN_TABLE[call.id])(static_cast<int>(call.arg_count));
+        break;
+    }
+
     case OpCode::NEW: {
         std::visit(
             [this](const auto& op) {
@@ -1044,62 +1536,27 @@ void VM::execute_instruction(CallFrame& frame) {
                     if (name_it != class_name_to_id_.end()) {
                         class_id = name_it->second;
                     }
-                    ObjectPtr obj = std::make_shared<AlphabetObject>(class_id);
+                    ObjectPtr obj = make_ref<AlphabetObject>(class_id);
 
-                    std::vector<Value> args;
-                    for (int i = 0; i < arg_count; ++i) {
-                        args.push_back(pop());
+                    // Constructor arguments move from the stack into its frame.
+                    size_t argc = arg_count > 0 ? static_cast<size_t>(arg_count) : 0;
+                    if (static_cast<size_t>(stack_ptr_ - stack_.get()) < argc) {
+                        throw RuntimeError("Stack underflow");
                     }
-                    std::reverse(args.begin(), args.end());
-
-                    auto class_it = classes_.find(class_id);
-                    if (class_it != classes_.end()) {
-                        run_field_init(obj, class_it->second);
-
-                        const CompiledClass* init_cls = &class_it->second;
-                        bool found_init = false;
-                        while (init_cls) {
-                            auto it = init_cls->methods.find("init");
-                            if (it == init_cls->methods.end())
-                                it = init_cls->methods.find(class_name);
-                            if (it != init_cls->methods.end()) {
-                                found_init = true;
-                                break;
-                            }
-                            if (!init_cls->superclass.empty()) {
-                                auto sid = class_name_to_id_.find(init_cls->superclass);
-                                if (sid != class_name_to_id_.end()) {
-                                    auto sci = classes_.find(sid->second);
-                                    if (sci != classes_.end()) {
-                                        init_cls = &sci->second;
-                                        continue;
-                                    }
-                                }
-                            }
-                            break;
-                        }
-                        if (found_init) {
-                            auto it = init_cls->methods.find("init");
-                            if (it == init_cls->methods.end())
-                                it = init_cls->methods.find(class_name);
-                            auto& init_method = it->second;
-                            CallFrame init_frame(&init_method.bytecode);
-                            init_frame.locals["this"] = Value(obj);
-
-                            if (arg_count > 0) {
-                                for (size_t i = 0; i < args.size() && i < init_method.param_names.size(); ++i) {
-                                    init_frame.locals[init_method.param_names[i]] = args[i];
-                                }
-                            }
+                    Value* args = stack_ptr_ - argc;
 
-                            check_call_depth();
+                    if (const ClassLink* link = class_link(class_id)) {
+                        run_field_init(obj, *link);
+                        if (link->constructor) {
+                            CallFrame& init_frame = push_frame(*link->constructor, args, argc, Value(obj));
                             init_frame.post_action_value = Value(obj);
                             init_frame.push_post_action_on_return = true;
-                            frames_.push_back(std::move(init_frame));
+                            drop_to(args);
                             return;
                         }
                     }
 
+                    drop_to(args);
                     push(Value(obj));
                 } else if constexpr (std::is_same_v<T, std::string>) {
                     uint16_t class_id = 0;
@@ -1107,16 +1564,15 @@ void VM::execute_instruction(CallFrame& frame) {
                     if (name_it != class_name_to_id_.end()) {
                         class_id = name_it->second;
                     }
-                    ObjectPtr obj = std::make_shared<AlphabetObject>(class_id);
+                    ObjectPtr obj = make_ref<AlphabetObject>(class_id);
 
-                    auto class_it = classes_.find(class_id);
-                    if (class_it != classes_.end()) {
-                        run_field_init(obj, class_it->second);
+                    if (const ClassLink* link = class_link(class_id)) {
+                        run_field_init(obj, *link);
                     }
 
                     push(Value(obj));
                 } else if constexpr (std::is_same_v<T, int64_t>) {
-                    ObjectPtr obj = std::make_shared<AlphabetObject>(static_cast<uint16_t>(op));
+                    ObjectPtr obj = make_ref<AlphabetObject>(static_cast<uint16_t>(op));
                     push(Value(obj));
                 }
             },
@@ -1140,7 +1596,7 @@ void VM::execute_instruction(CallFrame& frame) {
     }
 
     case OpCode::HALT:
-        frames_.clear();
+        clear_frames();
         break;
 
     case OpCode::SETUP_TRY: {
@@ -1172,16 +1628,11 @@ void VM::execute_instruction(CallFrame& frame) {
                 using T = std::decay_t<decltype(op)>;
                 if constexpr (std::is_same_v<T, std::string>) {
                     Value class_val = pop();
-                    if (class_val.is_number()) {
-                        uint16_t class_id = static_cast<uint16_t>(class_val.as_number());
-                        auto cls_it = classes_.find(class_id);
-                        if (cls_it != classes_.end()) {
-                            std::string key = cls_it->second.name + "." + std::string(op);
-                            auto it = globals_.find(key);
-                            if (it != globals_.end()) {
-                                push(it->second);
-                                return;
-                            }
+                    uint32_t slot;
+                    if (static_slot(class_val, op, slot)) {
+                        if (const Value* field = globals_.find(slot)) {
+                            push(*field);
+                            return;
                         }
                     }
                     push(Value(nullptr));
@@ -1198,14 +1649,9 @@ void VM::execute_instruction(CallFrame& frame) {
                 if constexpr (std::is_same_v<T, std::string>) {
                     Value val = pop();
                     Value class_val = pop();
-                    if (class_val.is_number()) {
-                        uint16_t class_id = static_cast<uint16_t>(class_val.as_number());
-                        auto cls_it = classes_.find(class_id);
-                        if (cls_it != classes_.end()) {
-                            std::string key = cls_it->second.name + "." + std::string(op);
-                            globals_[key] = val;
-                        }
-                    }
+                    uint32_t slot;
+                    if (static_slot(class_val, op, slot))
+                        globals_.set(slot, val);
                     push(val);
                 }
             },
@@ -1220,14 +1666,8 @@ void VM::execute_instruction(CallFrame& frame) {
                 if constexpr (std::is_same_v<T, std::string>) {
                     Value obj_val = pop();
                     if (obj_val.is_object()) {
-                        ObjectPtr obj = obj_val.as_object();
-                        auto it = obj->fields.find(op);
-                        if (it != obj->fields.end()) {
-                            auto field_ptr = it->second;
-                            push(*field_ptr);
-                        } else {
-                            push(Value(nullptr));
-                        }
+                        const Value* field = obj_val.as_object()->get_field(op);
+                        push(field ? *field : Value(nullptr));
                     } else {
                         push(Value(nullptr));
                     }
@@ -1245,9 +1685,9 @@ void VM::execute_instruction(CallFrame& frame) {
                     Value val = pop();
                     Value obj_val = pop();
                     if (obj_val.is_object()) {
-                        ObjectPtr obj = obj_val.as_object();
-                        obj->fields[op] = std::make_shared<Value>(val);
+                        obj_val.as_object()->set_field(op, val);
                     }
+                    push(std::move(val));
                 }
             },
             instr.operand);
@@ -1291,14 +1731,14 @@ void VM::execute_instruction(CallFrame& frame) {
         break;
     }
 
-    case OpCode::LOAD_INDEX: {
+    case OpCode::LOAD_INDEX:
+    case OpCode::LOAD_INDEX_I: {
         Value idx = pop();
         Value obj = pop();
 
         if (obj.is_list() && idx.is_number()) {
             const auto& list = obj.as_list();
-            double raw = idx.as_number();
-            int64_t index = static_cast<int64_t>(raw);
+            int64_t index = idx.as_integer();
 
             if (index < 0)
                 index += static_cast<int64_t>(list.size());
@@ -1328,8 +1768,7 @@ void VM::execute_instruction(CallFrame& frame) {
 
         if (obj.is_list() && idx.is_number()) {
             auto& list = obj.as_list();
-            double raw = idx.as_number();
-            int64_t index = static_cast<int64_t>(raw);
+            int64_t index = idx.as_integer();
             if (index < 0)
                 index += static_cast<int64_t>(list.size());
             if (index >= 0 && static_cast<size_t>(index) < list.size()) {
@@ -1345,9 +1784,8 @@ void VM::execute_instruction(CallFrame& frame) {
 
     case OpCode::MARK_CONST: {
         Value name_val = pop();
-        if (name_val.is_string()) {
-            const_vars_.insert(name_val.as_string());
-        }
+        if (name_val.is_string())
+            mark_const(name_val.as_string());
         break;
     }
 
@@ -1385,7 +1823,7 @@ void VM::wait_for_debugger_command() {
             std::ostringstream oss;
             oss << "{";
             bool first = true;
-            for (const auto& [name, val] : globals_) {
+            for (const auto& [name, val] : globals_.snapshot()) {
                 if (!first)
                     oss << ",";
                 oss << "\"" << name << "\": \"" << value_to_string(val) << "\"";
@@ -1457,98 +1895,52 @@ std::string VM::get_locals_json(const CallFrame& frame) {
     std::ostringstream oss;
     oss << "{";
     bool first = true;
-    for (const auto& [name, val] : frame.locals) {
+    if (frame.self.is_object()) {
+        oss << "\"this\": \"" << value_to_string(frame.self) << "\"";
+        first = false;
+    }
+    for (size_t i = 0; i < frame.slot_count && frame.slot_names; ++i) {
+        if ((*frame.slot_names)[i].rfind('$', 0) == 0)
+            continue; // a temporary of the optimizer
         if (!first)
             oss << ",";
-        oss << "\"" << name << "\": \"" << value_to_string(val) << "\"";
+        oss << "\"" << (*frame.slot_names)[i] << "\": \"" << value_to_string(locals_[frame.slot_base + i]) << "\"";
         first = false;
     }
     oss << "}";
     return oss.str();
 }
 
-void VM::run_field_init(ObjectPtr obj, const CompiledClass& cls) {
-    std::vector<const CompiledClass*> chain;
-    const CompiledClass* current = &cls;
-    while (current) {
-        chain.push_back(current);
-        if (!current->superclass.empty()) {
-            auto sid = class_name_to_id_.find(current->superclass);
-            if (sid != class_name_to_id_.end()) {
-                auto sci = classes_.find(sid->second);
-                if (sci != classes_.end()) {
-                    current = &sci->second;
-                    continue;
-                }
-            }
-        }
-        break;
-    }
-
-    std::reverse(chain.begin(), chain.end());
-
-    for (const auto* c : chain) {
+void VM::run_field_init(ObjectPtr obj, const ClassLink& link) {
+    // Field initializers are ordinary code run in a frame whose `this` is the
+    // new object; their implicit return value is discarded.
+    for (const auto* c : link.init_chain) {
         if (c->field_init.empty())
             continue;
-        const auto& fi = c->field_init;
-        for (size_t ip = 0; ip < fi.size();) {
-            const auto& instr = fi[ip];
-            if (instr.op == OpCode::RET)
+        size_t saved_stack = stack_ptr_ - stack_.get();
+        size_t saved_frames = frames_.size();
+        frames_.push(&c->field_init).self = Value(obj);
+
+        while (frames_.size() > saved_frames) {
+            auto& current_frame = frames_.back();
+            if (current_frame.ip >= current_frame.bytecode->size()) {
+                pop_frame();
                 break;
-            if (instr.op == OpCode::LOAD_VAR) {
-                push(Value(obj));
-            } else if (instr.op == OpCode::PUSH_CONST || instr.op == OpCode::PUSH_CONST_POOL) {
-                if (instr.op == OpCode::PUSH_CONST_POOL) {
-                    auto* idx = std::get_if<int64_t>(&instr.operand);
-                    if (idx && static_cast<size_t>(*idx) < constant_pool_.size()) {
-                        const Operand& val = constant_pool_[*idx];
-                        if (auto* i = std::get_if<int64_t>(&val)) {
-                            push(Value(*i));
-                        } else if (auto* d = std::get_if<double>(&val)) {
-                            push(Value(*d));
-                        } else if (auto* s = std::get_if<std::string>(&val)) {
-                            push(Value(*s));
-                        } else {
-                            push(Value(nullptr));
-                        }
-                    } else {
-                        push(Value(nullptr));
-                    }
-                } else {
-                    if (auto* i = std::get_if<int64_t>(&instr.operand)) {
-                        push(Value(*i));
-                    } else if (auto* d = std::get_if<double>(&instr.operand)) {
-                        push(Value(*d));
-                    } else if (auto* s = std::get_if<std::string>(&instr.operand)) {
-                        push(Value(*s));
-                    } else {
-                        push(Value(nullptr));
-                    }
-                }
-            } else if (instr.op == OpCode::STORE_FIELD) {
-                Value val = pop();
-                Value obj_val = pop();
-                if (obj_val.is_object()) {
-                    auto o = obj_val.as_object();
-                    std::visit(
-                        [&](const auto& f) {
-                            if constexpr (std::is_same_v<std::decay_t<decltype(f)>, std::string>) {
-                                o->fields[f] = std::make_shared<Value>(val);
-                            }
-                        },
-                        instr.operand);
-                }
-                push(val);
-            } else if (instr.op == OpCode::POP) {
-                pop();
             }
-            ip++;
+            if (debug_mode_ || trace_callback_) {
+                execute_instruction(current_frame);
+            } else {
+                dispatch(saved_frames);
+            }
         }
+
+        while (stack_ptr_ > stack_.get() + saved_stack)
+            pop();
     }
 }
 
 void VM::mark_const(const std::string& name) {
-    const_vars_.insert(name);
+    globals_.mark_const(globals_.slot(name));
 }
 
 void VM::throw_exception(const Value& value) {
@@ -1568,35 +1960,64 @@ void VM::throw_exception(const Value& value) {
             return;
         }
 
-        frames_.pop_back();
+        pop_frame();
     }
 
     last_unhandled_error_ = value_to_string(value);
     std::cerr << "Unhandled exception: " << value_to_string(value) << std::endl;
 }
 
-const std::vector<Instruction>* VM::lookup_method(const CompiledClass& cls, const std::string& name,
-                                                  const std::string&) {
-    const CompiledClass* current = &cls;
-    while (current) {
-        auto it = current->methods.find(name);
-        if (it != current->methods.end()) {
-            return &it->second.bytecode;
-        }
+void VM::link_classes() {
+    class_name_to_id_.clear();
+    uint16_t max_id = 0;
+    for (const auto& [id, cls] : classes_) {
+        class_name_to_id_[cls.name] = id;
+        max_id = std::max(max_id, id);
+    }
+
+    class_links_.clear();
+    class_links_.resize(classes_.empty() ? 0 : static_cast<size_t>(max_id) + 1);
+    for (const auto& [id, cls] : classes_) {
+        ClassLink& link = class_links_[id];
+        link.cls = &cls;
+
+        // Nearest definition wins; the length bound stops a superclass cycle.
+        const CompiledClass* current = &cls;
+        while (current && link.init_chain.size() <= classes_.size()) {
+            link.init_chain.push_back(current);
+            for (const auto& [name, method] : current->methods) {
+                link.vtable.emplace(name, &method);
+            }
+            if (!link.constructor) {
+                auto it = current->methods.find("init");
+                if (it == current->methods.end())
+                    it = current->methods.find(cls.name);
+                if (it != current->methods.end())
+                    link.constructor = &it->second;
+            }
 
-        if (!current->superclass.empty()) {
-            auto super_id_it = class_name_to_id_.find(current->superclass);
-            if (super_id_it != class_name_to_id_.end()) {
-                auto cls_it = classes_.find(super_id_it->second);
-                if (cls_it != classes_.end()) {
-                    current = &cls_it->second;
-                    continue;
+            const CompiledClass* next = nullptr;
+            if (!current->superclass.empty()) {
+                auto sid = class_name_to_id_.find(current->superclass);
+                if (sid != class_name_to_id_.end()) {
+                    auto sci = classes_.find(sid->second);
+                    if (sci != classes_.end())
+                        next = &sci->second;
                 }
             }
+            current = next;
         }
-        break;
+        std::reverse(link.init_chain.begin(), link.init_chain.end());
     }
-    return nullptr;
+}
+
+const std::vector<Instruction>* VM::lookup_method(const CompiledClass& cls, const std::string& name,
+                                                  const std::string&) {
+    const ClassLink* link = class_link(cls.id);
+    if (!link)
+        return nullptr;
+    auto it = link->vtable.find(name);
+    return it != link->vtable.end() ? &it->second->bytecode : nullptr;
 }
 
 } // namespace alphabet
@@ -0,0 +1,1335 @@
+#include "vm.h"
+#include <algorithm>
+#include <cmath>
+
+// Threaded dispatch relies on the GNU "labels as values" extension. Other
+// compilers, or builds defining ALPHABET_NO_COMPUTED_GOTO, use a switch.
+#if defined(__GNUC__) && !defined(ALPHABET_NO_COMPUTED_GOTO)
+#define ALPHABET_COMPUTED_GOTO 1
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace alphabet {
+
+namespace {
+
+// Pseudo-opcodes that only appear in decoded code.
+constexpr OpCode END_OF_CODE = static_cast<OpCode>(0);
+constexpr size_t SLOW_PATH_INDEX = static_cast<size_t>(OpCode::FOR_ITER) + 1;
+constexpr OpCode SLOW_PATH = static_cast<OpCode>(SLOW_PATH_INDEX);
+
+// Quickened forms. A generic instruction that sees operands of one of these
+// types rewrites itself in place to the matching form, which only checks
+// that the types still match. On a miss it rewrites itself back and runs
+// generically; after QUICKEN_MISS_LIMIT misses the site stays generic.
+constexpr OpCode quick_op(size_t n) {
+    return static_cast<OpCode>(SLOW_PATH_INDEX + 1 + n);
+}
+constexpr OpCode ADD_DOUBLE = quick_op(0);
+constexpr OpCode SUB_DOUBLE = quick_op(1);
+constexpr OpCode MUL_DOUBLE = quick_op(2);
+constexpr OpCode LT_DOUBLE = quick_op(3);
+constexpr OpCode LE_DOUBLE = quick_op(4);
+constexpr OpCode GT_DOUBLE = quick_op(5);
+constexpr OpCode GE_DOUBLE = quick_op(6);
+constexpr OpCode ADD_STRING = quick_op(7);
+constexpr OpCode LOAD_INDEX_LIST_INT = quick_op(8);
+constexpr OpCode LOAD_INDEX_MAP_STRING = quick_op(9);
+// Not a quickening: decode puts it on the first instruction of a list or
+// map literal built only from constants, see fold_literals.
+constexpr OpCode PUSH_LITERAL = quick_op(10);
+constexpr size_t HANDLER_COUNT = static_cast<size_t>(PUSH_LITERAL) + 1;
+constexpr uint8_t QUICKEN_MISS_LIMIT = 4;
+
+// DecodedInstruction::arg for LOAD_VAR of `this`; otherwise arg is the
+// global slot, and the site is a name only for name operands, which may
+// also be fields of `this`.
+constexpr int64_t SELF_VAR = -1;
+
+inline bool is_double(const Value& v) {
+    return v.kind() == Value::Kind::Number;
+}
+
+// list[index] with negative indices counting from the end; null when out of
+// range, as LOAD_INDEX does.
+inline Value list_item(const Value::List& list, int64_t index) {
+    if (index < 0)
+        index += static_cast<int64_t>(list.size());
+    if (index >= 0 && static_cast<size_t>(index) < list.size())
+        return list[static_cast<size_t>(index)];
+    return Value();
+}
+
+// A fresh copy of a literal template. Containers are copied, nested ones
+// recursively; strings are immutable and stay shared with the template.
+Value clone_literal(const Value& value) {
+    if (value.is_list()) {
+        Value::List items = value.as_list();
+        for (Value& item : items) {
+            if (item.is_list() || item.is_map())
+                item = clone_literal(item);
+        }
+        return Value(std::move(items));
+    }
+    if (value.is_map()) {
+        Value::Map items = value.as_map();
+        for (auto& [key, item] : items) {
+            if (item.is_list() || item.is_map())
+                item = clone_literal(item);
+        }
+        return Value(std::move(items));
+    }
+    return value;
+}
+
+inline void rewrite(DecodedInstruction& d, OpCode op, const void* const* handlers) {
+    d.op = op;
+    if (handlers)
+        d.handler = handlers[static_cast<size_t>(op)];
+}
+
+inline bool is_falsy(const Value& v) {
+    switch (v.kind()) {
+    case Value::Kind::Null:
+        return true;
+    case Value::Kind::Integer:
+        return v.as_integer() == 0;
+    case Value::Kind::Number:
+        return v.as_number() == 0;
+    case Value::Kind::Bool:
+        return !v.as_bool();
+    case Value::Kind::String:
+        return v.as_string().empty();
+    default:
+        return false;
+    }
+}
+
+// A list or map literal whose elements are all constants compiles to its
+// PUSH_CONSTs and a BUILD_LIST or BUILD_MAP. Each such run, nested ones
+// included, is built once here into a template: its first instruction
+// becomes PUSH_LITERAL, which pushes a clone and resumes after the run.
+// The rest of the run stays decoded, so native code that side-exits inside
+// a literal can resume there. Runs never span a jump target.
+void fold_literals(const std::vector<Instruction>& bytecode, DecodedCode& decoded, const void* const* handlers) {
+    std::vector<DecodedInstruction>& code = decoded.code;
+    std::vector<bool> targets(bytecode.size() + 1, false);
+    for (const Instruction& instr : bytecode) {
+        bool jump = instr.op == OpCode::JUMP || instr.op == OpCode::JUMP_IF_FALSE ||
+                    instr.op == OpCode::JUMP_IF_TRUE || instr.op == OpCode::BREAK_JUMP ||
+                    instr.op == OpCode::CONTINUE_JUMP || instr.op == OpCode::SETUP_TRY;
+        const auto* target = std::get_if<int64_t>(&instr.operand);
+        if (jump && target && *target >= 0 && static_cast<size_t>(*target) < targets.size())
+            targets[*target] = true;
+    }
+
+    struct Pending {
+        size_t start; // first instruction that pushes this value
+        Value value;
+    };
+    std::vector<Pending> pending;
+    for (size_t i = 0; i < bytecode.size(); ++i) {
+        if (targets[i])
+            pending.clear();
+        const Instruction& instr = bytecode[i];
+        const auto* count = std::get_if<int64_t>(&instr.operand);
+        bool build = (instr.op == OpCode::BUILD_LIST || instr.op == OpCode::BUILD_MAP) && count && *count >= 0;
+        size_t needed = build ? static_cast<size_t>(*count) * (instr.op == OpCode::BUILD_MAP ? 2 : 1) : 0;
+        if (instr.op == OpCode::PUSH_CONST && code[i].op == OpCode::PUSH_CONST) {
+            pending.push_back(Pending{i, decoded.constants[code[i].site]});
+        } else if (build && needed <= pending.size()) {
+            Pending* items = pending.data() + pending.size() - needed;
+            Value literal;
+            if (instr.op == OpCode::BUILD_LIST) {
+                Value::List list;
+                list.reserve(needed);
+                for (size_t k = 0; k < needed; ++k)
+                    list.push_back(std::move(items[k].value));
+                literal = Value(std::move(list));
+            } else {
+                // Same order as BUILD_MAP: pairs from the top, so the first
+                // occurrence of a repeated key wins.
+                Value::Map map;
+                for (size_t k = needed; k > 0; k -= 2) {
+                    if (items[k - 2].value.is_string())
+                        map[items[k - 2].value.as_string()] = std::move(items[k - 1].value);
+                }
+                literal = Value(std::move(map));
+            }
+            size_t start = needed ? items[0].start : i;
+            pending.resize(pending.size() - needed);
+            pending.push_back(Pending{start, literal});
+            DecodedInstruction& first = code[start];
+            rewrite(first, PUSH_LITERAL, handlers);
+            if (needed == 0) {
+                // An empty literal starts at its BUILD, which has no constant yet.
+                first.site = static_cast<uint32_t>(decoded.constants.size());
+                decoded.constants.emplace_back();
+            }
+            decoded.constants[first.site] = std::move(literal);
+            first.arg = static_cast<int64_t>(i + 1);
+        } else {
+            pending.clear();
+        }
+    }
+}
+
+// Instructions whose operand shape the fast handlers do not expect are routed
+// to SLOW_PATH, which runs them through VM::execute_instruction unchanged.
+// Direct calls are linked here to the global function they name, if any.
+DecodedCode decode(const std::vector<Instruction>& bytecode, size_t slot_count,
+                   const std::vector<uint32_t>& global_slots, GlobalTable& globals,
+                   const std::vector<Value>& constants,
+                   const std::unordered_map<std::string, CompiledMethod>& functions, const void* const* handlers) {
+    DecodedCode decoded;
+    std::vector<DecodedInstruction>& code = decoded.code;
+    code.resize(bytecode.size() + 1);
+    for (size_t i = 0; i < bytecode.size(); ++i) {
+        const Instruction& instr = bytecode[i];
+        DecodedInstruction& d = code[i];
+        if (instr.line > 0 && (decoded.lines.empty() || decoded.lines.back().line != instr.line))
+            decoded.lines.push_back(LineRun{static_cast<uint32_t>(i), instr.line});
+        auto add_constant = [&](Value value) {
+            d.site = static_cast<uint32_t>(decoded.constants.size());
+            decoded.constants.push_back(std::move(value));
+        };
+
+        const auto* int_operand = std::get_if<int64_t>(&instr.operand);
+        const auto* str_operand = std::get_if<std::string>(&instr.operand);
+        bool fast = true;
+
+        switch (instr.op) {
+        case OpCode::PUSH_CONST:
+            if (auto* dv = std::get_if<double>(&instr.operand)) {
+                add_constant(Value(*dv));
+            } else if (str_operand) {
+                add_constant(Value(*str_operand));
+            } else if (int_operand) {
+                add_constant(Value(*int_operand));
+            } else if (std::holds_alternative<std::monostate>(instr.operand) ||
+                       std::holds_alternative<std::nullptr_t>(instr.operand)) {
+                add_constant(Value());
+            } else if (!std::holds_alternative<std::monostate>(instr.operand) &&
+                       !std::holds_alternative<std::nullptr_t>(instr.operand)) {
+                fast = false;
+            }
+            break;
+        case OpCode::LOAD_VAR:
+        case OpCode::STORE_VAR:
+            if (int_operand && *int_operand >= 0 && static_cast<size_t>(*int_operand) < global_slots.size()) {
+                d.arg = global_slots[*int_operand];
+            } else if (str_operand && instr.op == OpCode::LOAD_VAR && *str_operand == "this") {
+                d.arg = SELF_VAR;
+            } else if (str_operand) {
+                d.arg = globals.slot(*str_operand);
+                d.site = static_cast<uint32_t>(decoded.names.size());
+                decoded.names.push_back(str_operand);
+            } else {
+                fast = false;
+            }
+            break;
+        case OpCode::GET_STATIC:
+        case OpCode::SET_STATIC:
+            fast = str_operand != nullptr;
+            d.site = static_cast<uint32_t>(decoded.static_sites.size());
+            decoded.static_sites.push_back(StaticSite{str_operand});
+            break;
+        case OpCode::LOAD_LOCAL:
+        case OpCode::STORE_LOCAL:
+            fast = int_operand && *int_operand >= 0 && static_cast<size_t>(*int_operand) < slot_count;
+            if (fast)
+                d.arg = *int_operand;
+            break;
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+        case OpCode::BREAK_JUMP:
+        case OpCode::CONTINUE_JUMP:
+            // Targets past the end land on the sentinel, i.e. an implicit return.
+            fast = int_operand != nullptr;
+            if (fast) {
+                d.arg = (*int_operand < 0 || static_cast<size_t>(*int_operand) > bytecode.size())
+                            ? static_cast<int64_t>(bytecode.size())
+                            : *int_operand;
+            }
+            break;
+        case OpCode::LOAD_FIELD:
+        case OpCode::STORE_FIELD:
+            d.site = static_cast<uint32_t>(decoded.field_sites.size());
+            decoded.field_sites.push_back(FieldSite{str_operand, {}});
+            fast = str_operand != nullptr;
+            break;
+        case OpCode::CALL:
+        case OpCode::TAIL_CALL:
+            if (auto* call = std::get_if<std::pair<std::string, int>>(&instr.operand)) {
+                d.arg = call->second;
+                d.site = static_cast<uint32_t>(decoded.call_sites.size());
+                CallSite& site = decoded.call_sites.emplace_back();
+                site.name = &call->first;
+                site.line = decoded.lines.empty() ? 0 : decoded.lines.back().line;
+                fast = call->second >= 0;
+                auto fn = functions.find(call->first);
+                if (fn != functions.end())
+                    site.callee = &fn->second;
+            } else {
+                fast = false;
+            }
+            break;
+        case OpCode::CALL_BUILTIN:
+            fast = int_operand && BuiltinCall::unpack(*int_operand).id < BUILTIN_COUNT;
+            if (fast)
+                d.arg = *int_operand;
+            break;
+        case OpCode::ADD_R:
+        case OpCode::SUB_R:
+        case OpCode::MUL_R:
+        case OpCode::DIV_R:
+        case OpCode::PERCENT_R:
+        case OpCode::EQ_R:
+        case OpCode::NE_R:
+        case OpCode::GT_R:
+        case OpCode::GE_R:
+        case OpCode::LT_R:
+        case OpCode::LE_R:
+        case OpCode::ADD_I:
+        case OpCode::SUB_I:
+        case OpCode::LT_I:
+        case OpCode::LE_I:
+        case OpCode::ADD_II:
+        case OpCode::SUB_II:
+        case OpCode::MUL_II:
+        case OpCode::PERCENT_II:
+        case OpCode::EQ_II:
+        case OpCode::NE_II:
+        case OpCode::GT_II:
+        case OpCode::GE_II:
+        case OpCode::LT_II:
+        case OpCode::LE_II:
+        case OpCode::MOVE_I:
+        case OpCode::MOVE_R: {
+            // Registers must be in range and at most one source may be a
+            // constant, which is materialized into the constants table.
+            if (!int_operand) {
+                fast = false;
+                break;
+            }
+            RegisterOperands regs = RegisterOperands::unpack(*int_operand);
+            bool binary = instr.op != OpCode::MOVE_R && instr.op != OpCode::MOVE_I;
+            bool rhs_const = binary && regs.rhs_const;
+            if (regs.lhs_const && rhs_const) {
+                fast = false;
+                break;
+            }
+            auto source_ok = [&](uint16_t index, bool is_const) {
+                if (!is_const)
+                    return index < slot_count;
+                if (index >= constants.size())
+                    return false;
+                add_constant(constants[index]);
+                return true;
+            };
+            fast = source_ok(regs.lhs, regs.lhs_const) && (!binary || source_ok(regs.rhs, rhs_const)) &&
+                   (regs.push || regs.dst < slot_count);
+            d.arg = *int_operand;
+            break;
+        }
+        case OpCode::GUARD_INT:
+        case OpCode::STORE_LOCAL_I:
+            fast = int_operand && *int_operand >= 0 && static_cast<size_t>(*int_operand) < slot_count;
+            if (fast)
+                d.arg = *int_operand;
+            break;
+        case OpCode::INC_I:
+        case OpCode::INC_II:
+            fast = int_operand && IncrementOperands::unpack(*int_operand).slot < slot_count;
+            if (fast)
+                d.arg = *int_operand;
+            break;
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::PERCENT:
+        case OpCode::EQ:
+        case OpCode::NE:
+        case OpCode::GT:
+        case OpCode::GE:
+        case OpCode::LT:
+        case OpCode::LE:
+        case OpCode::NOT:
+        case OpCode::POP:
+        case OpCode::DUP:
+        case OpCode::RET:
+        case OpCode::LOOP_START:
+        case OpCode::NOP:
+        case OpCode::LOAD_INDEX:
+        case OpCode::LOAD_INDEX_I:
+        case OpCode::FOR_ITER:
+            break;
+        default:
+            fast = false;
+            break;
+        }
+
+        d.op = fast ? instr.op : SLOW_PATH;
+        if (handlers)
+            d.handler = handlers[static_cast<size_t>(d.op)];
+    }
+
+    DecodedInstruction& end = code.back();
+    end.op = END_OF_CODE;
+    if (handlers)
+        end.handler = handlers[0];
+    fold_literals(bytecode, decoded, handlers);
+    return decoded;
+}
+
+} // namespace
+
+void VM::reset_dispatch_cache() {
+    decoded_.clear();
+    for (auto& frame : frames_) {
+        frame.decoded = nullptr;
+    }
+}
+
+DecodedCode* VM::decoded_for(CallFrame& frame, const void* const* handlers) {
+    if (!frame.decoded) {
+        auto it = decoded_.find(frame.bytecode);
+        if (it == decoded_.end()) {
+            it = decoded_
+                     .emplace(frame.bytecode, decode(*frame.bytecode, frame.slot_count, global_index_slots_, globals_, constants_,
+                                                  global_functions_, handlers))
+                     .first;
+        }
+        frame.decoded = &it->second;
+    }
+    return frame.decoded;
+}
+
+// Counts one entry or loop iteration of `body` and compiles it the first
+// time the count passes the threshold. True once native code exists.
+bool VM::jit_hot(DecodedCode& body, const CallFrame& frame) {
+    if (body.native)
+        return true;
+    if (body.jit_tried || ++body.hotness < jit_threshold_)
+        return false;
+    body.jit_tried = true;
+    body.native = JitCode::compile(*frame.bytecode, frame.slot_count, constant_pool_, global_index_slots_);
+    return body.native != nullptr;
+}
+
+// Runs frames until the frame count drops to `floor`, the current frame runs
+// off the end of its bytecode, or an exception escapes. Hot opcodes are
+// handled inline with the stack pointer, instruction pointer and slot base
+// held in locals; everything else is synced back to the VM and executed by
+// execute_instruction, so both paths share one definition of each opcode's
+// full semantics.
+void VM::dispatch(size_t floor) {
+#ifdef ALPHABET_COMPUTED_GOTO
+    // Label addresses never change, so each thread fills the table once.
+    // Lambdas run by builtins and streams enter dispatch once per call.
+    static thread_local const void* handlers[HANDLER_COUNT];
+    if (!handlers[0]) {
+        std::fill(std::begin(handlers), std::end(handlers), &&op_slow);
+        handlers[0] = &&op_end;
+#define SET_HANDLER(name) handlers[static_cast<size_t>(OpCode::name)] = &&op_##name
+        SET_HANDLER(PUSH_CONST);
+        SET_HANDLER(LOAD_VAR);
+        SET_HANDLER(STORE_VAR);
+        SET_HANDLER(LOAD_LOCAL);
+        SET_HANDLER(STORE_LOCAL);
+        SET_HANDLER(ADD);
+        SET_HANDLER(SUB);
+        SET_HANDLER(MUL);
+        SET_HANDLER(DIV);
+        SET_HANDLER(PERCENT);
+        SET_HANDLER(EQ);
+        SET_HANDLER(NE);
+        SET_HANDLER(GT);
+        SET_HANDLER(GE);
+        SET_HANDLER(LT);
+        SET_HANDLER(LE);
+        SET_HANDLER(NOT);
+        SET_HANDLER(JUMP);
+        SET_HANDLER(JUMP_IF_FALSE);
+        SET_HANDLER(JUMP_IF_TRUE);
+        SET_HANDLER(BREAK_JUMP);
+        SET_HANDLER(CONTINUE_JUMP);
+        SET_HANDLER(LOOP_START);
+        SET_HANDLER(NOP);
+        SET_HANDLER(POP);
+        SET_HANDLER(DUP);
+        SET_HANDLER(CALL);
+        SET_HANDLER(TAIL_CALL);
+        SET_HANDLER(CALL_BUILTIN);
+        SET_HANDLER(RET);
+        SET_HANDLER(FOR_ITER);
+        SET_HANDLER(ADD_R);
+        SET_HANDLER(SUB_R);
+        SET_HANDLER(MUL_R);
+        SET_HANDLER(DIV_R);
+        SET_HANDLER(PERCENT_R);
+        SET_HANDLER(EQ_R);
+        SET_HANDLER(NE_R);
+        SET_HANDLER(GT_R);
+        SET_HANDLER(GE_R);
+        SET_HANDLER(LT_R);
+        SET_HANDLER(LE_R);
+        SET_HANDLER(MOVE_R);
+        SET_HANDLER(ADD_I);
+        SET_HANDLER(SUB_I);
+        SET_HANDLER(LT_I);
+        SET_HANDLER(LE_I);
+        SET_HANDLER(INC_I);
+        SET_HANDLER(GUARD_INT);
+        SET_HANDLER(ADD_II);
+        SET_HANDLER(SUB_II);
+        SET_HANDLER(MUL_II);
+        SET_HANDLER(PERCENT_II);
+        SET_HANDLER(EQ_II);
+        SET_HANDLER(NE_II);
+        SET_HANDLER(GT_II);
+        SET_HANDLER(GE_II);
+        SET_HANDLER(LT_II);
+        SET_HANDLER(LE_II);
+        SET_HANDLER(INC_II);
+        SET_HANDLER(STORE_LOCAL_I);
+        SET_HANDLER(MOVE_I);
+        SET_HANDLER(LOAD_INDEX);
+        SET_HANDLER(LOAD_INDEX_I);
+        SET_HANDLER(LOAD_FIELD);
+        SET_HANDLER(STORE_FIELD);
+        SET_HANDLER(GET_STATIC);
+        SET_HANDLER(SET_STATIC);
+#undef SET_HANDLER
+#define SET_QUICK_HANDLER(name) handlers[static_cast<size_t>(name)] = &&op_##name
+        SET_QUICK_HANDLER(ADD_DOUBLE);
+        SET_QUICK_HANDLER(SUB_DOUBLE);
+        SET_QUICK_HANDLER(MUL_DOUBLE);
+        SET_QUICK_HANDLER(LT_DOUBLE);
+        SET_QUICK_HANDLER(LE_DOUBLE);
+        SET_QUICK_HANDLER(GT_DOUBLE);
+        SET_QUICK_HANDLER(GE_DOUBLE);
+        SET_QUICK_HANDLER(ADD_STRING);
+        SET_QUICK_HANDLER(LOAD_INDEX_LIST_INT);
+        SET_QUICK_HANDLER(LOAD_INDEX_MAP_STRING);
+        SET_QUICK_HANDLER(PUSH_LITERAL);
+#undef SET_QUICK_HANDLER
+    }
+#define TARGET(name)                                                                                                   \
+    case static_cast<uint8_t>(OpCode::name):                                                                           \
+    op_##name:
+#define QUICK_TARGET(name)                                                                                             \
+    case static_cast<uint8_t>(name):                                                                                   \
+    op_##name:
+#define DISPATCH() goto* ip->handler
+#else
+    const void* const* handlers = nullptr;
+#define TARGET(name) case static_cast<uint8_t>(OpCode::name):
+#define QUICK_TARGET(name) case static_cast<uint8_t>(name):
+#define DISPATCH() continue
+#endif
+// Rewrites the current instruction and runs it again in its new form.
+#define QUICKEN(to)                                                                                                    \
+    if (ip->quicken_misses < QUICKEN_MISS_LIMIT) {                                                                     \
+        rewrite(*ip, to, handlers);                                                                                    \
+        DISPATCH();                                                                                                    \
+    }
+#define UNQUICKEN(to)                                                                                                  \
+    ++ip->quicken_misses;                                                                                              \
+    rewrite(*ip, to, handlers);                                                                                        \
+    DISPATCH()
+#define NEXT()                                                                                                         \
+    ++ip;                                                                                                              \
+    DISPATCH()
+#define NEED(n)                                                                                                        \
+    if (sp - stack_base < static_cast<ptrdiff_t>(n))                                                                   \
+    goto op_slow
+#define ROOM()                                                                                                         \
+    if (sp == stack_limit)                                                                                             \
+    goto op_slow
+// Native code for the current body can start at ip (counting it as hot).
+#define JIT_READY()                                                                                                    \
+    (jit_enabled_ && (body->native || jit_hot(*body, *fr)) && body->native->can_enter(static_cast<size_t>(ip - code)))
+
+    Value* const stack_base = stack_.get();
+    Value* const stack_limit = stack_base + STACK_MAX;
+
+    CallFrame* fr = nullptr;
+    DecodedCode* body = nullptr;
+    DecodedInstruction* code = nullptr;
+    DecodedInstruction* ip = nullptr;
+    Value* sp = nullptr;
+    Value* slots = nullptr;
+
+reload:
+    if (frames_.size() <= floor)
+        return;
+    fr = &frames_.back();
+    body = decoded_for(*fr, handlers);
+    code = body->code.data();
+    if (fr->ip >= fr->bytecode->size())
+        return;
+    ip = code + fr->ip;
+    sp = stack_ptr_;
+    slots = locals_.data() + fr->slot_base;
+    if (CycleCollector::due())
+        CycleCollector::collect();
+    if (fr->ip == 0 && JIT_READY())
+        goto run_native;
+
+#ifdef ALPHABET_COMPUTED_GOTO
+    DISPATCH();
+#endif
+    for (;;) {
+        switch (static_cast<uint8_t>(ip->op)) {
+        TARGET(PUSH_CONST) {
+            ROOM();
+            *sp++ = body->constants[ip->site];
+            NEXT();
+        }
+
+        TARGET(LOAD_LOCAL) {
+            ROOM();
+            *sp++ = slots[ip->arg];
+            NEXT();
+        }
+
+        TARGET(STORE_LOCAL) {
+            NEED(1);
+            slots[ip->arg] = sp[-1];
+            NEXT();
+        }
+
+        TARGET(LOAD_VAR) {
+            ROOM();
+            if (ip->arg == SELF_VAR) {
+                *sp++ = fr->self;
+                NEXT();
+            }
+            if (const Value* global = globals_.find(static_cast<uint32_t>(ip->arg))) {
+                *sp++ = *global;
+                NEXT();
+            }
+            // Undefined name: unqualified field access inside a method.
+            if (ip->site && fr->self.is_object())
+                goto op_slow;
+            *sp++ = Value();
+            NEXT();
+        }
+
+        TARGET(STORE_VAR) {
+            NEED(1);
+            uint32_t slot = static_cast<uint32_t>(ip->arg);
+            if ((ip->site && fr->self.is_object()) || globals_.is_const(slot))
+                goto op_slow;
+            globals_.set(slot, sp[-1]);
+            NEXT();
+        }
+
+        TARGET(GET_STATIC) {
+            // The site remembers the slot of the last class it saw.
+            NEED(1);
+            const Value& class_val = sp[-1];
+            if (!class_val.is_number())
+                goto op_slow;
+            uint32_t class_id = static_cast<uint16_t>(class_val.as_number());
+            StaticSite& site = body->static_sites[ip->site];
+            if (class_id != site.class_id) {
+                if (!static_slot(class_val, *site.name, site.slot))
+                    goto op_slow;
+                site.class_id = class_id;
+            }
+            const Value* field = globals_.find(site.slot);
+            sp[-1] = field ? *field : Value();
+            NEXT();
+        }
+
+        TARGET(SET_STATIC) {
+            NEED(2);
+            const Value& class_val = sp[-2];
+            if (!class_val.is_number())
+                goto op_slow;
+            uint32_t class_id = static_cast<uint16_t>(class_val.as_number());
+            StaticSite& site = body->static_sites[ip->site];
+            if (class_id != site.class_id) {
+                if (!static_slot(class_val, *site.name, site.slot))
+                    goto op_slow;
+                site.class_id = class_id;
+            }
+            globals_.set(site.slot, sp[-1]);
+            sp[-2] = std::move(sp[-1]);
+            --sp;
+            NEXT();
+        }
+
+        TARGET(ADD) {
+            NEED(2);
+            Value& a = sp[-2];
+            const Value& b = sp[-1];
+            int64_t r;
+            if (a.is_integer() && b.is_integer()) {
+                // Overflow leaves the operands for the slow path's double fallback.
+                if (!checked_add(a.as_integer(), b.as_integer(), r))
+                    goto op_slow;
+                a = Value(r);
+            } else if (a.is_number() && b.is_number()) {
+                if (is_double(a) && is_double(b)) {
+                    QUICKEN(ADD_DOUBLE);
+                }
+                a = Value(a.as_number() + b.as_number());
+            } else if (a.is_string() && b.is_string()) {
+                QUICKEN(ADD_STRING);
+                goto op_slow;
+            } else {
+                goto op_slow;
+            }
+            --sp;
+            NEXT();
+        }
+
+        TARGET(SUB) {
+            NEED(2);
+            Value& a = sp[-2];
+            const Value& b = sp[-1];
+            int64_t r;
+            if (a.is_integer() && b.is_integer()) {
+                // Overflow leaves the operands for the slow path's double fallback.
+                if (!checked_sub(a.as_integer(), b.as_integer(), r))
+                    goto op_slow;
+                a = Value(r);
+            } else if (a.is_number() && b.is_number()) {
+                if (is_double(a) && is_double(b)) {
+                    QUICKEN(SUB_DOUBLE);
+                }
+                a = Value(a.as_number() - b.as_number());
+            } else {
+                goto op_slow;
+            }
+            --sp;
+            NEXT();
+        }
+
+        TARGET(MUL) {
+            NEED(2);
+            Value& a = sp[-2];
+            const Value& b = sp[-1];
+            int64_t r;
+            if (a.is_integer() && b.is_integer()) {
+                // Overflow leaves the operands for the slow path's double fallback.
+                if (!checked_mul(a.as_integer(), b.as_integer(), r))
+                    goto op_slow;
+                a = Value(r);
+            } else if (a.is_number() && b.is_number()) {
+                if (is_double(a) && is_double(b)) {
+                    QUICKEN(MUL_DOUBLE);
+                }
+                a = Value(a.as_number() * b.as_number());
+            } else {
+                goto op_slow;
+            }
+            --sp;
+            NEXT();
+        }
+
+        TARGET(DIV) {
+            NEED(2);
+            Value& a = sp[-2];
+            const Value& b = sp[-1];
+            if (!a.is_number() || !b.is_number() || b.as_number() == 0)
+                goto op_slow;
+            a = Value(a.as_number() / b.as_number());
+            --sp;
+            NEXT();
+        }
+
+        TARGET(PERCENT) {
+            NEED(2);
+            Value& a = sp[-2];
+            const Value& b = sp[-1];
+            if (!a.is_number() || !b.is_number() || a.is_integer() != b.is_integer())
+                goto op_slow;
+            if (a.is_integer()) {
+                if (b.as_integer() == 0 || b.as_integer() == -1)
+                    goto op_slow;
+                a = Value(a.as_integer() % b.as_integer());
+            } else {
+                a = Value(std::fmod(a.as_number(), b.as_number()));
+            }
+            --sp;
+            NEXT();
+        }
+
+#define COMPARE(name, op, quick)                                                                                       \
+    TARGET(name) {                                                                                                     \
+        NEED(2);                                                                                                       \
+        Value& a = sp[-2];                                                                                             \
+        const Value& b = sp[-1];                                                                                       \
+        if (a.is_integer() && b.is_integer()) {                                                                        \
+            a = Value(a.as_integer() op b.as_integer());                                                               \
+        } else if (a.is_number() && b.is_number()) {                                                                   \
+            if (is_double(a) && is_double(b)) {                                                                        \
+                QUICKEN(quick);                                                                                        \
+            }                                                                                                          \
+            a = Value(a.as_number() op b.as_number());                                                                 \
+        } else {                                                                                                       \
+            goto op_slow;                                                                                              \
+        }                                                                                                              \
+        --sp;                                                                                                          \
+        NEXT();                                                                                                        \
+    }
+            COMPARE(LT, <, LT_DOUBLE)
+            COMPARE(LE, <=, LE_DOUBLE)
+            COMPARE(GT, >, GT_DOUBLE)
+            COMPARE(GE, >=, GE_DOUBLE)
+#undef COMPARE
+
+        // Quickened forms of the generic operators above.
+#define DOUBLE_OP(name, op, generic)                                                                                   \
+    QUICK_TARGET(name) {                                                                                               \
+        NEED(2);                                                                                                       \
+        Value& a = sp[-2];                                                                                             \
+        const Value& b = sp[-1];                                                                                       \
+        if (!is_double(a) || !is_double(b)) {                                                                          \
+            UNQUICKEN(OpCode::generic);                                                                                \
+        }                                                                                                              \
+        a = Value(a.raw_number() op b.raw_number());                                                                   \
+        --sp;                                                                                                          \
+        NEXT();                                                                                                        \
+    }
+            DOUBLE_OP(ADD_DOUBLE, +, ADD)
+            DOUBLE_OP(SUB_DOUBLE, -, SUB)
+            DOUBLE_OP(MUL_DOUBLE, *, MUL)
+            DOUBLE_OP(LT_DOUBLE, <, LT)
+            DOUBLE_OP(LE_DOUBLE, <=, LE)
+            DOUBLE_OP(GT_DOUBLE, >, GT)
+            DOUBLE_OP(GE_DOUBLE, >=, GE)
+#undef DOUBLE_OP
+
+        QUICK_TARGET(ADD_STRING) {
+            NEED(2);
+            if (!sp[-2].is_string() || !sp[-1].is_string()) {
+                UNQUICKEN(OpCode::ADD);
+            }
+            sp[-2] = Value(sp[-2].as_string() + sp[-1].as_string());
+            *--sp = Value();
+            NEXT();
+        }
+
+        TARGET(LOAD_INDEX) {
+            NEED(2);
+            if (sp[-2].is_list() && sp[-1].is_integer()) {
+                QUICKEN(LOAD_INDEX_LIST_INT);
+            } else if (sp[-2].is_map() && sp[-1].is_string()) {
+                QUICKEN(LOAD_INDEX_MAP_STRING);
+            }
+            goto op_slow;
+        }
+
+        QUICK_TARGET(LOAD_INDEX_LIST_INT) {
+            NEED(2);
+            if (!sp[-2].is_list() || !sp[-1].is_integer()) {
+                UNQUICKEN(OpCode::LOAD_INDEX);
+            }
+            sp[-2] = list_item(sp[-2].as_list(), sp[-1].raw_integer());
+            *--sp = Value();
+            NEXT();
+        }
+
+        QUICK_TARGET(LOAD_INDEX_MAP_STRING) {
+            NEED(2);
+            if (!sp[-2].is_map() || !sp[-1].is_string()) {
+                UNQUICKEN(OpCode::LOAD_INDEX);
+            }
+            {
+                const Value::Map& map = sp[-2].as_map();
+                auto it = map.find(sp[-1].as_string());
+                Value item = it != map.end() ? it->second : Value();
+                sp[-2] = std::move(item);
+            }
+            *--sp = Value();
+            NEXT();
+        }
+
+        QUICK_TARGET(PUSH_LITERAL) {
+            ROOM();
+            *sp++ = clone_literal(body->constants[ip->site]);
+            ip = code + ip->arg;
+            DISPATCH();
+        }
+
+        TARGET(EQ) {
+            NEED(2);
+            bool equal = sp[-2] == sp[-1];
+            sp[-2] = Value(equal);
+            *--sp = Value();
+            NEXT();
+        }
+
+        TARGET(NE) {
+            NEED(2);
+            bool equal = sp[-2] == sp[-1];
+            sp[-2] = Value(!equal);
+            *--sp = Value();
+            NEXT();
+        }
+
+        TARGET(NOT) {
+            NEED(1);
+            sp[-1] = Value(is_falsy(sp[-1]));
+            NEXT();
+        }
+
+        TARGET(JUMP)
+        TARGET(BREAK_JUMP)
+        TARGET(CONTINUE_JUMP) {
+            ip = code + ip->arg;
+            DISPATCH();
+        }
+
+        TARGET(JUMP_IF_FALSE) {
+            NEED(1);
+            bool take = is_falsy(sp[-1]);
+            *--sp = Value();
+            ip = take ? code + ip->arg : ip + 1;
+            DISPATCH();
+        }
+
+        TARGET(JUMP_IF_TRUE) {
+            NEED(1);
+            bool take = !is_falsy(sp[-1]);
+            *--sp = Value();
+            ip = take ? code + ip->arg : ip + 1;
+            DISPATCH();
+        }
+
+        TARGET(LOOP_START) {
+            if (CycleCollector::due())
+                CycleCollector::collect();
+            if (JIT_READY())
+                goto run_native;
+            NEXT();
+        }
+
+        TARGET(NOP) {
+            NEXT();
+        }
+
+        run_native:
+            ip = code + body->native->run(static_cast<size_t>(ip - code), slots, sp, stack_base, stack_limit, globals_);
+            DISPATCH();
+
+        TARGET(POP) {
+            NEED(1);
+            *--sp = Value();
+            NEXT();
+        }
+
+        TARGET(DUP) {
+            NEED(1);
+            ROOM();
+            *sp = sp[-1];
+            ++sp;
+            NEXT();
+        }
+
+        TARGET(CALL)
+        TARGET(TAIL_CALL) {
+            // Fast paths: a direct call of a global function linked at decode
+            // time, and a method call on an object through the site's cache
+            // over class vtables. Everything else (builtins, z.*, lambdas
+            // held in variables, static and super calls) is slow. A tail call
+            // whose frame is reusable replaces it, so the RET after it never
+            // runs in this frame.
+            size_t argc = static_cast<size_t>(ip->arg);
+            NEED(argc + 1);
+            Value* callee = sp - argc - 1;
+            const CompiledMethod* method;
+            Value self;
+            CallSite& site = body->call_sites[ip->site];
+            if (callee->is_null()) {
+                method = site.callee;
+                if (!method)
+                    goto op_slow;
+            } else if (callee->is_object()) {
+                uint16_t class_id = static_cast<const AlphabetObject*>(callee->cell())->class_id;
+                method = site.cache.find(class_id);
+                if (!method) {
+                    const ClassLink* link = class_link(class_id);
+                    if (!link)
+                        goto op_slow;
+                    auto it = link->vtable.find(*site.name);
+                    if (it == link->vtable.end())
+                        goto op_slow;
+                    method = it->second;
+                    site.cache.add(class_id, method);
+                }
+                self = std::move(*callee);
+            } else {
+                goto op_slow;
+            }
+            fr->ip = static_cast<size_t>(ip - code) + 1;
+            stack_ptr_ = sp;
+            if (site.line > 0)
+                last_line_ = site.line;
+            if (ip->op == OpCode::TAIL_CALL && fr->reusable())
+                pop_frame();
+            push_frame(*method, callee + 1, argc, std::move(self));
+            // Arguments were moved into the new frame; only null husks remain.
+            stack_ptr_ = callee;
+            goto reload;
+        }
+
+        TARGET(CALL_BUILTIN) {
+            // Builtins work on the VM's own stack and may call back into
+            // lambdas or raise, so sync state around the table call.
+            BuiltinCall call = BuiltinCall::unpack(ip->arg);
+            fr->ip = static_cast<size_t>(ip - code) + 1;
+            stack_ptr_ = sp;
+            if (int line = body->line_at(static_cast<size_t>(ip - code)))
+                last_line_ = line;
+            (this->*BUILTIN_TABLE[call.id])(static_cast<int>(call.arg_count));
+            goto reload;
+        }
+
+        TARGET(RET) {
+            NEED(1);
+            {
+                Value result = std::move(*--sp);
+                if (fr->push_post_action_on_return)
+                    result = fr->post_action_value;
+                stack_ptr_ = sp;
+                pop_frame();
+                if (!frames_.empty())
+                    *stack_ptr_++ = std::move(result);
+            }
+            goto reload;
+        }
+
+        TARGET(FOR_ITER) {
+            NEED(1);
+            ROOM();
+            {
+                IteratorCell* it = sp[-1].as_iterator();
+                // Stream stages run lambdas, which the slow path can call.
+                if (!it || !it->stages.empty())
+                    goto op_slow;
+                // The loop's variable still holds the iterator.
+                Value item;
+                bool more = it->advance(item);
+                sp[-1] = std::move(item);
+                *sp++ = Value(more);
+            }
+            NEXT();
+        }
+
+        TARGET(LOAD_FIELD) {
+            NEED(1);
+            if (!sp[-1].is_object())
+                goto op_slow;
+            {
+                FieldSite& site = body->field_sites[ip->site];
+                const auto* obj = static_cast<const AlphabetObject*>(sp[-1].cell());
+                int slot;
+                if (const FieldCache::Entry* hit = site.cache.find(obj->shape)) {
+                    slot = static_cast<int>(hit->slot);
+                } else {
+                    slot = obj->shape->find(*site.name);
+                    if (slot < 0)
+                        goto op_slow;
+                    site.cache.add(obj->shape, nullptr, static_cast<uint32_t>(slot));
+                }
+                // Copy before overwriting the receiver, which may own the field.
+                Value field = obj->slots[slot];
+                sp[-1] = std::move(field);
+            }
+            NEXT();
+        }
+
+        TARGET(STORE_FIELD) {
+            NEED(2);
+            if (!sp[-2].is_object())
+                goto op_slow;
+            {
+                FieldSite& site = body->field_sites[ip->site];
+                auto* obj = const_cast<AlphabetObject*>(static_cast<const AlphabetObject*>(sp[-2].cell()));
+                const FieldCache::Entry* hit = site.cache.find(obj->shape);
+                if (!hit) {
+                    int slot = obj->shape->find(*site.name);
+                    if (slot >= 0) {
+                        site.cache.add(obj->shape, nullptr, static_cast<uint32_t>(slot));
+                    } else {
+                        site.cache.add(obj->shape, obj->shape->with_field(*site.name),
+                                             static_cast<uint32_t>(obj->shape->size()));
+                    }
+                    hit = site.cache.find(obj->shape);
+                }
+                if (!hit) {
+                    obj->set_field(*site.name, sp[-1]);
+                } else if (hit->next) {
+                    obj->shape = hit->next;
+                    obj->slots.push_back(sp[-1]);
+                } else {
+                    obj->slots[hit->slot] = sp[-1];
+                }
+                // The assigned value is the result of the expression.
+                sp[-2] = std::move(sp[-1]);
+                --sp;
+            }
+            NEXT();
+        }
+
+        // Register forms. Sources are read in place; the result goes to a
+        // slot or, with the PUSH flag, onto the stack.
+#define REG_LHS() ((ip->arg & RegisterOperands::LHS_CONST) ? body->constants[ip->site] : slots[static_cast<uint16_t>(ip->arg >> 16)])
+#define REG_RHS() ((ip->arg & RegisterOperands::RHS_CONST) ? body->constants[ip->site] : slots[static_cast<uint16_t>(ip->arg >> 32)])
+#define REG_PUSHES() ((ip->arg & RegisterOperands::PUSH) != 0)
+#define REG_OUT() (REG_PUSHES() ? sp : slots + static_cast<uint16_t>(ip->arg))
+#define REGISTER_ARITH(name, checked, op)                                                                              \
+    TARGET(name) {                                                                                                     \
+        if (REG_PUSHES())                                                                                              \
+            ROOM();                                                                                                    \
+        const Value& a = REG_LHS();                                                                                    \
+        const Value& b = REG_RHS();                                                                                    \
+        Value* out = REG_OUT();                                                                                        \
+        int64_t r;                                                                                                     \
+        if (a.is_integer() && b.is_integer()) {                                                                        \
+            if (!checked(a.as_integer(), b.as_integer(), r))                                                           \
+                goto op_slow;                                                                                          \
+            *out = Value(r);                                                                                           \
+        } else if (a.is_number() && b.is_number()) {                                                                   \
+            *out = Value(a.as_number() op b.as_number());                                                              \
+        } else {                                                                                                       \
+            goto op_slow;                                                                                              \
+        }                                                                                                              \
+        sp += REG_PUSHES();                                                                                            \
+        NEXT();                                                                                                        \
+    }
+#define REGISTER_COMPARE(name, op)                                                                                     \
+    TARGET(name) {                                                                                                     \
+        if (REG_PUSHES())                                                                                              \
+            ROOM();                                                                                                    \
+        const Value& a = REG_LHS();                                                                                    \
+        const Value& b = REG_RHS();                                                                                    \
+        Value* out = REG_OUT();                                                                                        \
+        if (a.is_integer() && b.is_integer()) {                                                                        \
+            *out = Value(a.as_integer() op b.as_integer());                                                            \
+        } else if (a.is_number() && b.is_number()) {                                                                   \
+            *out = Value(a.as_number() op b.as_number());                                                              \
+        } else {                                                                                                       \
+            goto op_slow;                                                                                              \
+        }                                                                                                              \
+        sp += REG_PUSHES();                                                                                            \
+        NEXT();                                                                                                        \
+    }
+            REGISTER_ARITH(ADD_R, checked_add, +)
+            REGISTER_ARITH(SUB_R, checked_sub, -)
+            REGISTER_ARITH(MUL_R, checked_mul, *)
+            REGISTER_COMPARE(LT_R, <)
+            REGISTER_COMPARE(LE_R, <=)
+            REGISTER_COMPARE(GT_R, >)
+            REGISTER_COMPARE(GE_R, >=)
+            // The integer forms share the handlers: their guard is the integer
+            // test each handler makes first, with numbers as the fallback.
+            REGISTER_ARITH(ADD_I, checked_add, +)
+            REGISTER_ARITH(SUB_I, checked_sub, -)
+            REGISTER_COMPARE(LT_I, <)
+            REGISTER_COMPARE(LE_I, <=)
+#undef REGISTER_ARITH
+#undef REGISTER_COMPARE
+
+        TARGET(DIV_R) {
+            if (REG_PUSHES())
+                ROOM();
+            const Value& a = REG_LHS();
+            const Value& b = REG_RHS();
+            if (!a.is_number() || !b.is_number() || b.as_number() == 0)
+                goto op_slow;
+            *REG_OUT() = Value(a.as_number() / b.as_number());
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(PERCENT_R) {
+            if (REG_PUSHES())
+                ROOM();
+            const Value& a = REG_LHS();
+            const Value& b = REG_RHS();
+            if (!a.is_number() || !b.is_number() || a.is_integer() != b.is_integer())
+                goto op_slow;
+            if (a.is_integer()) {
+                if (b.as_integer() == 0 || b.as_integer() == -1)
+                    goto op_slow;
+                *REG_OUT() = Value(a.as_integer() % b.as_integer());
+            } else {
+                *REG_OUT() = Value(std::fmod(a.as_number(), b.as_number()));
+            }
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(EQ_R) {
+            if (REG_PUSHES())
+                ROOM();
+            bool equal = REG_LHS() == REG_RHS();
+            *REG_OUT() = Value(equal);
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(NE_R) {
+            if (REG_PUSHES())
+                ROOM();
+            bool equal = REG_LHS() == REG_RHS();
+            *REG_OUT() = Value(!equal);
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(MOVE_R) {
+            if (REG_PUSHES())
+                ROOM();
+            *REG_OUT() = REG_LHS();
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(INC_I) {
+            Value& v = slots[static_cast<uint16_t>(ip->arg)];
+            int64_t delta = ip->arg >> 32;
+            int64_t r;
+            if (v.is_integer() && checked_add(v.as_integer(), delta, r)) {
+                v = Value(r);
+            } else if (v.is_number() && !v.is_integer()) {
+                v = Value(v.as_number() + static_cast<double>(delta));
+            } else {
+                goto op_slow;
+            }
+            NEXT();
+        }
+
+        // Strict-mode specialized forms. Integer sources are proven, so they
+        // are read unchecked. Overflow and failed guards take the slow path,
+        // where execute_instruction deoptimizes the frame.
+#define PROVEN_ARITH(name, checked)                                                                                    \
+    TARGET(name) {                                                                                                     \
+        if (REG_PUSHES())                                                                                              \
+            ROOM();                                                                                                    \
+        int64_t r;                                                                                                     \
+        if (!checked(REG_LHS().raw_integer(), REG_RHS().raw_integer(), r))                                             \
+            goto op_slow;                                                                                              \
+        *REG_OUT() = Value(r);                                                                                         \
+        sp += REG_PUSHES();                                                                                            \
+        NEXT();                                                                                                        \
+    }
+#define PROVEN_COMPARE(name, op)                                                                                       \
+    TARGET(name) {                                                                                                     \
+        if (REG_PUSHES())                                                                                              \
+            ROOM();                                                                                                    \
+        *REG_OUT() = Value(REG_LHS().raw_integer() op REG_RHS().raw_integer());                                        \
+        sp += REG_PUSHES();                                                                                            \
+        NEXT();                                                                                                        \
+    }
+            PROVEN_ARITH(ADD_II, checked_add)
+            PROVEN_ARITH(SUB_II, checked_sub)
+            PROVEN_ARITH(MUL_II, checked_mul)
+            PROVEN_COMPARE(EQ_II, ==)
+            PROVEN_COMPARE(NE_II, !=)
+            PROVEN_COMPARE(GT_II, >)
+            PROVEN_COMPARE(GE_II, >=)
+            PROVEN_COMPARE(LT_II, <)
+            PROVEN_COMPARE(LE_II, <=)
+#undef PROVEN_ARITH
+#undef PROVEN_COMPARE
+
+        TARGET(PERCENT_II) {
+            if (REG_PUSHES())
+                ROOM();
+            int64_t a = REG_LHS().raw_integer();
+            int64_t b = REG_RHS().raw_integer();
+            if (b == 0 || b == -1)
+                goto op_slow;
+            *REG_OUT() = Value(a % b);
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(MOVE_I) {
+            if (REG_PUSHES())
+                ROOM();
+            const Value& v = REG_LHS();
+            if (!v.is_integer())
+                goto op_slow;
+            *REG_OUT() = v;
+            sp += REG_PUSHES();
+            NEXT();
+        }
+
+        TARGET(INC_II) {
+            Value& v = slots[static_cast<uint16_t>(ip->arg)];
+            int64_t r;
+            if (!checked_add(v.raw_integer(), ip->arg >> 32, r))
+                goto op_slow;
+            v = Value(r);
+            NEXT();
+        }
+
+        TARGET(GUARD_INT) {
+            if (!slots[ip->arg].is_integer())
+                goto op_slow;
+            NEXT();
+        }
+
+        TARGET(STORE_LOCAL_I) {
+            NEED(1);
+            if (!sp[-1].is_integer())
+                goto op_slow;
+            slots[ip->arg] = sp[-1];
+            NEXT();
+        }
+
+        TARGET(LOAD_INDEX_I) {
+            NEED(2);
+            if (!sp[-2].is_list())
+                goto op_slow;
+            sp[-2] = list_item(sp[-2].as_list(), sp[-1].raw_integer());
+            *--sp = Value();
+            NEXT();
+        }
+#undef REG_LHS
+#undef REG_RHS
+#undef REG_PUSHES
+#undef REG_OUT
+
+        case static_cast<uint8_t>(END_OF_CODE):
+#ifdef ALPHABET_COMPUTED_GOTO
+        op_end:
+#endif
+            fr->ip = static_cast<size_t>(ip - code);
+            stack_ptr_ = sp;
+            return;
+
+        default:
+        op_slow:
+            fr->ip = static_cast<size_t>(ip - code);
+            stack_ptr_ = sp;
+            if (int line = body->line_at(static_cast<size_t>(ip - code)))
+                last_line_ = line;
+            execute_instruction(*fr);
+            goto reload;
+        }
+    }
+
+#undef TARGET
+#undef QUICK_TARGET
+#undef QUICKEN
+#undef UNQUICKEN
+#undef DISPATCH
+#undef NEXT
+#undef NEED
+#undef ROOM
+#undef JIT_READY
+}
+
+} // namespace alphabet
@@ -31,12 +31,20 @@ inline void run(const std::string& source) {
     Parser parser(tokens, source);
     auto stmts = parser.parse();
     Compiler compiler;
+    compiler.set_strict_mode(lexer.is_strict());
     auto program = compiler.compile(stmts);
     VM vm(program);
     vm.run();
 }
 
-inline std::string run_capture(const std::string& source) {
+// How run_capture compiles and runs a program; the defaults match the CLI.
+struct RunOptions {
+    int opt_level = -1;          // -1: the compiler's default
+    int jit = -1;                // -1: the VM's default; 0: off; 1: on from the first entry
+    Program* compiled = nullptr; // receives the program that ran
+};
+
+inline std::string run_capture(const std::string& source, const RunOptions& options = {}) {
     std::ostringstream oss;
     std::streambuf* old = std::cout.rdbuf(oss.rdbuf());
     try {
@@ -45,8 +53,17 @@ inline std::string run_capture(const std::string& source) {
         Parser parser(tokens, source);
         auto stmts = parser.parse();
         Compiler compiler;
+        compiler.set_strict_mode(lexer.is_strict());
+        if (options.opt_level >= 0)
+            compiler.set_opt_level(options.opt_level);
         auto program = compiler.compile(stmts);
+        if (options.compiled)
+            *options.compiled = program;
         VM vm(program);
+        if (options.jit >= 0) {
+            vm.set_jit_enabled(options.jit == 1);
+            vm.set_jit_threshold(0);
+        }
         vm.run();
     } catch (...) {
         std::cout.rdbuf(old);
@@ -62,6 +79,7 @@ inline std::unordered_map<std::string, Value> run_get_globals(const std::string&
     Parser parser(tokens, source);
     auto stmts = parser.parse();
     Compiler compiler;
+    compiler.set_strict_mode(lexer.is_strict());
     auto program = compiler.compile(stmts);
     VM vm(program);
     vm.run();
@@ -71,6 +71,146 @@ TEST_CASE("Arithmetic: parentheses", "[vm][arithmetic]") {
     REQUIRE(output == "20\n");
 }
 
+TEST_CASE("Arithmetic: integers stay exact and overflow to numbers", "[vm][arithmetic]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 step(5 v) {
+  5 w = v
+  w = w + 1
+  r w
+}
+m 5 count(5 lim) {
+  5 s = 0
+  l (5 k = 0 : k < lim : k = k + 1) {
+    s = s + k
+  }
+  r s
+}
+z.o(9007199254740993)
+z.o(step(9223372036854775806))
+z.o(step(9223372036854775807))
+z.o(step(1.5))
+z.o(count(100))
+z.o(-7 % 3)
+z.o(z.type(42))
+5 a = 3
+i (a > 1) { z.o(1 + 2) } e { z.o(30 * 2) })");
+    REQUIRE(output == "9007199254740993\n9223372036854775807\n9.22337e+18\n2.5\n4950\n-1\nnumber\n3\n");
+}
+
+TEST_CASE("Arithmetic: strict mode specializes proven integers", "[vm][arithmetic]") {
+    std::string output = test::run_capture(R"(#alphabet<en strict>
+m 5 count(5 lim) {
+  5 s
+  l (5 k = 0 : k < lim : k = k + 1) {
+    s = s + k * 2 % 7
+  }
+  r s
+}
+m 5 sum(13 xs, 5 cnt) {
+  5 acc = 0
+  l (5 k = 0 : k < cnt : k = k + 1) {
+    acc = acc + xs[k]
+  }
+  r acc
+}
+m 5 triple(5 v) {
+  5 w = v
+  w = w * 3
+  r w
+}
+z.o(count(100))
+z.o(count(2.5))
+z.o(sum([1, 2, 3], 3))
+z.o(sum([1.5, 2], 2))
+z.o(triple(4))
+z.o(triple(9223372036854775807)))");
+    REQUIRE(output == "296\n6\n6\n3.5\n12\n2.76701e+19\n");
+}
+
+TEST_CASE("Arithmetic: one site sees changing operand types", "[vm][arithmetic]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 1 plus(1 a, 1 b) {
+  r a + b
+}
+m 1 less(1 a, 1 b) {
+  r a < b
+}
+m 1 at(1 c, 1 key) {
+  r c[key]
+}
+l (5 k = 0 : k < 6 : k = k + 1) {
+  z.o(plus(k * 0.5, 0.25))
+  z.o(plus("x", "y"))
+}
+z.o(plus(2, 3))
+z.o(plus("n", 1))
+z.o(less(3.5, 2.5))
+z.o(less(2, 2.5))
+z.o(at([10, 20, 30], -1))
+z.o(at([10, 20, 30], 7))
+z.o(at({"a": 1}, "a"))
+z.o(at([10, 20, 30], 0)))");
+    REQUIRE(output == "0.25\nxy\n0.75\nxy\n1.25\nxy\n1.75\nxy\n2.25\nxy\n2.75\nxy\n5\nn1\nfalse\ntrue\n30\nnull\n1\n10\n");
+}
+
+TEST_CASE("Arithmetic: native code matches the interpreter", "[vm][arithmetic][jit]") {
+    const std::string source = R"(#alphabet<en>
+m 5 sum(5 lim) {
+  5 s = 0
+  l (5 k = 0 : k < lim : k = k + 1) {
+    s = s + k * 2 - k % 3
+  }
+  r s
+}
+m 1 grow(5 lim) {
+  1 v = 1
+  l (5 k = 0 : k < lim : k = k + 1) {
+    v = v * 3
+    i (v >= 100000000000000000000.0) { v = v / 7 }
+  }
+  r v
+}
+m 1 mix(5 lim) {
+  1 v = 0
+  l (5 k = 0 : k < lim : k = k + 1) {
+    i (k == 5) { v = "s" }
+    v = v + 1
+  }
+  r v
+}
+z.o(sum(1000))
+z.o(grow(60))
+z.o(mix(8))
+z.o(sum(-2) == 0))";
+    std::string interpreted = test::run_capture(source, {-1, 0});
+    REQUIRE(interpreted == "998001\n2.14386e+19\ns111\ntrue\n");
+    REQUIRE(test::run_capture(source, {-1, 1}) == interpreted);
+}
+
+TEST_CASE("Globals: native code matches the interpreter", "[vm][variables][jit]") {
+    const std::string source = R"(#alphabet<en>
+5 total = 0
+5 calls = 0
+m 5 bump(5 by) {
+  calls = calls + 1
+  r by
+}
+l (5 idx = 0 : idx < 500 : idx = idx + 1) {
+  total = total + bump(idx)
+}
+z.o(total)
+z.o(calls)
+1 tag = 0
+l (5 idx = 0 : idx < 6 : idx = idx + 1) {
+  i (idx == 3) { tag = "t" }
+  tag = tag + 1
+}
+z.o(tag))";
+    std::string interpreted = test::run_capture(source, {-1, 0});
+    REQUIRE(interpreted == "124750\n500\nt111\n");
+    REQUIRE(test::run_capture(source, {-1, 1}) == interpreted);
+}
+
 // ============================================================================
 // Variable Tests
 // ============================================================================
@@ -114,6 +254,19 @@ TEST_CASE("Comparison: not equal", "[vm][comparison]") {
     REQUIRE(output == "true\n");
 }
 
+TEST_CASE("Value equality by kind", "[vm][comparison]") {
+    REQUIRE(Value(std::string("ab")) == Value(std::string("ab")));
+    REQUIRE(Value(int64_t(2)) == Value(2.0));
+    REQUIRE(Value() == Value(nullptr));
+    REQUIRE(Value(std::string("1")) != Value(int64_t(1)));
+    Value::List items = {Value(1), Value(std::string("x"))};
+    REQUIRE(Value(items) == Value(items));
+    Value obj(make_ref<AlphabetObject>(20));
+    Value same = obj;
+    REQUIRE(obj == same);
+    REQUIRE(obj != Value(make_ref<AlphabetObject>(20)));
+}
+
 // ============================================================================
 // Control Flow Tests
 // ============================================================================
@@ -158,6 +311,78 @@ z.o(result))");
     REQUIRE(output == "24\n");
 }
 
+TEST_CASE("Function locals are per-call", "[vm][functions]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 depth(5 num) {
+  5 here = num
+  i (num > 0) { depth(num - 1) }
+  r here
+}
+z.o(depth(3)))");
+    REQUIRE(output == "3\n");
+}
+
+TEST_CASE("Function locals do not leak into globals", "[vm][functions]") {
+    auto globals = test::run_get_globals(R"(#alphabet<en>
+5 total = 1
+m 5 work() {
+  5 total = 40
+  5 scratch = 2
+  r total + scratch
+}
+5 answer = work())");
+    REQUIRE(globals.at("total").as_number() == 1);
+    REQUIRE(globals.at("answer").as_number() == 42);
+    REQUIRE(globals.find("scratch") == globals.end());
+}
+
+TEST_CASE("Globals and static fields read back by name", "[vm][functions]") {
+    // Both live in the VM's global slots; get_globals() lists them by name.
+    auto globals = test::run_get_globals(R"(#alphabet<en>
+c Counter {
+  s 5 hits = 0
+  12 label = "hits"
+  m 12 describe() {
+    r label + ":" + Counter.hits
+  }
+}
+5 total = 0
+l (5 k = 0 : k < 5 : k = k + 1) {
+  total = total + k
+  Counter.hits = Counter.hits + 2
+}
+5 obj = n Counter()
+12 text = obj.describe()
+5 unset = missing)");
+    REQUIRE(globals.at("total").as_number() == 10);
+    REQUIRE(globals.at("Counter.hits").as_number() == 10);
+    REQUIRE(globals.at("text").as_string() == "hits:10");
+    REQUIRE(globals.at("unset").is_null());
+    REQUIRE(globals.find("missing") == globals.end());
+}
+
+TEST_CASE("Register arithmetic on locals matches stack arithmetic", "[vm][functions]") {
+    // Inside a function these compile to register-form opcodes; at top level
+    // the same expressions use the stack forms.
+    std::string body = R"(
+  5 a = 7
+  5 b = 2
+  12 s = "n="
+  5 q = a / b
+  5 m = a % b
+  s = s + a
+  z.o(q)
+  z.o(m)
+  z.o(a * b - 1)
+  z.o(a >= b)
+  z.o(s)
+)";
+    std::string in_function = test::run_capture("#alphabet<en>\nm 5 calc() {" + body + "  r 0\n}\ncalc()");
+    std::string top_level = test::run_capture("#alphabet<en>\n" + body);
+    REQUIRE(in_function == "3.5\n1\n13\ntrue\nn=7\n");
+    REQUIRE(in_function == top_level);
+}
+
 // ============================================================================
 // List Tests
 // ============================================================================
@@ -259,6 +484,21 @@ TEST_CASE("Built-in type string", "[vm][builtins]") {
     REQUIRE(output == "string\n");
 }
 
+TEST_CASE("Builtins from either end of the builtin table", "[vm][builtins]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 run() {
+  5 total = 0
+  l (5 k = 0 : k < 3 : k = k + 1) {
+    total = total + z.sqrt(16) + z.sum([k, 1])
+  }
+  r total
+}
+z.o(run())
+z.o(z.join(["a", "b"], "-"))
+z.o(z.flatten_str([["x"], ["y"]])))");
+    REQUIRE(output == "18\na-b\nxy\n");
+}
+
 // ============================================================================
 // New Built-in Tests
 // ============================================================================
@@ -345,6 +585,412 @@ z.o(p.get_x()))");
     REQUIRE(output == "0\n");
 }
 
+TEST_CASE("Field access through a polymorphic site", "[vm][classes]") {
+    // One LOAD_FIELD site sees more receiver shapes than its cache holds, and
+    // fields added outside the class body land in different slots.
+    std::string output = test::run_capture(R"(#alphabet<en>
+c A { 5 val = 1 }
+c B { 5 pad = 0
+  5 val = 2 }
+c C { 5 val = 3 }
+c D { 5 val = 4 }
+c E { 5 val = 5 }
+5 objs = [n A(), n B(), n C(), n D(), n E()]
+5 first = objs[0]
+first.extra = 10
+5 second = objs[1]
+second.other = 20
+second.extra = 30
+5 total = 0
+l (5 k = 0 : k < 5 : k = k + 1) {
+  5 item = objs[k]
+  total = total + item.val
+}
+z.o(total)
+z.o(first.extra + second.extra + second.other)
+z.o(z.len(objs)))");
+    REQUIRE(output == "15\n60\n5\n");
+}
+
+TEST_CASE("Field initializers run as code", "[vm][classes]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+c Bag {
+  13 items = [1, 2]
+  5 size = 2 * 3
+}
+5 bags = [n Bag(), n Bag()]
+5 first = bags[0]
+z.append(first.items, 3)
+z.o(z.len(bags))
+z.o(z.len(first.items) + first.size)
+5 second = bags[1]
+z.o(z.len(second.items)))");
+    REQUIRE(output == "2\n9\n2\n");
+}
+
+TEST_CASE("Inherited and overridden methods through a polymorphic call site", "[vm][classes]") {
+    // The same CALL sites see more receiver classes than their caches hold;
+    // each must still resolve through the right vtable, as must inherited
+    // constructors.
+    std::string output = test::run_capture(R"(#alphabet<en>
+c Base {
+  5 val = 0
+  m init(5 start) {
+    this.val = start
+  }
+  m get() {
+    r this.val
+  }
+  m twice() {
+    r this.get() * 2
+  }
+}
+c Left ^ Base {
+  m get() {
+    r this.val + 1
+  }
+}
+c Right ^ Base {
+  5 pad = 0
+}
+c Deep ^ Left {
+  m twice() {
+    r 100
+  }
+}
+c Other ^ Right {
+  5 more = 0
+}
+c Last ^ Other {
+  m get() {
+    r 7
+  }
+}
+m 5 sum_all(13 objs) {
+  5 total = 0
+  l (5 k = 0 : k < 6 : k = k + 1) {
+    5 item = objs[k]
+    total = total + item.twice()
+  }
+  r total
+}
+5 objs = [n Base(1), n Left(1), n Right(1), n Deep(1), n Other(1), n Last(1)]
+z.o(sum_all(objs))
+z.o(sum_all(objs)))");
+    REQUIRE(output == "124\n124\n");
+}
+
+TEST_CASE("Constructor and static call arguments bind in order", "[vm][classes]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+c Pair {
+  5 first = 0
+  5 second = 0
+  m init(5 a, 13 items) {
+    this.first = a
+    this.second = items[1]
+  }
+  s m 5 join(5 a, 12 sep, 5 c) {
+    r a + sep + c
+  }
+}
+5 p = n Pair(4, [7, 8], 9)
+5 q = n Pair(1, ["u", "v"])
+z.o(p.first + p.second)
+z.o(q.second)
+z.o(Pair.join(1, "-", 2))
+z.o(Pair.join(3, "+", 4)))");
+    REQUIRE(output == "12\nv\n1-2\n3+4\n");
+}
+
+TEST_CASE("Constant list and map literals are fresh on every execution", "[vm][lists]") {
+    // These literals are built once into templates and cloned per run; a
+    // change to one copy must not reach the next.
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 13 make(5 k) {
+  5 row = [[0], {"key": [5]}, "s", 2.5]
+  z.append(row[0], k)
+  z.append(row[1]["key"], k)
+  r row
+}
+z.o(make(1))
+z.o(make(2))
+5 dup = {"x": 1, "x": 2}
+z.o(dup["x"])
+z.o([])
+z.o({}))");
+    REQUIRE(output == "[[0, 1], {key: [5, 1]}, s, 2.5]\n[[0, 2], {key: [5, 2]}, s, 2.5]\n1\n[]\n{}\n");
+}
+
+TEST_CASE("Runtime errors report the line they were raised on", "[vm][errors]") {
+    // Lines come from the decoded body's run-length table, not from each
+    // instruction, so check one raised from a callee after many calls.
+    std::string source = R"(#alphabet<en>
+m 5 ratio(5 a, 5 q) {
+  5 scaled = a * 2
+  r scaled / q
+}
+5 total = 0
+l (5 k = 5 : k >= 0 : k = k - 1) {
+  total = total + ratio(k, k)
+})";
+    auto stmts = test::parse(source);
+    Compiler compiler;
+    auto program = compiler.compile(stmts);
+    VM vm(program);
+    std::streambuf* old = std::cerr.rdbuf(nullptr);
+    vm.run();
+    std::cerr.rdbuf(old);
+    REQUIRE(vm.get_unhandled_error().find("Division by zero") != std::string::npos);
+    REQUIRE(vm.get_last_line() == 4);
+}
+
+TEST_CASE("Every optimization level runs a program the same way", "[vm][optimizer]") {
+    // Constant branches, code after return and break, jumps across folded
+    // code and try handlers, all at -O0, -O1 and -O2.
+    const std::string source = R"(#alphabet<en>
+m 5 pick(5 k) {
+  i (2 * 3 > 5) { r k + 1 } e { r k - 1 }
+  z.o("unreachable")
+}
+5 total = 0
+l (5 k = 0 : k < 6 : k = k + 1) {
+  i (!(k % 2 == 0)) { k }
+  i (k > 3) {
+    b
+    5 dead = total + 100
+  }
+  total = total + pick(k) + 2 * 3 - 1.5
+}
+t {
+  i ("" == "") { total = total + z.len("ab" + "cd" + 5) }
+  z.o(1 / 0)
+} h (12 err) {
+  z.o("caught")
+}
+z.o(total)
+i (0) { z.o("no") } e { z.o("yes") })";
+    Program program0, program1, program2;
+    std::string output = test::run_capture(source, {0, -1, &program0});
+    REQUIRE(output == "caught\n18\nyes\n");
+    REQUIRE(test::run_capture(source, {1, -1, &program1}) == output);
+    REQUIRE(test::run_capture(source, {2, -1, &program2}) == output);
+    for (const Program* program : {&program1, &program2}) {
+        for (const Instruction& instr : program->main)
+            REQUIRE(instr.op != OpCode::NOP);
+    }
+    REQUIRE(program1.main.size() < program0.main.size());
+    REQUIRE(program2.main.size() <= program1.main.size());
+}
+
+TEST_CASE("Loop invariants move out of function loops at -O2", "[vm][optimizer]") {
+    // z.len of an untouched list and a * q leave the loop; z.len of a list
+    // the loop shrinks stays, and a division in a loop that never runs
+    // raises nothing.
+    const std::string source = R"(#alphabet<en>
+m 5 scan(13 lst, 5 a, 5 q) {
+  5 total = 0
+  l (5 ix = 0 : ix < z.len(lst) : ix = ix + 1) {
+    total = total + lst[ix] * (a * q)
+  }
+  r total
+}
+m 5 drain(13 lst) {
+  5 cnt = 0
+  l (z.len(lst) > 0) {
+    z.pop_back(lst)
+    cnt = cnt + 1
+  }
+  r cnt
+}
+m 5 never(5 a, 5 q) {
+  5 xx = 0
+  l (5 ix = 0 : ix < 0 : ix = ix + 1) { xx = a / q }
+  r xx
+}
+13 data = [1, 2, 3, 4]
+z.o(scan(data, 2, 5))
+z.o(drain(data))
+z.o(z.len(data))
+z.o(never(1, 0)))";
+    Program program0, program2;
+    std::string output = test::run_capture(source, {0, -1, &program0});
+    REQUIRE(output == "100\n4\n0\n0\n");
+    REQUIRE(test::run_capture(source, {2, -1, &program2}) == output);
+    const std::vector<Instruction>& body0 = program0.functions["scan"].bytecode;
+    const std::vector<Instruction>& body2 = program2.functions["scan"].bytecode;
+    auto in_loop = [](const std::vector<Instruction>& body, auto&& match) {
+        bool inside = false;
+        for (const Instruction& instr : body) {
+            if (instr.op == OpCode::LOOP_START)
+                inside = true;
+            else if (inside && match(instr))
+                return true;
+        }
+        return false;
+    };
+    auto is_len = [](const Instruction& instr) {
+        return instr.op == OpCode::CALL_BUILTIN &&
+               BuiltinCall::unpack(std::get<int64_t>(instr.operand)).id ==
+                   static_cast<uint32_t>(builtin_id("len"));
+    };
+    auto is_mul = [](const Instruction& instr) {
+        return instr.op == OpCode::MUL || instr.op == OpCode::MUL_R;
+    };
+    REQUIRE(in_loop(body0, is_len));
+    REQUIRE(in_loop(body0, is_mul));
+    REQUIRE_FALSE(in_loop(body2, is_len));
+    // lst[ix] * (a * q) still multiplies inside; a * q does not.
+    int muls = 0;
+    bool inside = false;
+    for (const Instruction& instr : body2) {
+        if (instr.op == OpCode::LOOP_START)
+            inside = true;
+        else if (inside && is_mul(instr))
+            ++muls;
+    }
+    REQUIRE(muls == 1);
+}
+
+TEST_CASE("Small functions and methods on this are inlined at -O2", "[vm][optimizer]") {
+    // sq, pick and get are copied into their callers; fact calls itself,
+    // shadowed is also a global, and B overrides get for other callers.
+    const std::string source = R"(#alphabet<en>
+m 5 sq(5 v) {
+  r v * v
+}
+m 5 pick(5 a, 5 b) {
+  i (a > b) { r a }
+  r b
+}
+m 5 fact(5 v) {
+  i (v <= 1) { r 1 }
+  r v * fact(v - 1)
+}
+m 5 shadowed(5 v) {
+  r v + 1
+}
+m 5 sum(5 lim) {
+  5 total = 0
+  l (5 ix = 0 : ix < lim : ix = ix + 1) { total = total + sq(ix) + pick(ix, 2) }
+  r total
+}
+m 5 other() {
+  r fact(4) + shadowed(1)
+}
+c A {
+  5 v = 4
+  m 5 get() { r this.v }
+  m 5 twice() { r this.get() * 2 }
+}
+5 shadowed = m(5 v) { r v + 100 }
+z.o(sum(5))
+z.o(other())
+z.o(n A().twice()))";
+    auto calls = [](const std::vector<Instruction>& body) {
+        std::vector<std::string> names;
+        for (const Instruction& instr : body) {
+            if (instr.op == OpCode::CALL)
+                names.push_back(std::get<std::pair<std::string, int>>(instr.operand).first);
+        }
+        return names;
+    };
+    Program program0, program2;
+    std::string output = test::run_capture(source, {0, -1, &program0});
+    REQUIRE(output == "43\n125\n8\n");
+    REQUIRE(test::run_capture(source, {2, -1, &program2}) == output);
+    REQUIRE(calls(program0.functions["sum"].bytecode).size() == 2);
+    REQUIRE(calls(program2.functions["sum"].bytecode).empty());
+    REQUIRE(calls(program2.functions["other"].bytecode) == std::vector<std::string>{"fact", "shadowed"});
+    for (auto& [id, cls] : program2.classes) {
+        if (cls.name == "A")
+            REQUIRE(calls(cls.methods["twice"].bytecode).empty());
+    }
+}
+
+TEST_CASE("Cyclic object graphs are collected", "[vm][classes][gc]") {
+    uint64_t freed_before = CycleCollector::stats().freed;
+    std::string output = test::run_capture(R"(#alphabet<en>
+c Node {
+  5 val = 0
+  15 prev = null
+  15 next = null
+}
+m 5 ring(5 size) {
+  5 head = n Node()
+  5 cur = head
+  l (5 k = 1 : k < size : k = k + 1) {
+    5 nd = n Node()
+    nd.val = k
+    nd.prev = cur
+    cur.next = nd
+    cur = nd
+  }
+  cur.next = head
+  head.prev = cur
+  r head.next.val + head.prev.val
+}
+5 total = 0
+l (5 j = 0 : j < 50 : j = j + 1) {
+  total = total + ring(4)
+}
+5 lst = [1, 2]
+z.append(lst, lst)
+z.o(total)
+z.o(z.len(lst[2])))");
+    REQUIRE(output == "200\n3\n");
+    CycleCollector::collect();
+    REQUIRE(CycleCollector::stats().freed - freed_before >= 201);
+}
+
+TEST_CASE("Repeated string concatenation appends in place", "[vm][strings]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 12 build(5 rows) {
+  12 s = ""
+  l (5 k = 0 : k < rows : k = k + 1) {
+    s = s + k + ","
+  }
+  r s
+}
+12 g = "g"
+l (5 k = 0 : k < 3 : k = k + 1) {
+  g = g + k
+}
+12 first = "qwe"
+12 second = first
+first = first + "!"
+second = second + " q"
+12 c = "c"
+c = c + c + c
+12 d = ""
+d = d + null
+z.o(build(4))
+z.o(g)
+z.o(first + " " + second)
+z.o(c)
+z.o(d)
+z.o(1 + "s"))");
+    REQUIRE(output == "0,1,2,3,\ng012\nqwe! qwe q\nccc\nnull\n1s\n");
+}
+
+TEST_CASE("Shared strings are never changed through another reference", "[vm][strings]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 size(12 text) {
+  r z.len(text)
+}
+12 word = "héllo"
+12 same = z.trim(word)
+z.o(size(word))
+word = word + "!"
+z.o(z.len(word))
+z.o(z.len(same))
+z.o(same == z.substr(same, 0))
+z.o(z.upper(same))
+z.o(same)
+z.o(z.reverse(z.lower("AB")))
+z.o(z.replace(same, "l", "L")))");
+    REQUIRE(output == "5\n6\n5\ntrue\nHéLLO\nhéllo\nba\nhéLLo\n");
+}
+
 // ============================================================================
 // Pattern Matching Tests
 // ============================================================================
@@ -390,15 +1036,128 @@ TEST_CASE("Division by zero is catchable", "[vm][negative][errors]") {
 
 TEST_CASE("Stack overflow handled gracefully", "[vm][negative][errors]") {
     // Recursive function with no base case should not crash the process
-    // It prints "Unhandled exception" and returns normally
+    // It prints "Unhandled exception" and returns normally. The call is not
+    // in tail position, which would reuse the frame and never overflow.
     std::string output = test::run_capture(R"(#alphabet<en>
 m 5 inf() {
-  r inf()
+  r 1 + inf()
 }
 inf())");
     REQUIRE(true);
 }
 
+TEST_CASE("Error inside a hot loop is caught and the loop resumes", "[vm][negative][errors]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 f(5 num) {
+  5 s = 0
+  l (5 i = 0 : i < num : i = i + 1) {
+    t { s = s + 10 / (i - 2) } h (15 e) { s = s + 1000 }
+  }
+  r s
+}
+z.o(f(4)))");
+    REQUIRE(output == "995\n");
+}
+
+TEST_CASE("Deep recursion returns through every frame", "[vm][functions]") {
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 depth(5 num) {
+  i (num == 0) { r 0 }
+  r depth(num - 1) + 1
+}
+z.o(depth(500)))");
+    REQUIRE(output == "500\n");
+}
+
+TEST_CASE("Tail calls run in constant stack", "[vm][functions]") {
+    // Each recursion goes far past the call depth limit. fail's frames are
+    // reused, while guarded keeps its own so its handler still catches.
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 count(5 num, 5 acc) {
+  i (num == 0) { r acc }
+  r count(num - 1, acc + num)
+}
+m 5 is_even(5 v) {
+  i (v == 0) { r 1 }
+  r is_odd(v - 1)
+}
+m 5 is_odd(5 v) {
+  i (v == 0) { r 0 }
+  r is_even(v - 1)
+}
+c Walker {
+  5 steps = 0
+  m 5 walk(5 v) {
+    i (v == 0) { r this.steps }
+    this.steps = this.steps + 1
+    r this.walk(v - 1)
+  }
+}
+m 5 fail(5 v) {
+  i (v == 0) { z.t("done") }
+  r fail(v - 1)
+}
+m 5 guarded() {
+  t { r fail(5000) } h (12 err) { r 7 }
+}
+z.o(count(100000, 0))
+z.o(is_even(5001))
+z.o(n Walker().walk(3000))
+z.o(guarded()))");
+    REQUIRE(output == "5000050000\n0\n3000\n7\n");
+}
+
+TEST_CASE("For-each iterates lazily", "[vm][loops]") {
+    // The range is past the z.range list limit; strings go by code point.
+    std::string output = test::run_capture(R"(#alphabet<en>
+5 total = 0
+l (num : z.range(2000000)) { total = total + num }
+z.o(total)
+l (ch : "hé!") { z.o(ch) }
+14 mp = {"x": 1, "y": 2}
+l (key : mp) { z.o(key) }
+l (val : z.values(mp)) { z.o(val) }
+l (val : z.range(6, 0, -3)) { z.o(val) }
+outer: l (aa : [1, 2]) {
+  l (bb : [10, 20, 30]) {
+    i (bb == 20) { k }
+    i (aa == 2) { b outer }
+    z.o(aa + bb)
+  }
+})");
+    REQUIRE(output == "1999999000000\nh\né\n!\nx\ny\n1\n2\n6\n3\n11\n31\n");
+}
+
+TEST_CASE("Reused call frames start clean", "[vm][functions]") {
+    // `risky` returns from inside its try block, so its frame is popped
+    // with a handler still registered; later calls reuse that frame.
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 risky(5 v) {
+  t {
+    i (v % 2 == 0) { z.t("even") }
+    r v
+  } h (12 err) {
+    r 0 - v
+  }
+}
+m 5 walk(5 num) {
+  i (num == 0) { r 0 }
+  r walk(num - 1) + risky(num)
+}
+m 5 plain(5 v) {
+  z.t("boom")
+  r v
+}
+z.o(walk(200))
+z.o(walk(3))
+t {
+  plain(1)
+} h (12 err) {
+  z.o("caught " + err)
+})");
+    REQUIRE(output == "-100\n2\ncaught boom\n");
+}
+
 TEST_CASE("Accessing undefined variable returns nil", "[vm][negative]") {
     // Undefined variables resolve to nil. Verify it doesn't crash.
     // z.o(nil) should print empty/null without throwing.
@@ -673,6 +1432,42 @@ TEST_CASE("Lambda captures global variable (closure)", "[vm][closure]") {
     REQUIRE(output == "50\n");
 }
 
+TEST_CASE("For-each variables are frame locals", "[vm][loops]") {
+    // Each recursive call has its own loop variable and iterator, and
+    // neither leaks into the globals.
+    std::string output = test::run_capture(R"(#alphabet<en>
+m 5 recsum(13 xs, 5 depth) {
+  5 acc = 0
+  l (vv : xs) {
+    acc = acc + vv
+    i (depth > 0) { acc = acc + recsum(xs, depth - 1) }
+    acc = acc + vv
+  }
+  r acc
+}
+z.o(recsum([1, 2], 1))
+z.o(recsum([1, 2], 3))
+z.o(vv))");
+    REQUIRE(output == "18\n90\nnull\n");
+}
+
+TEST_CASE("Stream fuses map, filter and reduce", "[vm][functional]") {
+    // Each element passes through every stage before the next is read.
+    std::string output = test::run_capture(R"(#alphabet<en>
+13 nums = [1, 2, 3, 4, 5]
+13 seen = []
+5 total = z.stream(nums)
+  .map(m (5 x) { z.append(seen, x) r x * x })
+  .filter(m (5 x) { z.append(seen, -x) r x % 2 == 1 })
+  .reduce(m (5 acc, 5 x) { r acc + x }, 0)
+z.o(total)
+z.o(seen)
+z.o(z.stream("abc").map(m (12 c) { r z.upper(c) }).list())
+l (big : z.stream(nums).filter(m (5 x) { r x > 3 })) { z.o(big) }
+z.o(z.type(z.stream(nums))))");
+    REQUIRE(output == "35\n[1, -1, 2, -4, 3, -9, 4, -16, 5, -25]\n[A, B, C]\n4\n5\niterator\n");
+}
+
 TEST_CASE("z.map with closure captures global", "[vm][closure]") {
     std::string output = test::run_capture("#alphabet<en>\n5 factor = 3\n5 lst = [1, 2, 3]\n5 result = z.map(lst, m(5 "
                                            "val) { r val * factor })\nz.o(z.tostr(result))");